@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "bench.h"
+#include "config.h"
+#include "graph.h"
+#include "network.h"
+#include "util.h"
+
+extern int VALID_LINES;
+extern int VALID_NODES;
+extern Graph graph;
+extern unsigned int rngSeed;
+extern SimConfig config;
+
+static const char* PHASE_NAMES[BENCH_NUM_PHASES] = { "spawn", "trains", "citizens", "output", "tick" };
+
+bool BenchmarkParams::set(const std::string& argument) {
+	size_t split = argument.find('=');
+	if (split == std::string::npos) {
+		return false;
+	}
+	std::string key = argument.substr(0, split);
+	std::string value = argument.substr(split + 1);
+	if (key == "ticks") return util::parseUnsigned(value, &ticks);
+	else if (key == "warmup") return util::parseUnsigned(value, &warmup);
+	else if (key == "output") output = value;
+	else return false;
+	return true;
+}
+
+bool BenchmarkParams::validate() {
+	bool valid = true;
+	if (ticks < 1) {
+		std::cout << "ERR: ticks must be at least 1" << std::endl;
+		valid = false;
+	}
+	return valid;
+}
+
+void BenchmarkRecorder::reserve(size_t ticks) {
+	for (std::vector<float>& samples : phases) {
+		samples.reserve(ticks);
+	}
+}
+
+// nearest-rank percentile of sorted samples
+static float percentile(const std::vector<float>& sorted, double p) {
+	if (sorted.empty()) return 0;
+	size_t rank = size_t(p / 100 * sorted.size());
+	return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+static std::string jsonString(const std::string& s) {
+	std::string out = "\"";
+	for (char c : s) {
+		if (c == '"' || c == '\\') out += '\\';
+		if (c >= 0 && c < 0x20) continue;
+		out += c;
+	}
+	return out + "\"";
+}
+
+static std::string compilerName() {
+	#if defined(__clang__)
+	return "clang " __clang_version__;
+	#elif defined(__GNUC__)
+	return "gcc " __VERSION__;
+	#elif defined(_MSC_VER)
+	return "msvc " + std::to_string(_MSC_VER);
+	#else
+	return "unknown";
+	#endif
+}
+
+int writeBenchmarkReport(const BenchmarkParams& params, BenchmarkRecorder& recorder, const BenchmarkTotals& totals, MemoryTracker& memory) {
+	std::ostringstream json;
+	double seconds = std::max(totals.seconds, 1e-9);
+	json << "{\n";
+	json << "\t\"options\": { \"ticks\": " << params.ticks << ", \"warmup\": " << params.warmup << ", \"threads\": " << config.threads
+		<< ", \"agents\": " << config.agents << ", \"seed\": " << rngSeed << ", \"network\": " << jsonString(config.network)
+		<< ", \"settings\": " << jsonString(config.arguments()) << " },\n";
+	json << "\t\"build\": { \"compiler\": " << jsonString(compilerName()) << ", \"date\": " << jsonString(__DATE__ " " __TIME__) << ", \"network_build_key\": \"" << std::hex << networkBuildKey() << std::dec << "\" },\n";
+	json << "\t\"network\": { \"nodes\": " << VALID_NODES << ", \"edges\": " << graph.numEdges << ", \"lines\": " << VALID_LINES << " },\n";
+	json << "\t\"throughput\": { \"seconds\": " << totals.seconds << ", \"ticks_per_second\": " << totals.ticks / seconds
+		<< ", \"agent_updates_per_second\": " << recorder.agentTicks / seconds << ", \"spawned_per_second\": " << totals.spawned / seconds
+		<< ", \"mean_active_agents\": " << (totals.ticks > 0 ? recorder.agentTicks / totals.ticks : 0) << " },\n";
+
+	json << "\t\"phases_us\": {\n";
+	for (int p = 0; p < BENCH_NUM_PHASES; p++) {
+		std::vector<float>& samples = recorder.phases[p];
+		double sum = 0;
+		for (float s : samples) sum += s;
+		std::sort(samples.begin(), samples.end());
+		json << "\t\t\"" << PHASE_NAMES[p] << "\": { \"mean\": " << (samples.empty() ? 0 : sum / samples.size())
+			<< ", \"p50\": " << percentile(samples, 50) << ", \"p90\": " << percentile(samples, 90) << ", \"p99\": " << percentile(samples, 99)
+			<< ", \"p999\": " << percentile(samples, 99.9) << ", \"max\": " << (samples.empty() ? 0 : samples.back()) << " }"
+			<< (p + 1 < BENCH_NUM_PHASES ? ",\n" : "\n");
+	}
+	json << "\t},\n";
+
+	MemoryUsage current = memory.current();
+	MemoryUsage peak = memory.peak();
+	json << "\t\"memory\": {\n";
+	json << "\t\t\"peak_rss_bytes\": " << util::peakResidentBytes() << ", \"accounted_bytes\": " << current.total() << ", \"peak_accounted_bytes\": " << memory.peakTotal()
+		<< ", \"bytes_per_agent\": " << current.bytesPerAgent() << ",\n";
+	json << "\t\t\"subsystems\": {\n";
+	for (int s = 0; s < MEMORY_NUM_SUBSYSTEMS; s++) {
+		json << "\t\t\t\"" << MEMORY_SUBSYSTEM_NAMES[s] << "\": { \"bytes\": " << current.bytes[s] << ", \"peak\": " << peak.bytes[s] << " }"
+			<< (s + 1 < MEMORY_NUM_SUBSYSTEMS ? ",\n" : "\n");
+	}
+	json << "\t\t}\n";
+	json << "\t},\n";
+	json << "\t\"path_cache\": { \"requests\": " << totals.pathRequests << ", \"hits\": " << totals.pathCacheHits << ", \"fails\": " << totals.pathFails
+		<< ", \"hit_rate\": " << (totals.pathRequests > 0 ? double(totals.pathCacheHits) / totals.pathRequests : 0) << " }\n";
+	json << "}\n";
+
+	if (params.output == "-") {
+		std::cout << json.str();
+		return AOK;
+	}
+	std::ofstream out(params.output, std::ios::trunc);
+	if (!out) {
+		std::cerr << "Error opening " << params.output << std::endl;
+		return ERROR_OPENING_FILE;
+	}
+	out << json.str();
+	std::cout << "Benchmark report written to " << params.output << std::endl;
+	return AOK;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "macros.h"
+#include "footprint.h"
+
+// options of a `citysim bench` run, defaults from the macros they override
+// the simulation itself (threads, agents, seed, network...) is set up by SimConfig, which bench arguments also set
+struct BenchmarkParams {
+	unsigned long ticks = BENCHMARK_TICK_AMT; // measured ticks
+	unsigned long warmup = BENCHMARK_WARMUP_TICKS; // ticks run before measuring starts
+	std::string output = BENCHMARK_REPORT_FILE; // "-" for stdout
+
+	// sets one option from a key=value argument, false if the key is unknown or the value invalid
+	bool set(const std::string& argument);
+	// false (after printing why) if the options cannot be run
+	bool validate();
+};
+
+// parts of a simulation tick that are timed separately (BENCH_PHASE_TICK is the whole tick)
+enum BenchmarkPhase {
+	BENCH_PHASE_SPAWN, // draining the spawn queue
+	BENCH_PHASE_TRAINS, // spawning, moving and applying stop events of trains
+	BENCH_PHASE_CITIZENS, // updating and removing citizens
+	BENCH_PHASE_OUTPUT, // telemetry, trajectory, snapshots and checkpoints
+	BENCH_PHASE_TICK,
+	BENCH_NUM_PHASES
+};
+
+// per-tick samples of the measured part of a benchmark run (simulation thread only)
+class BenchmarkRecorder {
+public:
+	void reserve(size_t ticks);
+
+	inline void record(const float micros[BENCH_NUM_PHASES], size_t activeCitizens) {
+		for (int p = 0; p < BENCH_NUM_PHASES; p++) {
+			phases[p].push_back(micros[p]);
+		}
+		agentTicks += activeCitizens;
+	}
+
+	std::vector<float> phases[BENCH_NUM_PHASES]; // microseconds per tick
+	uint64_t agentTicks = 0; // active citizens summed over the measured ticks
+};
+
+// counters over the measured part of a benchmark run (differences between its start and end)
+struct BenchmarkTotals {
+	double seconds;
+	uint64_t ticks;
+	uint64_t spawned; // citizens routed and published
+	uint64_t pathRequests;
+	uint64_t pathCacheHits;
+	uint64_t pathFails;
+};
+
+// writes a JSON report of the run (options and settings, build, network, throughput, phase percentiles, memory per subsystem and peak RSS, path cache)
+// phases are sorted in place
+int writeBenchmarkReport(const BenchmarkParams& params, BenchmarkRecorder& recorder, const BenchmarkTotals& totals, MemoryTracker& memory);
@@ -0,0 +1,289 @@
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include "checkpoint.h"
+#include "network.h"
+#include "graph.h"
+#include "line.h"
+#include "node.h"
+#include "pathcache.h"
+#include "train.h"
+#include "timetable.h"
+#include "citizen.h"
+#include "config.h"
+
+extern int VALID_LINES;
+extern int VALID_NODES;
+extern std::vector<Line> lines;
+extern std::vector<Node> nodes;
+extern Graph graph;
+extern Line WALKING_LINE;
+extern TrainStore trains;
+extern Timetable timetable;
+extern CitizenVector citizens;
+extern PathCache cache;
+extern int pathRequests;
+extern int pathCacheHits;
+extern int pathFails;
+extern unsigned int rngSeed;
+extern std::mt19937_64 spawnRNG;
+extern long unsigned int simTick;
+extern std::atomic<unsigned int> simTime;
+extern std::atomic<unsigned int> handledCitizens;
+extern bool toggleSpawn;
+extern SimConfig config;
+
+CheckpointWriter::CheckpointWriter(Node* nodeArray, Line* lineArray, Line* walkingLine) {
+	nodeBase = nodeArray;
+	lineBase = lineArray;
+	walkingLineRef = walkingLine;
+}
+
+int32_t CheckpointWriter::node(const Node* n) {
+	return n == nullptr ? CHECKPOINT_NULL : int32_t(n - nodeBase);
+}
+
+int32_t CheckpointWriter::line(const Line* l) {
+	if (l == nullptr) return CHECKPOINT_NULL;
+	return l == walkingLineRef ? GRAPH_WALKING_LINE : int32_t(l - lineBase);
+}
+
+int CheckpointWriter::write(const std::string& filename) {
+	CheckpointHeader header = {};
+	std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.version = CHECKPOINT_VERSION;
+	header.byteOrder = NETWORK_BYTE_ORDER_MARK;
+	header.buildKey = checkpointBuildKey();
+	header.network = checkpointNetworkKey();
+	header.checksum = networkChecksum(payload.data(), payload.size());
+	header.payloadSize = payload.size();
+
+	// never leave a half-written checkpoint behind under the real name
+	std::string tempName = filename + ".tmp";
+	{
+		std::ofstream out(tempName, std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) {
+			std::cerr << "Error opening " << tempName << std::endl;
+			return ERROR_OPENING_FILE;
+		}
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(payload.data()), std::streamsize(payload.size()));
+		if (!out) {
+			std::cerr << "Error writing " << tempName << std::endl;
+			return ERROR_OPENING_FILE;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(tempName, filename, error);
+	if (error) {
+		std::cerr << "Error renaming " << tempName << " to " << filename << ": " << error.message() << std::endl;
+		return ERROR_OPENING_FILE;
+	}
+	return AOK;
+}
+
+CheckpointReader::CheckpointReader(Node* nodeArray, int numNodes, Line* lineArray, int numLines, Line* walkingLine) {
+	nodeBase = nodeArray;
+	nodeCount = numNodes;
+	lineBase = lineArray;
+	lineCount = numLines;
+	walkingLineRef = walkingLine;
+}
+
+int CheckpointReader::open(const std::string& filename) {
+	std::ifstream in(filename, std::ios::binary);
+	if (!in.is_open()) {
+		std::cerr << "Error opening " << filename << std::endl;
+		return ERROR_OPENING_FILE;
+	}
+	CheckpointHeader header;
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+		std::cout << "ERR: " << filename << " is truncated" << std::endl;
+		return ERROR_INVALID_FILE;
+	}
+	if (std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 || header.byteOrder != NETWORK_BYTE_ORDER_MARK) {
+		std::cout << "ERR: " << filename << " is not a checkpoint for this machine" << std::endl;
+		return ERROR_INVALID_FILE;
+	}
+	if (header.version != CHECKPOINT_VERSION || header.buildKey != checkpointBuildKey()) {
+		std::cout << "ERR: " << filename << " was saved by another version or configuration" << std::endl;
+		return ERROR_INVALID_FILE;
+	}
+	if (header.network != checkpointNetworkKey()) {
+		std::cout << "ERR: " << filename << " was saved with another network" << std::endl;
+		return ERROR_INVALID_FILE;
+	}
+
+	payload.resize(size_t(header.payloadSize));
+	if (!in.read(reinterpret_cast<char*>(payload.data()), std::streamsize(payload.size())) || in.peek() != EOF) {
+		std::cout << "ERR: " << filename << " is truncated" << std::endl;
+		return ERROR_INVALID_FILE;
+	}
+	if (networkChecksum(payload.data(), payload.size()) != header.checksum) {
+		std::cout << "ERR: " << filename << " failed its checksum" << std::endl;
+		return ERROR_INVALID_FILE;
+	}
+	position = 0;
+	ok = true;
+	return AOK;
+}
+
+Node* CheckpointReader::node(int32_t index) {
+	if (index == CHECKPOINT_NULL) return nullptr;
+	if (index < 0 || index >= nodeCount) {
+		ok = false;
+		return nullptr;
+	}
+	return nodeBase + index;
+}
+
+Line* CheckpointReader::line(int32_t index) {
+	if (index == CHECKPOINT_NULL) return nullptr;
+	if (index == GRAPH_WALKING_LINE) return walkingLineRef;
+	if (index < 0 || index >= lineCount) {
+		ok = false;
+		return nullptr;
+	}
+	return lineBase + index;
+}
+
+uint64_t checkpointBuildKey() {
+	const double parameters[] = {
+		double(networkBuildKey() >> 32), double(networkBuildKey() & 0xFFFFFFFF),
+		CITIZEN_PATH_SIZE, PATH_CACHE_BUCKETS, PATH_CACHE_BUCKETS_SIZE,
+		SIM_START_TIME, TICKS_PER_MINUTE, double(sizeof(Citizen))
+	};
+	return networkChecksum(reinterpret_cast<const uint8_t*>(parameters), sizeof(parameters));
+}
+
+uint64_t checkpointNetworkKey() {
+	std::vector<uint32_t> structure = { uint32_t(VALID_NODES), uint32_t(VALID_LINES), uint32_t(graph.numEdges) };
+	structure.insert(structure.end(), graph.offsets, graph.offsets + graph.numNodes + 1);
+	structure.insert(structure.end(), graph.targets, graph.targets + graph.numEdges);
+	for (int l = 0; l < VALID_LINES; l++) {
+		structure.push_back(uint32_t(lines[l].size));
+		for (int i = 0; i < lines[l].size; i++) {
+			structure.push_back(uint32_t(lines[l].path[i]->index));
+		}
+	}
+	return networkChecksum(reinterpret_cast<const uint8_t*>(structure.data()), structure.size() * sizeof(uint32_t));
+}
+
+int saveCheckpoint(const std::string& filename) {
+	CheckpointWriter out(nodes.data(), lines.data(), &WALKING_LINE);
+
+	// settings the run depends on, a checkpoint only resumes with the same ones
+	std::string settings = config.simulationArguments();
+	out.put(std::vector<char>(settings.begin(), settings.end()));
+
+	// clock and spawning
+	out.put(rngSeed);
+	out.put(uint64_t(simTick));
+	out.put(handledCitizens.load());
+	out.put(toggleSpawn);
+	std::ostringstream rngState;
+	rngState << spawnRNG;
+	std::string rngText = rngState.str();
+	out.put(std::vector<char>(rngText.begin(), rngText.end()));
+
+	// timetable cursors
+	std::vector<unsigned long long> nextTrips;
+	for (TimetableRoute& route : timetable.routes) {
+		nextTrips.push_back(route.nextTrip);
+	}
+	out.put(nextTrips);
+
+	trains.save(out);
+
+	// node counters and the trains waiting on every platform
+	for (int i = 0; i < VALID_NODES; i++) {
+		Node& node = nodes[i];
+		out.put(node.capacity);
+		out.put(node.totalRiders);
+		for (Platform& platform : node.platforms) {
+			out.put(platform.trains);
+		}
+	}
+
+	citizens.save(out);
+
+	cache.save(out);
+	out.put(pathRequests);
+	out.put(pathCacheHits);
+	out.put(pathFails);
+
+	int status = out.write(filename);
+	if (status == AOK) {
+		std::cout << "Saved checkpoint at tick " << simTick << " (" << citizens.activeSize() << " citizens, " << trains.activeSize() << " trains) to " << filename << std::endl;
+	}
+	return status;
+}
+
+int loadCheckpoint(const std::string& filename) {
+	CheckpointReader in(nodes.data(), VALID_NODES, lines.data(), VALID_LINES, &WALKING_LINE);
+	int status = in.open(filename);
+	if (status != AOK) {
+		return status;
+	}
+
+	std::vector<char> settingsText;
+	in.get(settingsText);
+	std::string settings(settingsText.begin(), settingsText.end());
+	if (in.valid() && settings != config.simulationArguments()) {
+		std::cout << "ERR: " << filename << " was saved with other settings, resume it with " << settings << std::endl;
+		return ERROR_INVALID_FILE;
+	}
+
+	uint64_t tick = 0;
+	unsigned int handled = 0;
+	std::vector<char> rngText;
+	in.get(rngSeed);
+	in.get(tick);
+	in.get(handled);
+	in.get(toggleSpawn);
+	in.get(rngText);
+	std::istringstream rngState(std::string(rngText.begin(), rngText.end()));
+	rngState >> spawnRNG;
+	if (!rngState) in.fail();
+
+	std::vector<unsigned long long> nextTrips;
+	in.get(nextTrips);
+	if (nextTrips.size() != timetable.routes.size()) in.fail();
+	for (size_t r = 0; in.valid() && r < nextTrips.size(); r++) {
+		timetable.routes[r].nextTrip = nextTrips[r];
+	}
+
+	trains.restore(in);
+
+	for (int i = 0; in.valid() && i < VALID_NODES; i++) {
+		Node& node = nodes[i];
+		in.get(node.capacity);
+		in.get(node.totalRiders);
+		for (Platform& platform : node.platforms) {
+			in.get(platform.trains);
+			for (int t : platform.trains) {
+				if (t < 0 || t >= trains.size()) in.fail();
+			}
+		}
+	}
+
+	citizens.restore(in);
+
+	cache.restore(in);
+	in.get(pathRequests);
+	in.get(pathCacheHits);
+	in.get(pathFails);
+
+	if (!in.done()) {
+		std::cout << "ERR: " << filename << " does not match this simulation" << std::endl;
+		return ERROR_INVALID_FILE;
+	}
+	simTick = tick;
+	simTime = SIM_START_TIME + (unsigned int)simTick;
+	handledCitizens = handled;
+	std::cout << "Restored checkpoint at tick " << simTick << " (" << citizens.activeSize() << " citizens, " << trains.activeSize() << " trains) from " << filename << std::endl;
+	return AOK;
+}
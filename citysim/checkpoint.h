@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "macros.h"
+
+class Node;
+struct Line;
+
+// Checkpoint layout (written by saveCheckpoint, native byte order):
+// CheckpointHeader, then the settings the run depends on (see SimConfig::simulationArguments) and the state of the clock, timetable, trains, nodes, citizens and path cache back to back
+// pointers are stored as node/line indices (see CheckpointWriter::node/line), so a checkpoint only fits the network it was saved with
+#define CHECKPOINT_MAGIC			"CSCHKPNT"
+#define CHECKPOINT_VERSION			2
+#define CHECKPOINT_NULL				-2 // index of a null node/line pointer (the walking line is GRAPH_WALKING_LINE)
+
+struct CheckpointHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint64_t buildKey; // see checkpointBuildKey
+	uint64_t network; // see checkpointNetworkKey
+	uint64_t checksum; // over the payload
+	uint64_t payloadSize;
+};
+
+// appends state to an in-memory payload
+class CheckpointWriter {
+public:
+	CheckpointWriter(Node* nodeArray, Line* lineArray, Line* walkingLine);
+
+	// trivially copyable values only
+	template<class T>
+	void put(const T& value) {
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+		payload.insert(payload.end(), bytes, bytes + sizeof(T));
+	}
+	// element count, then the elements
+	template<class T>
+	void put(const std::vector<T>& values) {
+		put(uint64_t(values.size()));
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(values.data());
+		payload.insert(payload.end(), bytes, bytes + values.size() * sizeof(T));
+	}
+
+	int32_t node(const Node* n);
+	int32_t line(const Line* l);
+
+	// writes header and payload to a temporary file and renames it over filename
+	int write(const std::string& filename);
+private:
+	Node* nodeBase;
+	Line* lineBase;
+	Line* walkingLineRef;
+	std::vector<uint8_t> payload;
+};
+
+// reads state back in the order it was written, every get fails (and keeps failing) once the payload runs out or holds an invalid index
+class CheckpointReader {
+public:
+	CheckpointReader(Node* nodeArray, int numNodes, Line* lineArray, int numLines, Line* walkingLine);
+
+	// reads filename and checks its magic, version, byte order, build key, network key and checksum
+	int open(const std::string& filename);
+
+	template<class T>
+	bool get(T& value) {
+		if (!ok || sizeof(T) > payload.size() - position) {
+			ok = false;
+			return false;
+		}
+		std::memcpy(&value, payload.data() + position, sizeof(T));
+		position += sizeof(T);
+		return true;
+	}
+	template<class T>
+	bool get(std::vector<T>& values) {
+		uint64_t count = 0;
+		if (!get(count) || count > (payload.size() - position) / sizeof(T)) {
+			ok = false;
+			return false;
+		}
+		values.resize(size_t(count));
+		std::memcpy(values.data(), payload.data() + position, size_t(count) * sizeof(T));
+		position += size_t(count) * sizeof(T);
+		return true;
+	}
+
+	Node* node(int32_t index);
+	Line* line(int32_t index);
+
+	// marks the checkpoint invalid (for inconsistencies only the caller can see)
+	inline void fail() {
+		ok = false;
+	}
+	// true if every read so far succeeded
+	inline bool valid() {
+		return ok;
+	}
+	// true if the whole payload has been read
+	inline bool done() {
+		return ok && position == payload.size();
+	}
+private:
+	Node* nodeBase;
+	int nodeCount;
+	Line* lineBase;
+	int lineCount;
+	Line* walkingLineRef;
+	std::vector<uint8_t> payload;
+	size_t position = 0;
+	bool ok = true;
+};
+
+// hash of the macros that change the layout or meaning of the saved state
+uint64_t checkpointBuildKey();
+// hash of the loaded network's structure (nodes, lines and graph), checkpoints of other networks are rejected
+uint64_t checkpointNetworkKey();
+
+// saves the simulation between ticks: clock, spawn RNG, timetable cursors, trains, node counters and platforms, citizens and path cache
+// must run on the simulation thread with no spawner mid-publish (see simulationThread)
+int saveCheckpoint(const std::string& filename);
+// replaces that state after init(), fails if the checkpoint is invalid or for another network
+// (state may be partly replaced by then, so the run must not continue)
+int loadCheckpoint(const std::string& filename);
@@ -0,0 +1,62 @@
+#include <cmath>
+#include "circles.h"
+
+CircleBatch::CircleBatch(int numPoints) : buffer(sf::Triangles, sf::VertexBuffer::Usage::Stream) {
+	vertsPerCircle = numPoints * 3;
+	// same points as sf::CircleShape, starting at the top
+	for (int j = 0; j <= numPoints; j++) {
+		float angle = j * 2 * 3.141592654f / numPoints - 3.141592654f / 2;
+		unitCircle.push_back(Vector2f(std::cos(angle), std::sin(angle)));
+	}
+	useBuffer = sf::VertexBuffer::isAvailable();
+}
+
+void CircleBatch::resize(size_t count) {
+	size_t oldCount = instances.size();
+	instances.resize(count, { Vector2f(0, 0), 0.0f, sf::Color::Transparent });
+	vertices.resize(count * vertsPerCircle);
+	for (size_t i = oldCount; i < count; i++) {
+		expand(i);
+	}
+	if (count > oldCount) {
+		dirtyBegin = std::min(dirtyBegin, oldCount);
+		dirtyEnd = count;
+	}
+	// grow the buffer geometrically, its old contents are lost
+	if (useBuffer && count > bufferCircles) {
+		bufferCircles = std::max(count, bufferCircles * 2);
+		useBuffer = buffer.create(bufferCircles * vertsPerCircle);
+		dirtyBegin = 0;
+		dirtyEnd = count;
+	}
+	dirtyEnd = std::min(dirtyEnd, count);
+}
+
+void CircleBatch::expand(size_t i) {
+	const Instance& instance = instances[i];
+	sf::Vertex* v = &vertices[i * vertsPerCircle];
+	for (int j = 0; j < vertsPerCircle / 3; j++) {
+		v[j * 3] = sf::Vertex(unitCircle[j] * instance.radius + instance.position, instance.color);
+		v[j * 3 + 1] = sf::Vertex(instance.position, instance.color);
+		v[j * 3 + 2] = sf::Vertex(unitCircle[j + 1] * instance.radius + instance.position, instance.color);
+	}
+}
+
+void CircleBatch::update() {
+	if (dirtyBegin >= dirtyEnd) return;
+	if (useBuffer) {
+		buffer.update(&vertices[dirtyBegin * vertsPerCircle], (dirtyEnd - dirtyBegin) * vertsPerCircle, unsigned(dirtyBegin * vertsPerCircle));
+	}
+	dirtyBegin = SIZE_MAX;
+	dirtyEnd = 0;
+}
+
+void CircleBatch::draw(sf::RenderTarget& target, sf::RenderStates states) const {
+	if (instances.empty()) return;
+	if (useBuffer) {
+		target.draw(buffer, 0, instances.size() * vertsPerCircle, states);
+	}
+	else {
+		target.draw(vertices.data(), vertices.size(), sf::Triangles, states);
+	}
+}
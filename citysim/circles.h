@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <SFML/Graphics.hpp>
+
+typedef sf::Vector2f Vector2f;
+
+// circles with the same point count, drawn as one batch of triangles (a fan around the center of each circle)
+// the unit circle is computed once, only circles that changed are expanded to vertices, and only the range they span is uploaded
+// uses a streamed sf::VertexBuffer if the GPU supports it and draws from memory otherwise
+class CircleBatch : public sf::Drawable {
+public:
+	explicit CircleBatch(int numPoints);
+
+	// sets the number of circles drawn, new ones are empty until set
+	void resize(size_t count);
+	inline size_t size() {
+		return instances.size();
+	}
+	inline void set(size_t i, Vector2f position, float radius, sf::Color color) {
+		Instance& instance = instances[i];
+		if (instance.position == position && instance.radius == radius && instance.color == color) return;
+		instance = { position, radius, color };
+		expand(i);
+		dirtyBegin = std::min(dirtyBegin, i);
+		dirtyEnd = std::max(dirtyEnd, i + 1);
+	}
+	// uploads the circles set since the last update, call once per frame before drawing
+	void update();
+private:
+	struct Instance {
+		Vector2f position;
+		float radius;
+		sf::Color color;
+	};
+
+	int vertsPerCircle;
+	std::vector<Vector2f> unitCircle; // numPoints + 1 rim points, the last one repeats the first
+	std::vector<Instance> instances;
+	std::vector<sf::Vertex> vertices;
+	sf::VertexBuffer buffer;
+	bool useBuffer;
+	size_t bufferCircles = 0; // circles the buffer has room for
+	size_t dirtyBegin = SIZE_MAX; // circles [dirtyBegin, dirtyEnd) changed since the last update
+	size_t dirtyEnd = 0;
+
+	void expand(size_t i);
+	void draw(sf::RenderTarget& target, sf::RenderStates states) const override;
+};
@@ -1,17 +1,23 @@
 #include "citizen.h"
+#include "checkpoint.h"
+#include "locks.h"
+#include "config.h"
 
 class Node;
 extern Line WALKING_LINE;
+extern TrainStore trains;
+extern Timetable timetable;
+extern std::atomic<unsigned int> simTime;
+extern SimConfig config;
 
-std::mutex blockStack; // controls access to CitizenVector.inactive()
-std::mutex citizensMutex; // controls access to citizens.vec (used for debug reports, simulation, pushing back new citizens)
+InstrumentedMutex citizensMutex("citizensMutex"); // controls access to citizens.vec (used for debug reports, draining new citizens)
 
 #define MOVE if (moveDownPath()) return true
 #define DESPAWN status = STATUS_DESPAWNED; return true
 
 void Citizen::reset() {
 	status = STATUS_SPAWNED;
-	currentTrain = nullptr;
+	currentTrain = TRAIN_NONE;
 	currentNode = path[0].node;
 	currentLine = path[0].line;
 	nextNode = path[1].node;
@@ -20,6 +26,14 @@ void Citizen::reset() {
 	dist = 0;
 }
 
+bool Citizen::spawn(Node* start, Node* end) {
+	if (!start->findPath(end, path, &pathSize)) {
+		return false;
+	}
+	reset();
+	return true;
+}
+
 std::string Citizen::currentPathStr() {
 	char sum[NODE_ID_SIZE * 2 + LINE_ID_SIZE * 2 + 16];
 	std::strcpy(sum, currentNode->id);
@@ -74,7 +88,7 @@ bool Citizen::updatePositionAlongPath() {
 	case STATUS_TRANSFER:
 		if (timer > CITIZEN_TRANSFER_THRESH) {
 			timer = 0;
-			int currentInd, nextInd;
+			int currentInd = -1, nextInd = -1;
 			for (int i = 0; i < currentLine->size; i++) {
 				Node* n = currentLine->path[i];
 				if (n == currentNode) {
@@ -84,39 +98,55 @@ bool Citizen::updatePositionAlongPath() {
 					nextInd = i;
 				}
 			}
+			// a path step that does not follow its line (the direction would be undefined)
+			if (currentInd < 0 || nextInd < 0) {
+				#if CITIZEN_SPAWN_ERRORS == true
+				std::cout << "ERR: despawned INVALID_STEP citizen@" << int(index) << ": " << currentPathStr() << std::endl;
+				#endif
+				util::subCapacity(&currentNode->capacity);
+				DESPAWN;
+			}
 			statusForward = nextInd > currentInd ? STATUS_FORWARD : STATUS_BACKWARD;
-			if (currentInd == 0 || currentInd == currentLine->size - 1) statusForward = STATUS_AMBIVALENT;
+			stopIndex = currentInd;
+			platform = &currentNode->platforms[currentLine->platformIndex(currentInd, statusForward)];
+			// trips end at terminals instead of turning around, so the direction is always known and the wait is exact
+			nextArrival = timetable.nextTrain(currentLine, statusForward, stopIndex, simTime);
 			status = STATUS_AT_STOP;
 		}
 		return false;
 
-	// this is slow! try not to spend too much time at a stop
 	case STATUS_AT_STOP:
-		for (int i = 0; currentNode != nullptr && i < currentNode->numTrains(); i++) { // I don't know why the nullptr check is necessary lmao
-			Train* t = currentNode->trains[i];
-			if (t != nullptr && t->line == currentLine && t->capacity < TRAIN_CAPACITY && (t->statusForward == statusForward || statusForward == STATUS_AMBIVALENT)) {
+		if (simTime < nextArrival) {
+			return false;
+		}
+		// the platform only holds trains of currentLine going the right way, first to arrive boards first
+		for (int t : platform->trains) {
+			if (trains.capacity[t] < config.trainCapacity) {
 				util::subCapacity(&currentNode->capacity);
 				// we could store the distance until reaching the target node on this line locally, to prevent pointer jumps, but this probably has no performance effect
 				status = STATUS_BOARDED;
 				currentTrain = t;
-				currentTrain->capacity++;
+				trains.capacity[currentTrain]++;
 				MOVE;
+				return false;
 			}
 		}
+		// train full, wait for it to leave or for the next one
+		nextArrival = timetable.nextTrain(currentLine, statusForward, stopIndex, simTime + 1);
 		return false;
 
 	case STATUS_BOARDED:
-		if (currentTrain->status == STATUS_IN_TRANSIT) {
+		if (trains.status[currentTrain] == STATUS_IN_TRANSIT) {
 			status = STATUS_IN_TRANSIT;
 		}
 		return false;
 
 	case STATUS_IN_TRANSIT:
-		if (currentTrain->status == STATUS_AT_STOP && currentTrain->getLastStop() == currentNode) {
-			util::subCapacity(&currentTrain->capacity);
+		if (trains.status[currentTrain] == STATUS_AT_STOP && trains.getLastStop(currentTrain) == currentNode) {
+			util::subCapacity(&trains.capacity[currentTrain]);
 			MOVE;
 
-			currentTrain = nullptr;
+			currentTrain = TRAIN_NONE;
 
 			if (currentLine == &WALKING_LINE) {
 				return switch_WALK();
@@ -139,7 +169,7 @@ bool Citizen::cull() {
 		std::cout << "ERR: despawned TIMEOUT citizen @" << int(index) << ": " << currentPathStr() << std::endl;
 		#endif
 		if (status == STATUS_IN_TRANSIT) {
-			util::subCapacity(&currentTrain->capacity);
+			util::subCapacity(&trains.capacity[currentTrain]);
 		}
 		if (status == STATUS_AT_STOP || status == STATUS_TRANSFER) {
 			util::subCapacity(&currentNode->capacity);
@@ -154,48 +184,124 @@ CitizenVector::CitizenVector(size_t reserve, size_t maxS) {
 	maxSize = maxS;
 }
 
-bool CitizenVector::add(Node* start, Node* end) {
-	if (inactive.size() < NUM_CITIZEN_WORKER_THREADS) {
-		if (size() > maxSize) {
-			return false;
+size_t CitizenVector::drain(SpawnQueue<Citizen>& queue) {
+	std::lock_guard<InstrumentedMutex> citizensLock(citizensMutex);
+	size_t inserted = 0;
+	while (!inactive.empty() && queue.pop(vec[inactive.back()])) {
+		inactive.pop_back();
+		inserted++;
+	}
+	while (inactive.empty() && vec.size() < maxSize) {
+		vec.emplace_back();
+		if (!queue.pop(vec.back())) {
+			vec.pop_back();
+			break;
 		}
-		Citizen c = Citizen();
-		if (!start->findPath(end, c.path, &c.pathSize)) {
-			return false;
+		inserted++;
+	}
+	active += inserted;
+	return inserted;
+}
+
+bool CitizenVector::remove(int index) {
+	inactive.push_back(index);
+	active--;
+	return true;
+}
+
+void CitizenVector::save(CheckpointWriter& out) {
+	out.put(uint64_t(vec.size()));
+	for (Citizen& c : vec) {
+		out.put(c.timer);
+		out.put(c.status);
+		out.put(c.index);
+		out.put(c.pathSize);
+		out.put(c.statusForward);
+		out.put(c.stopIndex);
+		// the platform is only used while AT_STOP, where it belongs to currentNode
+		int32_t platform = -1;
+		if (c.platform != nullptr && c.currentNode != nullptr) {
+			std::vector<Platform>& platforms = c.currentNode->platforms;
+			if (c.platform >= platforms.data() && c.platform < platforms.data() + platforms.size()) {
+				platform = int32_t(c.platform - platforms.data());
+			}
 		}
-		c.reset();
-		{
-			std::lock_guard<std::mutex> citizensLock(citizensMutex);
-			vec.push_back(c);
+		out.put(platform);
+		out.put(c.nextArrival);
+		out.put(c.dist);
+		out.put(c.currentTrain);
+		out.put(out.node(c.currentNode));
+		out.put(out.line(c.currentLine));
+		out.put(out.node(c.nextNode));
+		for (PathWrapper& p : c.path) {
+			out.put(out.node(p.node));
+			out.put(out.line(p.line));
 		}
 	}
-	else {
-		Citizen* c;
-		{
-			std::lock_guard<std::mutex> stackLock(blockStack);
-			c = inactive.top();
-			inactive.pop();
-		}
-		if (c == nullptr) {
-			#if CITIZEN_SPAWN_ERRORS == true
-			std::cout << "ERR: found nullptr reference in CitizenVector stack" << std::endl;
-			#endif
-			return false;
+	out.put(inactive);
+	out.put(uint64_t(active.load()));
+}
+
+bool CitizenVector::restore(CheckpointReader& in) {
+	uint64_t count = 0;
+	if (!in.get(count) || count > maxSize) {
+		in.fail();
+		return false;
+	}
+	std::vector<Citizen> restored;
+	restored.resize(size_t(count));
+	for (Citizen& c : restored) {
+		int32_t platform, currentNode, currentLine, nextNode;
+		in.get(c.timer);
+		in.get(c.status);
+		in.get(c.index);
+		in.get(c.pathSize);
+		in.get(c.statusForward);
+		in.get(c.stopIndex);
+		in.get(platform);
+		in.get(c.nextArrival);
+		in.get(c.dist);
+		in.get(c.currentTrain);
+		in.get(currentNode);
+		in.get(currentLine);
+		in.get(nextNode);
+		c.currentNode = in.node(currentNode);
+		c.currentLine = in.line(currentLine);
+		c.nextNode = in.node(nextNode);
+		for (PathWrapper& p : c.path) {
+			int32_t node, line;
+			in.get(node);
+			in.get(line);
+			p.node = in.node(node);
+			p.line = in.line(line);
 		}
-		if (!start->findPath(end, c->path, &c->pathSize)) {
-			{
-				std::lock_guard<std::mutex> stackLock(blockStack);
-				inactive.push(c);
+		c.platform = nullptr;
+		if (platform >= 0) {
+			if (c.currentNode == nullptr || platform >= int32_t(c.currentNode->platforms.size())) {
+				in.fail();
 			}
-			return false;
+			else {
+				c.platform = &c.currentNode->platforms[platform];
+			}
+		}
+		if (c.currentTrain < TRAIN_NONE || c.currentTrain >= trains.size() || c.pathSize < 0 || c.pathSize > CITIZEN_PATH_SIZE) {
+			in.fail();
 		}
+		if (!in.valid()) return false;
+	}
 
-		c->reset();
+	std::vector<int> restoredInactive;
+	uint64_t restoredActive = 0;
+	in.get(restoredInactive);
+	in.get(restoredActive);
+	for (int i : restoredInactive) {
+		if (i < 0 || uint64_t(i) >= count) in.fail();
 	}
-	return true;
-}
+	if (!in.valid()) return false;
 
-bool CitizenVector::remove(int index) {
-	inactive.push(&vec[index]);
+	std::lock_guard<InstrumentedMutex> citizensLock(citizensMutex);
+	vec = std::move(restored);
+	inactive = std::move(restoredInactive);
+	active = size_t(restoredActive);
 	return true;
 }
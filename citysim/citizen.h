@@ -1,12 +1,18 @@
 #pragma once
 
+#include <atomic>
 #include <iostream>
 #include <mutex>
-#include <stack>
+#include <vector>
 #include "macros.h"
 #include "util.h"
 #include "train.h"
+#include "timetable.h"
 #include "line.h"
+#include "spawnqueue.h"
+
+class CheckpointWriter;
+class CheckpointReader;
 
 class Citizen {
 public:
@@ -15,14 +21,19 @@ public:
 	char index;
 	char pathSize;
 	char statusForward;
+	int stopIndex; // index of currentNode on currentLine (AT_STOP)
+	Platform* platform; // where the citizen waits for currentLine (AT_STOP)
+	unsigned int nextArrival; // tick the next train on currentLine reaches currentNode (AT_STOP)
 	float dist;
-	Train* currentTrain;
+	int currentTrain; // train id (see TrainStore)
 	Node* currentNode;
 	Line* currentLine;
 	Node* nextNode;
 	PathWrapper path[CITIZEN_PATH_SIZE]; // path.line[i] is used to travel between path.node[i] and path.node[i+1]
 
 	void reset();
+	// finds a path from start to end and resets the citizen to its first step, false if there is no path
+	bool spawn(Node* start, Node* end);
 	std::string currentPathStr();
 
 	inline bool moveDownPath() {
@@ -75,8 +86,9 @@ public:
 	inline size_t size() {
 		return vec.size();
 	}
+	// safe to call from any thread
 	inline size_t activeSize() {
-		return vec.size() - inactive.size();
+		return active.load(std::memory_order_relaxed);
 	}
 	inline size_t capacity() {
 		return vec.capacity();
@@ -84,11 +96,22 @@ public:
 	inline size_t max() {
 		return maxSize;
 	}
+	// heap bytes of every slot (despawned ones included) and the free slot list
+	inline size_t memoryBytes() {
+		return util::vectorBytes(vec) + util::vectorBytes(inactive);
+	}
 
-	bool add(Node* start, Node* end);
+	// moves every published citizen from queue into free slots (reusing despawned ones first), up to max()
+	// must not run concurrently with citizen updates, returns the number of citizens inserted
+	size_t drain(SpawnQueue<Citizen>& queue);
 	bool remove(int index);
+
+	// every slot (despawned ones included, they are reused in order), pointers as node/line indices (see saveCheckpoint)
+	void save(CheckpointWriter& out);
+	bool restore(CheckpointReader& in);
 private:
 	size_t maxSize;
 	std::vector<Citizen> vec;
-	std::stack<Citizen*> inactive;
+	std::vector<int> inactive; // indices of despawned citizens (stable across reallocations of vec)
+	std::atomic<size_t> active{ 0 };
 };
\ No newline at end of file
@@ -0,0 +1,156 @@
+#include <climits>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include "config.h"
+#include "util.h"
+
+static bool parseBool(const std::string& value) {
+	if (value == "true" || value == "1") return true;
+	if (value == "false" || value == "0") return false;
+	throw std::invalid_argument(value);
+}
+
+// whole-value parsers, they throw like std::stoi does if value is not entirely a number of their type
+static int parseInt(const std::string& value) {
+	size_t used;
+	int v = std::stoi(value, &used);
+	if (used != value.size()) throw std::invalid_argument(value);
+	return v;
+}
+
+static unsigned int parseUnsigned(const std::string& value) {
+	unsigned long v;
+	if (!util::parseUnsigned(value, &v) || v > UINT_MAX) throw std::invalid_argument(value);
+	return (unsigned int)v;
+}
+
+static float parseFloat(const std::string& value) {
+	size_t used;
+	float v = std::stof(value, &used);
+	if (used != value.size()) throw std::invalid_argument(value);
+	return v;
+}
+
+static const char* const KEYS[] = { "threads", "agents", "initial_agents", "spawn_method", "spawn_amount", "spawn_frequency", "cull_frequency",
+	"train_capacity", "transfer_penalty", "seed", "network", "telemetry", "trajectory" };
+
+// s without leading and trailing whitespace (or a Windows line ending)
+static std::string trim(const std::string& s) {
+	size_t first = s.find_first_not_of(" \t\r");
+	if (first == std::string::npos) return "";
+	return s.substr(first, s.find_last_not_of(" \t\r") - first + 1);
+}
+
+bool SimConfig::set(const std::string& argument) {
+	size_t split = argument.find('=');
+	if (split == std::string::npos) {
+		return false;
+	}
+	std::string key = argument.substr(0, split);
+	std::string value = argument.substr(split + 1);
+	try {
+		if (key == "threads") threads = parseInt(value);
+		else if (key == "agents") agents = parseInt(value);
+		else if (key == "initial_agents") initialAgents = parseInt(value);
+		else if (key == "spawn_method") spawnMethod = parseInt(value);
+		else if (key == "spawn_amount") spawnAmount = parseInt(value);
+		else if (key == "spawn_frequency") spawnFrequency = parseInt(value);
+		else if (key == "cull_frequency") cullFrequency = parseInt(value);
+		else if (key == "train_capacity") trainCapacity = parseUnsigned(value);
+		else if (key == "transfer_penalty") transferPenalty = parseFloat(value);
+		else if (key == "seed") seed = parseUnsigned(value);
+		else if (key == "network") network = value;
+		else if (key == "telemetry") telemetry = parseBool(value);
+		else if (key == "trajectory") trajectory = parseBool(value);
+		else return false;
+	}
+	catch (const std::exception&) {
+		return false;
+	}
+	return true;
+}
+
+bool SimConfig::knows(const std::string& argument) {
+	std::string key = argument.substr(0, argument.find('='));
+	for (const char* k : KEYS) {
+		if (key == k) return argument.find('=') != std::string::npos;
+	}
+	return false;
+}
+
+int SimConfig::load(const std::string& filename) {
+	std::ifstream in(filename);
+	if (!in.is_open()) {
+		std::cerr << "Error opening " << filename << std::endl;
+		return ERROR_OPENING_FILE;
+	}
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(in, line)) {
+		lineNumber++;
+		std::string argument = trim(line);
+		if (argument.empty() || argument[0] == '#') continue;
+		// "key = value" reads like "key=value"
+		size_t split = argument.find('=');
+		if (split != std::string::npos) {
+			argument = trim(argument.substr(0, split)) + "=" + trim(argument.substr(split + 1));
+		}
+		if (!set(argument)) {
+			std::cout << "ERR: invalid setting " << argument << " (" << filename << ":" << lineNumber << ")" << std::endl;
+			return ERROR_INVALID_FILE;
+		}
+	}
+	return AOK;
+}
+
+bool SimConfig::validate() {
+	bool valid = true;
+	if (threads < 1 || threads > MAX_CITIZEN_WORKER_THREADS) {
+		std::cout << "ERR: threads must be between 1 and " << MAX_CITIZEN_WORKER_THREADS << std::endl;
+		valid = false;
+	}
+	if (agents < 0 || agents > MAX_CITIZENS || initialAgents < 0 || initialAgents > MAX_CITIZENS) {
+		std::cout << "ERR: agents and initial_agents must be between 0 and " << MAX_CITIZENS << std::endl;
+		valid = false;
+	}
+	if (spawnMethod != 0 && spawnMethod != 1) {
+		std::cout << "ERR: spawn_method must be 0 (target amount) or 1 (fixed amount)" << std::endl;
+		valid = false;
+	}
+	if (spawnAmount < 0 || spawnFrequency < 1 || cullFrequency < 1) {
+		std::cout << "ERR: spawn_amount must not be negative, spawn_frequency and cull_frequency must be at least 1" << std::endl;
+		valid = false;
+	}
+	if (trainCapacity < 1) {
+		std::cout << "ERR: train_capacity must be at least 1" << std::endl;
+		valid = false;
+	}
+	if (!std::isfinite(transferPenalty) || transferPenalty < 0) {
+		std::cout << "ERR: transfer_penalty must be a finite number, not negative" << std::endl;
+		valid = false;
+	}
+	return valid;
+}
+
+std::string SimConfig::arguments() const {
+	std::ostringstream out;
+	out << "threads=" << threads << " agents=" << agents << " initial_agents=" << initialAgents << " spawn_method=" << spawnMethod
+		<< " spawn_amount=" << spawnAmount << " spawn_frequency=" << spawnFrequency << " cull_frequency=" << cullFrequency
+		<< " train_capacity=" << trainCapacity << " transfer_penalty=" << transferPenalty << " seed=" << seed
+		<< " telemetry=" << (telemetry ? "true" : "false") << " trajectory=" << (trajectory ? "true" : "false");
+	if (!network.empty()) {
+		out << " network=" << network;
+	}
+	return out.str();
+}
+
+std::string SimConfig::simulationArguments() const {
+	std::ostringstream out;
+	out << "threads=" << threads << " agents=" << agents << " spawn_method=" << spawnMethod << " spawn_amount=" << spawnAmount
+		<< " spawn_frequency=" << spawnFrequency << " cull_frequency=" << cullFrequency << " train_capacity=" << trainCapacity
+		<< " transfer_penalty=" << transferPenalty;
+	return out.str();
+}
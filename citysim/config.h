@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include "macros.h"
+
+// settings of a run that can change without recompiling, defaults from the macros they override
+// read from CONFIG_FILE (or `config=file`) and then from key=value arguments, which take precedence
+// constants that size arrays (CITIZEN_PATH_SIZE) or are baked into the network image (TRANSFER_PENALTY_MULTIPLIER) stay macros
+struct SimConfig {
+	int threads = NUM_CITIZEN_WORKER_THREADS; // simulation worker threads
+	int agents = TARGET_CITIZEN_COUNT; // target citizen count (spawn_method 0)
+	int initialAgents = CITIZEN_SPAWN_INIT; // citizens spawned before the simulation starts
+	int spawnMethod = CITIZEN_SPAWN_METHOD; // 0 to match agents, 1 for a fixed amount (spawn_amount)
+	int spawnAmount = CITIZEN_SPAWN_AMT;
+	int spawnFrequency = CITIZEN_SPAWN_FREQ; // ticks
+	int cullFrequency = CITIZEN_CULL_FREQ; // ticks
+	unsigned int trainCapacity = TRAIN_CAPACITY;
+	float transferPenalty = TRANSFER_PENALTY;
+	unsigned int seed = RNG_SEED; // 0 to seed from std::random_device
+	std::string network; // network image to load instead of NETWORK_IMAGE_FILE/the CSVs (no fallback), empty for the usual lookup
+	bool telemetry = TELEMETRY; // stream per-tick metrics to TELEMETRY_FILE
+	bool trajectory = TRAJECTORY; // record citizen state transitions to TRAJECTORY_FILE
+
+	// sets one setting from a key=value argument, false if the key is unknown or the value invalid
+	bool set(const std::string& argument);
+	// true if argument is key=value with a key set() reads (whether or not the value is valid)
+	static bool knows(const std::string& argument);
+	// sets every key=value line of filename (blank lines and lines starting with # are skipped)
+	int load(const std::string& filename);
+	// false (after printing why) if the settings cannot be run
+	bool validate();
+	// every setting as key=value arguments (that set() reads back)
+	std::string arguments() const;
+	// the settings a run's results depend on (not seed or network, which checkpoints restore, nor output), as key=value arguments
+	std::string simulationArguments() const;
+};
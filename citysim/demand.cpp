@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include "demand.h"
+#include "util.h"
+#include "config.h"
+
+extern SimConfig config;
+
+static const char* BAND_NAMES[DEMAND_NUM_BANDS] = { "AM", "MIDDAY", "PM", "NIGHT" };
+
+const char* DemandModel::bandName(int band) {
+	return BAND_NAMES[band];
+}
+
+int DemandModel::bandAt(unsigned int time) {
+	time %= SIM_DAY_TICKS;
+	// before the first band starts, the last one (which wraps around midnight) is still in effect
+	int band = DEMAND_NUM_BANDS - 1;
+	for (int b = 0; b < DEMAND_NUM_BANDS; b++) {
+		if (time >= bands[b].start) band = b;
+	}
+	return band;
+}
+
+// keeps the DEMAND_TOP_DESTINATIONS heaviest destinations of row and builds their sampler, returns the kept weight
+static double compileOrigin(DemandBand& band, int origin, std::vector<std::pair<int, double>>& row) {
+	auto heavier = [](const std::pair<int, double>& a, const std::pair<int, double>& b) { return a.second > b.second; };
+	if (int(row.size()) > DEMAND_TOP_DESTINATIONS) {
+		std::nth_element(row.begin(), row.begin() + DEMAND_TOP_DESTINATIONS, row.end(), heavier);
+		row.resize(DEMAND_TOP_DESTINATIONS);
+	}
+
+	std::vector<int>& destinations = band.destinations[origin];
+	std::vector<double> weights;
+	double kept = 0;
+	for (auto& destination : row) {
+		destinations.push_back(destination.first);
+		weights.push_back(destination.second);
+		kept += destination.second;
+	}
+	band.destinationSamplers[origin].build(weights);
+	band.originWeights[origin] = kept;
+	return kept;
+}
+
+int DemandModel::load(const std::string& filename, Node* nodes, int numNodes, const SpatialGrid& index) {
+	const unsigned int starts[DEMAND_NUM_BANDS] = { DEMAND_AM_START, DEMAND_MIDDAY_START, DEMAND_PM_START, DEMAND_NIGHT_START };
+	const float rates[DEMAND_NUM_BANDS] = { DEMAND_AM_RATE, DEMAND_MIDDAY_RATE, DEMAND_PM_RATE, DEMAND_NIGHT_RATE };
+	for (int b = 0; b < DEMAND_NUM_BANDS; b++) {
+		DemandBand& band = bands[b];
+		band.start = starts[b] * 60 * TICKS_PER_MINUTE;
+		band.rate = rates[b];
+		band.originWeights.assign(numNodes, 0);
+		band.destinations.assign(numNodes, std::vector<int>());
+		band.destinationSamplers.assign(numNodes, AliasSampler());
+	}
+
+	std::unordered_map<int, int> nodeIndex;
+	for (int i = 0; i < numNodes; i++) {
+		nodeIndex[nodes[i].numerID] = i;
+	}
+
+	// parse [band, from, to, trips] into sparse rows
+	std::vector<std::vector<std::vector<std::pair<int, double>>>> fileRows(DEMAND_NUM_BANDS);
+	bool fromFile[DEMAND_NUM_BANDS] = {};
+	std::ifstream odCSV(filename);
+	if (!odCSV.is_open()) {
+		std::cout << "No " << filename << " found, synthesizing demand from ridership" << std::endl;
+	}
+	else {
+		std::cout << "Reading " << filename << std::endl;
+		std::string fileLine;
+		while (std::getline(odCSV, fileLine)) {
+			if (fileLine.empty() || fileLine[0] == '#') continue;
+
+			std::stringstream lineStream(fileLine);
+			std::string cell;
+			std::vector<std::string> cells;
+			while (std::getline(lineStream, cell, ',')) {
+				cells.push_back(cell);
+			}
+			if (cells.size() < 4) continue;
+
+			int b = 0;
+			while (b < DEMAND_NUM_BANDS && std::strcmp(BAND_NAMES[b], cells[0].c_str()) != 0) b++;
+			if (b == DEMAND_NUM_BANDS) {
+				std::cout << "WARN: demand references unknown time band " << cells[0] << std::endl;
+				continue;
+			}
+			auto from = nodeIndex.find(std::stoi(cells[1]));
+			auto to = nodeIndex.find(std::stoi(cells[2]));
+			double trips = std::stod(cells[3]);
+			if (from == nodeIndex.end() || to == nodeIndex.end() || from->second == to->second || trips <= 0) continue;
+
+			if (fileRows[b].empty()) fileRows[b].resize(numNodes);
+			fileRows[b][from->second].push_back({ to->second, trips });
+			fromFile[b] = true;
+		}
+	}
+
+	// gravity model: trips(i, j) = production(i) * attraction(j) * exp(-distance(i, j) / DEMAND_GRAVITY_DISTANCE)
+	// ridership stands in for both masses, peaks skew attraction (AM) or production (PM) towards busy stations
+	std::vector<double> mass(numNodes), skewedMass(numNodes);
+	for (int i = 0; i < numNodes; i++) {
+		mass[i] = nodes[i].ridership;
+		skewedMass[i] = std::pow(double(nodes[i].ridership), DEMAND_PEAK_SKEW);
+	}
+	const std::vector<double>* production[DEMAND_NUM_BANDS] = { &mass, &mass, &skewedMass, &mass };
+	const std::vector<double>* attraction[DEMAND_NUM_BANDS] = { &skewedMass, &mass, &mass, &mass };
+
+	// only destinations within reach of an origin are weighed, so synthesis grows with stations * DEMAND_GRAVITY_CANDIDATES instead of stations^2
+	// reach is DEMAND_GRAVITY_CUTOFF decay distances, or less on dense networks (the radius holding about DEMAND_GRAVITY_CANDIDATES stations on average)
+	Vector2f low(FLT_MAX, FLT_MAX);
+	Vector2f high(-FLT_MAX, -FLT_MAX);
+	for (int i = 0; i < numNodes; i++) {
+		Vector2f position = nodes[i].getPosition();
+		low = Vector2f(std::min(low.x, position.x), std::min(low.y, position.y));
+		high = Vector2f(std::max(high.x, position.x), std::max(high.y, position.y));
+	}
+	double area = numNodes > 0 ? std::max(double(high.x - low.x) * double(high.y - low.y), 1.0) : 1.0;
+	float reach = float(std::min(DEMAND_GRAVITY_CUTOFF * DEMAND_GRAVITY_DISTANCE, std::sqrt(DEMAND_GRAVITY_CANDIDATES * area / (3.14159265358979 * std::max(numNodes, 1)))));
+
+	// origins are independent (compileOrigin only touches the origin's own entries), so they are split across threads
+	double total[DEMAND_NUM_BANDS] = {};
+	double kept[DEMAND_NUM_BANDS] = {};
+	int numThreads = config.threads;
+	std::vector<std::array<double, DEMAND_NUM_BANDS>> threadTotal(numThreads), threadKept(numThreads);
+	auto synthesize = [&](int t) {
+		std::vector<uint32_t> candidates;
+		std::vector<double> deterrence;
+		std::vector<std::pair<int, double>> row;
+		for (int i = t; i < numNodes; i += numThreads) {
+			Vector2f origin = nodes[i].getPosition();
+			candidates.clear();
+			deterrence.clear();
+			index.radius(origin, reach, candidates);
+			for (uint32_t j : candidates) {
+				Vector2f delta = nodes[j].getPosition() - origin;
+				deterrence.push_back(std::exp(-std::sqrt(delta.x * delta.x + delta.y * delta.y) / DEMAND_GRAVITY_DISTANCE));
+			}
+
+			for (int b = 0; b < DEMAND_NUM_BANDS; b++) {
+				row.clear();
+				if (fromFile[b]) {
+					row = fileRows[b][i];
+				}
+				else {
+					double p = (*production[b])[i];
+					for (size_t c = 0; c < candidates.size() && p > 0; c++) {
+						int j = int(candidates[c]);
+						double w = p * (*attraction[b])[j] * deterrence[c];
+						if (j != i && w > 0) row.push_back({ j, w });
+					}
+				}
+				for (auto& destination : row) threadTotal[t][b] += destination.second;
+				threadKept[t][b] += compileOrigin(bands[b], i, row);
+			}
+		}
+	};
+	std::vector<std::thread> threads;
+	for (int t = 0; t < numThreads; t++) {
+		threads.emplace_back(synthesize, t);
+	}
+	for (int t = 0; t < numThreads; t++) {
+		threads[t].join();
+		for (int b = 0; b < DEMAND_NUM_BANDS; b++) {
+			total[b] += threadTotal[t][b];
+			kept[b] += threadKept[t][b];
+		}
+	}
+
+	for (int b = 0; b < DEMAND_NUM_BANDS; b++) {
+		DemandBand& band = bands[b];
+		if (!band.origins.build(band.originWeights)) {
+			std::cout << "WARN: no demand in time band " << BAND_NAMES[b] << std::endl;
+		}
+		std::cout << "Demand " << BAND_NAMES[b] << " from " << starts[b] << ":00 (x" << band.rate << "): ";
+		std::cout << (fromFile[b] ? "file" : "gravity model") << ", " << (total[b] > 0 ? kept[b] / total[b] * 100 : 0) << "% of trips kept" << std::endl;
+	}
+	return AOK;
+}
+
+size_t DemandModel::memoryBytes() const {
+	size_t bytes = 0;
+	for (const DemandBand& b : bands) {
+		bytes += util::vectorBytes(b.originWeights) + b.origins.memoryBytes();
+		bytes += util::vectorBytes(b.destinations) + util::vectorBytes(b.destinationSamplers);
+		for (const std::vector<int>& d : b.destinations) {
+			bytes += util::vectorBytes(d);
+		}
+		for (const AliasSampler& sampler : b.destinationSamplers) {
+			bytes += sampler.memoryBytes();
+		}
+	}
+	return bytes;
+}
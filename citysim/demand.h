@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "macros.h"
+#include "node.h"
+#include "sampler.h"
+#include "spatial.h"
+
+// part of the day with its own origin-destination pattern and spawn rate
+struct DemandBand {
+	unsigned int start; // ticks since midnight, each band lasts until the next one starts (the last one wraps)
+	float rate; // spawn multiplier relative to TARGET_CITIZEN_COUNT/CITIZEN_SPAWN_AMT
+	std::vector<double> originWeights; // trips leaving each node, indexed like nodes
+	AliasSampler origins;
+	std::vector<std::vector<int>> destinations; // destinations[i] lists the node indices trips from node i can go to
+	std::vector<AliasSampler> destinationSamplers; // destinationSamplers[i] picks an index into destinations[i]
+};
+
+// origin-destination demand per time band, compiled into alias samplers (see AliasSampler)
+class DemandModel {
+public:
+	DemandBand bands[DEMAND_NUM_BANDS];
+
+	// reads [band, from numerID, to numerID, trips] rows, bands missing from the file are synthesized with a gravity model
+	// needs node positions (and index, built over them) and ridership, every origin keeps its DEMAND_TOP_DESTINATIONS heaviest destinations
+	int load(const std::string& filename, Node* nodes, int numNodes, const SpatialGrid& index);
+
+	// band in effect at time (ticks, may exceed SIM_DAY_TICKS)
+	int bandAt(unsigned int time);
+
+	inline float rateAt(unsigned int time) {
+		#if DEMAND_PROFILE == true
+		return bands[bandAt(time)].rate;
+		#else
+		(void)time;
+		return 1.0f;
+		#endif
+	}
+
+	static const char* bandName(int band);
+
+	// heap bytes held by the samplers and destination lists of every band
+	size_t memoryBytes() const;
+
+	// draws an origin and a destination node index, false if the band has no demand
+	template<class RNG>
+	inline bool sample(int band, RNG& rng, int* origin, int* destination) {
+		DemandBand& b = bands[band];
+		if (b.origins.size() == 0) return false;
+		int o = b.origins.sample(rng);
+		if (b.destinations[o].empty()) return false;
+		*origin = o;
+		*destination = b.destinations[o][b.destinationSamplers[o].sample(rng)];
+		return true;
+	}
+};
@@ -0,0 +1,62 @@
+#include <algorithm>
+#include <cstdio>
+#include "footprint.h"
+#include "util.h"
+
+const char* const MEMORY_SUBSYSTEM_NAMES[MEMORY_NUM_SUBSYSTEMS] = { "citizens", "citizen paths", "spawn queue", "path cache", "graph", "network", "trains", "demand", "render", "telemetry" };
+
+size_t MemoryUsage::total() const {
+	size_t sum = 0;
+	for (size_t b : bytes) {
+		sum += b;
+	}
+	return sum;
+}
+
+double MemoryUsage::bytesPerAgent() const {
+	return agents > 0 ? double(total()) / agents : 0;
+}
+
+void MemoryTracker::sample(const MemoryUsage& usage) {
+	std::lock_guard<std::mutex> trackerLock(trackerMutex);
+	latest = usage;
+	for (int s = 0; s < MEMORY_NUM_SUBSYSTEMS; s++) {
+		peaks.bytes[s] = std::max(peaks.bytes[s], usage.bytes[s]);
+	}
+	peaks.agents = std::max(peaks.agents, usage.agents);
+	peakTotalBytes = std::max(peakTotalBytes, usage.total());
+}
+
+MemoryUsage MemoryTracker::current() {
+	std::lock_guard<std::mutex> trackerLock(trackerMutex);
+	return latest;
+}
+
+MemoryUsage MemoryTracker::peak() {
+	std::lock_guard<std::mutex> trackerLock(trackerMutex);
+	return peaks;
+}
+
+size_t MemoryTracker::peakTotal() {
+	std::lock_guard<std::mutex> trackerLock(trackerMutex);
+	return peakTotalBytes;
+}
+
+void MemoryTracker::report(std::ostream& out) {
+	MemoryUsage now = current();
+	MemoryUsage top = peak();
+	size_t total = now.total();
+	char line[128];
+	std::snprintf(line, sizeof(line), "%-14s %10s %10s %7s\n", "Memory (KiB)", "current", "peak", "share");
+	out << line;
+	for (int s = 0; s < MEMORY_NUM_SUBSYSTEMS; s++) {
+		std::snprintf(line, sizeof(line), "%-14s %10zu %10zu %6.1f%%\n", MEMORY_SUBSYSTEM_NAMES[s], now.bytes[s] / 1024, top.bytes[s] / 1024,
+			total > 0 ? 100.0 * now.bytes[s] / total : 0.0);
+		out << line;
+	}
+	std::snprintf(line, sizeof(line), "%-14s %10zu %10zu\n", "total", total / 1024, peakTotal() / 1024);
+	out << line;
+	std::snprintf(line, sizeof(line), "%.0f bytes per agent (%zu active, %.0f B/agent in citizen slots), peak RSS %zu KiB\n", now.bytesPerAgent(), now.agents,
+		now.agents > 0 ? double(now.bytes[MEMORY_CITIZENS] + now.bytes[MEMORY_CITIZEN_PATHS]) / now.agents : 0.0, util::peakResidentBytes() / 1024);
+	out << line;
+}
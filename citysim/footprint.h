@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <ostream>
+#include "macros.h"
+
+// parts of the program whose heap footprint is accounted for separately
+enum MemorySubsystem {
+	MEMORY_CITIZENS, // citizen slots without their paths, the free slot list
+	MEMORY_CITIZEN_PATHS, // the path array of every citizen slot
+	MEMORY_SPAWN_QUEUE,
+	MEMORY_PATH_CACHE,
+	MEMORY_GRAPH, // CSR edges and per-line stop arrays
+	MEMORY_NETWORK, // nodes (with their platforms), lines (with their track geometry), the spatial index
+	MEMORY_TRAINS, // train columns and the timetable
+	MEMORY_DEMAND,
+	MEMORY_RENDER, // snapshot buffers and the heatmap (the renderer's own vertex buffers are not counted)
+	MEMORY_TELEMETRY, // telemetry, trajectory, profiler and trace buffers
+	MEMORY_NUM_SUBSYSTEMS
+};
+
+extern const char* const MEMORY_SUBSYSTEM_NAMES[MEMORY_NUM_SUBSYSTEMS];
+
+// bytes held by every subsystem at one point in time (capacity, not size, of its containers)
+struct MemoryUsage {
+	size_t bytes[MEMORY_NUM_SUBSYSTEMS] = {};
+	size_t agents = 0; // active citizens when measured
+
+	size_t total() const;
+	// total bytes per active citizen (0 without citizens)
+	double bytesPerAgent() const;
+};
+
+// latest and peak MemoryUsage of the run, sampled by the simulation thread and readable from any thread
+// peaks are per subsystem and of the total, taken over the samples (a peak between two samples is missed)
+class MemoryTracker {
+public:
+	void sample(const MemoryUsage& usage);
+
+	MemoryUsage current();
+	MemoryUsage peak(); // per subsystem maxima (agents is the most active citizens seen)
+	size_t peakTotal();
+
+	// prints a table of every subsystem (bytes, peak, share of the total), the totals, bytes per agent and the process's peak RSS
+	void report(std::ostream& out);
+private:
+	std::mutex trackerMutex;
+	MemoryUsage latest;
+	MemoryUsage peaks;
+	size_t peakTotalBytes = 0;
+};
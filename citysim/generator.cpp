@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include "generator.h"
+#include "util.h"
+
+bool GeneratorParams::set(const std::string& argument) {
+	size_t split = argument.find('=');
+	if (split == std::string::npos) {
+		return false;
+	}
+	std::string key = argument.substr(0, split);
+	std::string value = argument.substr(split + 1);
+	if (key == "stations") return util::parseInt(value, &stations);
+	else if (key == "lines") return util::parseInt(value, &lines);
+	else if (key == "transfers") return util::parseDouble(value, &transfers);
+	else if (key == "extent") return util::parseDouble(value, &extent);
+	else if (key == "ridership") return util::parseDouble(value, &ridership);
+	else if (key == "spread") return util::parseDouble(value, &spread);
+	else if (key == "seed") {
+		unsigned long u;
+		if (!util::parseUnsigned(value, &u) || u > UINT_MAX) return false;
+		seed = (unsigned int)u;
+		return true;
+	}
+	return false;
+}
+
+bool GeneratorParams::validate() {
+	bool valid = true;
+	if (lines < 1 || lines > GENERATOR_MAX_LINES) {
+		std::cout << "ERR: lines must be between 1 and " << GENERATOR_MAX_LINES << std::endl;
+		valid = false;
+	}
+	if (stations < 2 * lines) {
+		std::cout << "ERR: stations must be at least twice the number of lines" << std::endl;
+		valid = false;
+	}
+	if (transfers < 0 || transfers >= 1) {
+		std::cout << "ERR: transfers must be in [0, 1)" << std::endl;
+		valid = false;
+	}
+	if (extent <= 0 || ridership < 1 || spread < 0) {
+		std::cout << "ERR: extent must be positive, ridership at least 1 and spread not negative" << std::endl;
+		valid = false;
+	}
+	return valid;
+}
+
+// line id in base 36 (fits LINE_ID_SIZE for up to GENERATOR_MAX_LINES lines)
+static std::string lineName(int line) {
+	const char* digits = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	std::string name;
+	do {
+		name.insert(name.begin(), digits[line % 36]);
+		line /= 36;
+	} while (line > 0);
+	return name;
+}
+
+// evenly spread hues (golden angle), as a 6 character hex string for util::colorConvert
+static std::string lineColor(int line) {
+	double h = std::fmod(line * 0.618033988749895, 1.0) * 6;
+	double f = h - std::floor(h);
+	double s = 0.75, v = 0.9;
+	double p = v * (1 - s), q = v * (1 - s * f), t = v * (1 - s * (1 - f));
+	double rgb[6][3] = { {v, t, p}, {q, v, p}, {p, v, t}, {p, q, v}, {t, p, v}, {v, p, q} };
+	double* c = rgb[int(h) % 6];
+	std::ostringstream hex;
+	hex << std::hex << std::setfill('0');
+	for (int i = 0; i < 3; i++) {
+		hex << std::setw(2) << int(c[i] * 255);
+	}
+	return hex.str();
+}
+
+static const double pi = 3.14159265358979323846;
+
+// the standard distributions are implementation-defined, so a seed would give another network on every standard library
+// these are derived from the engine's output only (mt19937_64 itself is fully specified)
+
+// uniform in [0, 1) from the top 53 bits of one draw
+static double uniform(std::mt19937_64& rng) {
+	return double(rng() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// standard normal by Box-Muller (the second value of the pair is discarded, every call takes two draws)
+static double normal(std::mt19937_64& rng) {
+	double u = 1.0 - uniform(rng); // (0, 1], keeps the log finite
+	double v = uniform(rng);
+	return std::sqrt(-2 * std::log(u)) * std::cos(2 * pi * v);
+}
+
+int generateNetwork(const std::string& directory, const GeneratorParams& params) {
+	std::mt19937_64 rng = util::rngStream(params.seed, RNG_STREAM_GENERATOR);
+
+	// stop spacing that fills the extent with the requested number of stations, also the radius for reusing stations
+	double spacing = params.extent / std::sqrt(double(params.stations));
+
+	struct Station {
+		double x; // km
+		double y;
+		std::vector<int> lines;
+	};
+	std::vector<Station> stations;
+	stations.reserve(params.stations);
+	std::vector<std::vector<int>> stops(params.lines);
+
+	// stations bucketed into spacing sized cells, to find one to reuse near a stop
+	int cells = int(params.extent / spacing) + 1;
+	std::vector<std::vector<int>> grid(size_t(cells) * cells);
+	auto cellOf = [&](double x, double y) {
+		int cx = std::min(std::max(int(x / spacing), 0), cells - 1);
+		int cy = std::min(std::max(int(y / spacing), 0), cells - 1);
+		return cy * cells + cx;
+	};
+	// closest station within spacing of (x, y) that is not on line yet, -1 if there is none
+	auto nearest = [&](double x, double y, int line) {
+		int cx = cellOf(x, y) % cells;
+		int cy = cellOf(x, y) / cells;
+		int best = -1;
+		double bestDist = spacing * spacing;
+		for (int j = std::max(cy - 1, 0); j <= std::min(cy + 1, cells - 1); j++) {
+			for (int i = std::max(cx - 1, 0); i <= std::min(cx + 1, cells - 1); i++) {
+				for (int s : grid[size_t(j) * cells + i]) {
+					double dx = stations[s].x - x;
+					double dy = stations[s].y - y;
+					if (dx * dx + dy * dy < bestDist && stations[s].lines.back() != line) {
+						best = s;
+						bestDist = dx * dx + dy * dy;
+					}
+				}
+			}
+		}
+		return best;
+	};
+	auto addStop = [&](int line, int station) {
+		stops[line].push_back(station);
+		stations[station].lines.push_back(line);
+	};
+	auto addStation = [&](int line, double x, double y) {
+		stations.push_back({ x, y, {} });
+		grid[cellOf(x, y)].push_back(int(stations.size()) - 1);
+		addStop(line, int(stations.size()) - 1);
+	};
+
+	// every line creates an even share of the stations, reused ones are extra stops
+	int transferStops = 0;
+	for (int l = 0; l < params.lines; l++) {
+		int quota = params.stations / params.lines + (l < params.stations % params.lines ? 1 : 0);
+		double x, y;
+		if (l == 0) {
+			x = uniform(rng) * params.extent;
+			y = uniform(rng) * params.extent;
+			addStation(l, x, y);
+			quota--;
+		}
+		else {
+			// branch off the existing network
+			int start = std::min(int(uniform(rng) * stations.size()), int(stations.size()) - 1);
+			x = stations[start].x;
+			y = stations[start].y;
+			addStop(l, start);
+			transferStops++;
+		}
+
+		double heading = uniform(rng) * 2 * pi;
+		while (quota > 0) {
+			heading += GENERATOR_TURN * normal(rng);
+			double nx = x + std::cos(heading) * spacing;
+			double ny = y + std::sin(heading) * spacing;
+			// bounce off the edges of the extent
+			if (nx < 0 || nx > params.extent) {
+				heading = pi - heading;
+				nx = x + std::cos(heading) * spacing;
+			}
+			if (ny < 0 || ny > params.extent) {
+				heading = -heading;
+				ny = y + std::sin(heading) * spacing;
+			}
+			nx = std::min(std::max(nx, 0.0), params.extent);
+			ny = std::min(std::max(ny, 0.0), params.extent);
+
+			int reuse = uniform(rng) < params.transfers ? nearest(nx, ny, l) : -1;
+			if (reuse >= 0) {
+				addStop(l, reuse);
+				nx = stations[reuse].x;
+				ny = stations[reuse].y;
+				transferStops++;
+			}
+			else {
+				addStation(l, nx, ny);
+				quota--;
+			}
+			x = nx;
+			y = ny;
+		}
+	}
+
+	// number stations from south to north, so nearby stations get nearby indices
+	std::vector<int> order(stations.size());
+	for (size_t i = 0; i < order.size(); i++) order[i] = int(i);
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return stations[a].y < stations[b].y; });
+	std::vector<int> rank(stations.size());
+	for (size_t i = 0; i < order.size(); i++) rank[order[i]] = int(i);
+
+	// log-normal ridership, busier towards the centre and at transfer stations
+	std::vector<double> ridership(stations.size());
+	double totalRidership = 0;
+	for (size_t i = 0; i < stations.size(); i++) {
+		double dx = stations[i].x / params.extent - 0.5;
+		double dy = stations[i].y / params.extent - 0.5;
+		double centrality = 0.5 + 1.5 * std::exp(-8 * (dx * dx + dy * dy));
+		ridership[i] = params.ridership * std::exp(params.spread * normal(rng)) * centrality * (1 + 0.5 * (stations[i].lines.size() - 1));
+		totalRidership += ridership[i];
+	}
+	// the simulation sums ridership in an unsigned int
+	double ridershipScale = std::min(1.0, GENERATOR_MAX_TOTAL_RIDERSHIP / totalRidership);
+
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+	std::filesystem::path path(directory);
+
+	std::ofstream stationsCSV(path / "stations_data.csv");
+	if (!stationsCSV.is_open()) {
+		std::cerr << "Error opening " << (path / "stations_data.csv").string() << std::endl;
+		return ERROR_OPENING_FILE;
+	}
+	// [numerID, id, x, y, lines, ridership], coordinates in degrees around GENERATOR_ORIGIN_LON/LAT
+	const double kmPerDegreeLat = 110.574;
+	const double kmPerDegreeLon = 111.320 * std::cos(GENERATOR_ORIGIN_LAT * pi / 180);
+	stationsCSV << std::fixed << std::setprecision(7);
+	for (size_t i = 0; i < order.size(); i++) {
+		Station& station = stations[order[i]];
+		stationsCSV << i << ",Station " << i << ",";
+		stationsCSV << GENERATOR_ORIGIN_LON + station.x / kmPerDegreeLon << "," << GENERATOR_ORIGIN_LAT + station.y / kmPerDegreeLat << ",";
+		for (size_t j = 0; j < station.lines.size(); j++) {
+			stationsCSV << (j > 0 ? "-" : "") << lineName(station.lines[j]);
+		}
+		stationsCSV << "," << std::max((unsigned int)(ridership[order[i]] * ridershipScale), 1u) << "\n";
+	}
+
+	std::ofstream linesCSV(path / "lines_stations.csv");
+	if (!linesCSV.is_open()) {
+		std::cerr << "Error opening " << (path / "lines_stations.csv").string() << std::endl;
+		return ERROR_OPENING_FILE;
+	}
+	// [id, color, {path}]
+	for (int l = 0; l < params.lines; l++) {
+		linesCSV << lineName(l) << "," << lineColor(l);
+		for (int stop : stops[l]) {
+			linesCSV << "," << rank[stop];
+		}
+		linesCSV << "\n";
+	}
+
+	int transferStations = 0;
+	for (Station& station : stations) {
+		if (station.lines.size() > 1) transferStations++;
+	}
+	std::cout << "Generated " << stations.size() << " stations (" << transferStations << " transfers), " << params.lines << " lines, ";
+	std::cout << stations.size() + transferStops << " stops into " << directory << std::endl;
+	return AOK;
+}
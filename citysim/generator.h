@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include "macros.h"
+
+// parameters of a synthetic network (see generateNetwork), defaults from the GENERATOR_ macros
+struct GeneratorParams {
+	int stations = GENERATOR_STATIONS;
+	int lines = GENERATOR_LINES;
+	double transfers = GENERATOR_TRANSFERS; // chance that a stop reuses a nearby station of another line
+	double extent = GENERATOR_EXTENT; // km, side of the square the stations are placed in
+	double ridership = GENERATOR_RIDERSHIP; // median daily ridership of a station
+	double spread = GENERATOR_RIDERSHIP_SPREAD; // sigma of the log-normal ridership distribution
+	unsigned int seed = GENERATOR_SEED;
+
+	// sets one parameter from a key=value argument, false if the key is unknown or the value invalid
+	bool set(const std::string& argument);
+	// false (after printing why) if the parameters cannot produce a network
+	bool validate();
+};
+
+// writes lines_stations.csv and stations_data.csv for a random network into directory (created if missing)
+// lines wander across the extent dropping a stop every extent / sqrt(stations) km, every station lies on a line and
+// every line after the first starts at an existing station, so the network is connected
+// the same parameters and seed always produce the same files
+int generateNetwork(const std::string& directory, const GeneratorParams& params);
@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <tuple>
+#include "geometry.h"
+#include "line.h"
+#include "node.h"
+
+void Polyline::build(const std::vector<Vector2f>& p) {
+	points.clear();
+	arcLength.clear();
+	for (const Vector2f& point : p) {
+		if (!points.empty()) {
+			Vector2f delta = point - points.back();
+			float l = std::sqrt(delta.x * delta.x + delta.y * delta.y);
+			if (l <= 0) continue; // duplicate points would give zero length pieces
+			arcLength.push_back(arcLength.back() + l);
+		}
+		else {
+			arcLength.push_back(0);
+		}
+		points.push_back(point);
+	}
+}
+
+Vector2f Polyline::at(float s) {
+	if (points.size() < 2) {
+		return points.empty() ? Vector2f(0, 0) : points[0];
+	}
+	s = std::max(0.0f, std::min(s, length()));
+	size_t j = std::upper_bound(arcLength.begin(), arcLength.end(), s) - arcLength.begin();
+	j = std::min(std::max(j, size_t(1)), points.size() - 1);
+	float pieceLength = arcLength[j] - arcLength[j - 1];
+	float t = (s - arcLength[j - 1]) / pieceLength;
+	return points[j - 1] * (1.0f - t) + points[j] * t;
+}
+
+void KinematicProfile::build(float l, float maxSpeed, float a, float d) {
+	length = l;
+	accel = a;
+	decel = d;
+	timeScale = 1.0f;
+
+	// peak speed of a triangular profile covering the whole segment
+	float peak = std::sqrt(2.0f * l * a * d / (a + d));
+	cruise = std::min(maxSpeed, peak);
+	if (cruise <= 0) {
+		accelTime = cruiseTime = decelTime = 0;
+		return;
+	}
+	accelTime = cruise / a;
+	decelTime = cruise / d;
+	cruiseTime = std::max(0.0f, (l - 0.5f * cruise * (accelTime + decelTime)) / cruise);
+}
+
+void KinematicProfile::fitTime(float runTime) {
+	float natural = accelTime + cruiseTime + decelTime;
+	if (runTime <= 0 || natural <= 0) return;
+	if (runTime < natural) {
+		// faster than the speed limit allows, replay the natural profile in fast forward
+		timeScale = natural / runTime;
+		return;
+	}
+	// smaller root of length = v * runTime - v^2 * (1/a + 1/d) / 2
+	float k = 1.0f / accel + 1.0f / decel;
+	float disc = std::max(0.0f, runTime * runTime - 2.0f * k * length);
+	cruise = (runTime - std::sqrt(disc)) / k;
+	accelTime = cruise / accel;
+	decelTime = cruise / decel;
+	cruiseTime = std::max(0.0f, runTime - cruise * k);
+	timeScale = 1.0f;
+}
+
+// rows of one segment, as listed in the file
+struct SegmentRows {
+	std::vector<std::pair<int, Vector2f>> points; // (point index, raw position)
+	float maxSpeed = 0;
+	float accel = 0;
+	float decel = 0;
+};
+
+int loadGeometry(const std::string& filename, Line* lines, int numLines, std::function<Vector2f(float, float)> normalize) {
+	std::map<std::tuple<std::string, int, int>, SegmentRows> rows;
+
+	std::ifstream geomCSV(filename);
+	if (!geomCSV.is_open()) {
+		std::cout << "No " << filename << " found, using straight track between stations" << std::endl;
+	}
+	else {
+		std::cout << "Reading " << filename << std::endl;
+		std::string fileLine;
+		while (std::getline(geomCSV, fileLine)) {
+			if (fileLine.empty() || fileLine[0] == '#') continue;
+
+			std::stringstream lineStream(fileLine);
+			std::string cell;
+			std::vector<std::string> cells;
+			while (std::getline(lineStream, cell, ',')) {
+				cells.push_back(cell);
+			}
+			// the kinematic columns are optional (trailing empty cells are dropped by getline)
+			if (cells.size() < 6 || cells.size() > GEOM_CSV_NUM_COLUMNS) continue;
+
+			SegmentRows& segment = rows[std::make_tuple(cells[0], std::stoi(cells[1]), std::stoi(cells[2]))];
+			segment.points.push_back({ std::stoi(cells[3]), normalize(std::stof(cells[4]), std::stof(cells[5])) });
+			if (cells.size() > 6 && !cells[6].empty()) segment.maxSpeed = std::stof(cells[6]);
+			if (cells.size() > 7 && !cells[7].empty()) segment.accel = std::stof(cells[7]);
+			if (cells.size() > 8 && !cells[8].empty()) segment.decel = std::stof(cells[8]);
+		}
+	}
+
+	int curvedSegments = 0;
+	for (int l = 0; l < numLines; l++) {
+		Line& line = lines[l];
+		line.segments.assign(std::max(line.size - 1, 0), Segment());
+		for (int i = 0; i + 1 < line.size; i++) {
+			Segment& segment = line.segments[i];
+			segment.maxSpeed = segment.accel = segment.decel = 0;
+
+			// segments may be listed in either direction
+			Node* from = line.path[i];
+			Node* to = line.path[i + 1];
+			bool reversed = false;
+			auto it = rows.find(std::make_tuple(std::string(line.id), int(from->numerID), int(to->numerID)));
+			if (it == rows.end()) {
+				it = rows.find(std::make_tuple(std::string(line.id), int(to->numerID), int(from->numerID)));
+				reversed = true;
+			}
+
+			std::vector<Vector2f> points{ from->getPosition() };
+			if (it != rows.end()) {
+				SegmentRows& segmentRows = it->second;
+				std::vector<std::pair<int, Vector2f>> segmentPoints = segmentRows.points;
+				std::sort(segmentPoints.begin(), segmentPoints.end(), [](auto& a, auto& b) { return a.first < b.first; });
+				if (reversed) std::reverse(segmentPoints.begin(), segmentPoints.end());
+				for (auto& point : segmentPoints) {
+					points.push_back(point.second);
+				}
+				segment.maxSpeed = segmentRows.maxSpeed;
+				segment.accel = reversed ? segmentRows.decel : segmentRows.accel;
+				segment.decel = reversed ? segmentRows.accel : segmentRows.decel;
+				curvedSegments++;
+			}
+			points.push_back(to->getPosition());
+			segment.polyline.build(points);
+		}
+	}
+
+	std::cout << "Loaded geometry for " << curvedSegments << " segments" << std::endl;
+	return AOK;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+#include <functional>
+#include <string>
+#include <vector>
+#include "macros.h"
+
+typedef sf::Vector2f Vector2f;
+
+struct Line;
+
+// track between two adjacent stops, with a precomputed arc length table
+struct Polyline {
+	std::vector<Vector2f> points; // screen coordinates, from path[i] to path[i+1]
+	std::vector<float> arcLength; // arcLength[j] is the distance along the track from points[0] to points[j]
+
+	void build(const std::vector<Vector2f>& p);
+
+	inline float length() {
+		return arcLength.empty() ? 0.0f : arcLength.back();
+	}
+
+	// point s units along the track (binary search over the arc length table)
+	Vector2f at(float s);
+};
+
+// accelerate/cruise/decelerate travel time profile over one segment (triangular if cruise speed is never reached)
+// distances are in simulation units (screen distance * DISTANCE_SCALE), times in ticks
+struct KinematicProfile {
+	float length;
+	float accel;
+	float decel;
+	float cruise; // peak speed
+	float accelTime;
+	float cruiseTime;
+	float decelTime;
+	float timeScale; // > 1 if the timetable asks for a run time faster than the speed limit allows
+
+	void build(float l, float maxSpeed, float a, float d);
+	// slows the cruise phase down so the segment takes runTime ticks
+	void fitTime(float runTime);
+
+	inline float duration() {
+		return (accelTime + cruiseTime + decelTime) / timeScale;
+	}
+
+	// distance covered t ticks after leaving the stop
+	inline float distanceAt(float t) {
+		t *= timeScale;
+		if (t <= 0) return 0;
+		if (t < accelTime) return 0.5f * accel * t * t;
+		if (t < accelTime + cruiseTime) return 0.5f * cruise * accelTime + cruise * (t - accelTime);
+		float remaining = accelTime + cruiseTime + decelTime - t;
+		if (remaining <= 0) return length;
+		return length - 0.5f * decel * remaining * remaining;
+	}
+};
+
+// segments[i] of a line runs between path[i] and path[i+1]
+struct Segment {
+	Polyline polyline;
+	float maxSpeed; // 0 to use the TRAIN_ defaults
+	float accel;
+	float decel;
+};
+
+// reads [line id, from, to, point index, x, y, max speed, accel, decel] rows into line segments
+// stops are referenced by numerID, coordinates are in stations_data.csv space and converted with normalize
+// segments without geometry are straight lines between their stops
+int loadGeometry(const std::string& filename, Line* lines, int numLines, std::function<Vector2f(float, float)> normalize);
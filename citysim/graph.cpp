@@ -0,0 +1,83 @@
+#include <algorithm>
+#include "graph.h"
+#include "util.h"
+
+void Graph::build(size_t n, std::vector<GraphEdge>& edges) {
+	std::stable_sort(edges.begin(), edges.end(), [](const GraphEdge& a, const GraphEdge& b) {
+		if (a.from != b.from) return a.from < b.from;
+		if (a.to != b.to) return a.to < b.to;
+		return a.line < b.line;
+	});
+	edges.erase(std::unique(edges.begin(), edges.end(), [](const GraphEdge& a, const GraphEdge& b) {
+		return a.from == b.from && a.to == b.to && a.line == b.line;
+	}), edges.end());
+
+	ownedOffsets.assign(n + 1, 0);
+	ownedTargets.resize(edges.size());
+	ownedLines.resize(edges.size());
+	ownedWeights.resize(edges.size());
+	for (size_t e = 0; e < edges.size(); e++) {
+		ownedOffsets[edges[e].from + 1]++;
+		ownedTargets[e] = edges[e].to;
+		ownedLines[e] = edges[e].line;
+		ownedWeights[e] = edges[e].weight;
+	}
+	for (size_t i = 0; i < n; i++) {
+		ownedOffsets[i + 1] += ownedOffsets[i];
+	}
+
+	numNodes = n;
+	numEdges = edges.size();
+	offsets = ownedOffsets.data();
+	targets = ownedTargets.data();
+	lines = ownedLines.data();
+	weights = ownedWeights.data();
+}
+
+void Graph::borrow(size_t n, size_t m, const uint32_t* o, const uint32_t* t, const int32_t* l, const float* w) {
+	ownedOffsets.clear();
+	ownedTargets.clear();
+	ownedLines.clear();
+	ownedWeights.clear();
+	numNodes = n;
+	numEdges = m;
+	offsets = o;
+	targets = t;
+	lines = l;
+	weights = w;
+}
+
+void Graph::bind(Node* nodeArray, Line* lineArray, Line* walkingLine) {
+	nodeBase = nodeArray;
+	lineBase = lineArray;
+	walkingLineRef = walkingLine;
+}
+
+void Graph::buildLines(Line* lineArray, int numLines, const std::vector<std::vector<uint32_t>>& stopIndices) {
+	size_t totalStops = 0;
+	for (int l = 0; l < numLines; l++) {
+		totalStops += stopIndices[l].size();
+	}
+	// spans point into these, so they are sized once
+	lineStops.assign(totalStops, nullptr);
+	lineDists.assign(totalStops, 0.0f);
+	linePlatforms.assign(totalStops, 0);
+
+	size_t first = 0;
+	for (int l = 0; l < numLines; l++) {
+		Line& line = lineArray[l];
+		line.size = int(stopIndices[l].size());
+		line.path = lineStops.data() + first;
+		line.dist = lineDists.data() + first;
+		line.platform = linePlatforms.data() + first;
+		for (int i = 0; i < line.size; i++) {
+			line.path[i] = nodeBase + stopIndices[l][i];
+		}
+		first += line.size;
+	}
+}
+
+size_t Graph::memoryBytes() const {
+	size_t csr = (numNodes + 1) * sizeof(uint32_t) + numEdges * (sizeof(uint32_t) + sizeof(int32_t) + sizeof(float));
+	return csr + util::vectorBytes(lineStops) + util::vectorBytes(lineDists) + util::vectorBytes(linePlatforms);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "macros.h"
+#include "line.h"
+#include "node.h"
+
+#define GRAPH_WALKING_LINE			-1 // line index of walking transfer edges
+
+// edge list entry, only used while building a Graph
+struct GraphEdge {
+	uint32_t from;
+	uint32_t to;
+	int32_t line;
+	float weight;
+};
+
+// network adjacency in compressed sparse row form, sized from the input
+// the edges of node i are [offsets[i], offsets[i + 1]), stored as parallel target/line/weight arrays
+// the arrays are either owned (built from an edge list) or borrowed from a mapped network image
+// also owns the stops of every line, laid out back to back (see Line::path)
+class Graph {
+public:
+	const uint32_t* offsets = nullptr;
+	const uint32_t* targets = nullptr; // node indices
+	const int32_t* lines = nullptr; // line indices, GRAPH_WALKING_LINE for walking transfers
+	const float* weights = nullptr;
+	size_t numNodes = 0;
+	size_t numEdges = 0;
+
+	// sorts edges by origin and drops repeated (from, to, line) edges, keeping the first one's weight
+	void build(size_t n, std::vector<GraphEdge>& edges);
+	// uses arrays owned by someone else (they must outlive the graph)
+	void borrow(size_t n, size_t m, const uint32_t* o, const uint32_t* t, const int32_t* l, const float* w);
+	// sets what node/line indices refer to
+	void bind(Node* nodeArray, Line* lineArray, Line* walkingLine);
+
+	// gives every line a span of stops, stopIndices[l] are the node indices of line l (Line::size is set from them, call bind first)
+	void buildLines(Line* lineArray, int numLines, const std::vector<std::vector<uint32_t>>& stopIndices);
+
+	// bytes of the CSR arrays (owned or mapped from the network image) and the per-line stop arrays
+	size_t memoryBytes() const;
+
+	inline uint32_t begin(int node) {
+		return offsets[node];
+	}
+	inline uint32_t end(int node) {
+		return offsets[node + 1];
+	}
+	inline Node* target(uint32_t e) {
+		return nodeBase + targets[e];
+	}
+	inline Line* line(uint32_t e) {
+		return lines[e] == GRAPH_WALKING_LINE ? walkingLineRef : lineBase + lines[e];
+	}
+private:
+	Node* nodeBase = nullptr;
+	Line* lineBase = nullptr;
+	Line* walkingLineRef = nullptr;
+
+	std::vector<uint32_t> ownedOffsets;
+	std::vector<uint32_t> ownedTargets;
+	std::vector<int32_t> ownedLines;
+	std::vector<float> ownedWeights;
+
+	std::vector<Node*> lineStops;
+	std::vector<float> lineDists;
+	std::vector<unsigned short> linePlatforms;
+};
@@ -0,0 +1,59 @@
+#include "heatmap.h"
+#include "line.h"
+#include "train.h"
+
+void Heatmap::build(Line* lineArray, int numLines) {
+	lineBase = lineArray;
+	segmentBase.resize(numLines);
+	int total = 0;
+	for (int l = 0; l < numLines; l++) {
+		segmentBase[l] = total;
+		total += int(lineArray[l].segments.size());
+	}
+	loads.assign(total, 0);
+	trainSegment.clear();
+	trainRiders.clear();
+}
+
+void Heatmap::depart(int t, Line* line, int index, char direction, unsigned int riders) {
+	arrive(t);
+	// segments[i] runs between path[i] and path[i+1], departures from a terminal lead nowhere
+	int i = direction == STATUS_FORWARD ? index : index - 1;
+	if (i < 0 || i >= int(line->segments.size())) return;
+	if (size_t(t) >= trainSegment.size()) {
+		trainSegment.resize(t + 1, -1);
+		trainRiders.resize(t + 1, 0);
+	}
+	trainSegment[t] = segment(int(line - lineBase), i);
+	trainRiders[t] = riders;
+	loads[trainSegment[t]] += riders;
+}
+
+void Heatmap::arrive(int t) {
+	if (size_t(t) >= trainSegment.size() || trainSegment[t] < 0) return;
+	loads[trainSegment[t]] -= trainRiders[t];
+	trainSegment[t] = -1;
+}
+
+void Heatmap::rebuild(TrainStore& trains) {
+	std::fill(loads.begin(), loads.end(), 0);
+	trainSegment.assign(trains.size(), -1);
+	trainRiders.assign(trains.size(), 0);
+	for (int t = 0; t < trains.size(); t++) {
+		if (trains.status[t] == STATUS_IN_TRANSIT) {
+			depart(t, trains.line[t], trains.index[t], trains.statusForward[t], trains.capacity[t]);
+		}
+	}
+}
+
+sf::Color heatmapColor(float heat) {
+	heat = std::max(0.0f, std::min(heat, 1.0f));
+	// blue -> yellow -> red, fading in from transparent
+	sf::Uint8 alpha = sf::Uint8(std::min(1.0f, heat * 4) * HEATMAP_ALPHA);
+	if (heat < 0.5f) {
+		float f = heat * 2;
+		return sf::Color(sf::Uint8(255 * f), sf::Uint8(255 * f), sf::Uint8(255 * (1 - f)), alpha);
+	}
+	float f = (heat - 0.5f) * 2;
+	return sf::Color(255, sf::Uint8(255 * (1 - f)), 0, alpha);
+}
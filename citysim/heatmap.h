@@ -0,0 +1,44 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+#include <vector>
+#include "macros.h"
+
+struct Line;
+class TrainStore;
+
+// citizens on board of trains per track segment, kept up to date by TrainStore::applyEvents (if HEATMAP)
+// a train adds its riders to the segment it departs onto and takes the same amount back when it arrives, so nothing is ever rescanned
+// (waiting citizens per station are Node::capacity, which is already counted incrementally)
+class Heatmap {
+public:
+	// numbers the segments of every line (segment(l, i) is lines[l].segments[i])
+	void build(Line* lineArray, int numLines);
+
+	inline int segment(int l, int i) {
+		return segmentBase[l] + i;
+	}
+	inline size_t size() {
+		return loads.size();
+	}
+	inline size_t memoryBytes() const {
+		return (loads.capacity() + trainRiders.capacity()) * sizeof(unsigned int) + (segmentBase.capacity() + trainSegment.capacity()) * sizeof(int);
+	}
+
+	// train t left stop index of its line in direction with riders on board
+	void depart(int t, Line* line, int index, char direction, unsigned int riders);
+	// train t reached a stop or finished its trip
+	void arrive(int t);
+	// recounts every train in transit (after restoring a checkpoint)
+	void rebuild(TrainStore& trains);
+
+	std::vector<unsigned int> loads; // riders per segment
+private:
+	Line* lineBase = nullptr;
+	std::vector<int> segmentBase;
+	std::vector<int> trainSegment; // segment every train is on, -1 if it is not in transit
+	std::vector<unsigned int> trainRiders; // what the train added to its segment
+};
+
+// cold to hot color ramp for heat in [0, 1] (transparent at 0)
+sf::Color heatmapColor(float heat);
@@ -1,14 +1,25 @@
 #pragma once
 
 #include <SFML/Graphics.hpp>
+#include <vector>
+#include "macros.h"
+#include "geometry.h"
 
 class Node;
 
 struct Line {
 public:
-	char size;
-	char id[LINE_ID_SIZE];
+	int size = 0;
+	char id[LINE_ID_SIZE] = {};
 	sf::Color color;
-	Node* path[64];
-	float dist[64]; // dist[i] is equal to the distance between path[i] and path[i+1]
+	// path, dist and platform are spans of size entries in arrays owned by the Graph (see Graph::buildLines)
+	Node** path = nullptr;
+	float* dist = nullptr; // dist[i] is equal to the distance between path[i] and path[i+1] (along the track)
+	unsigned short* platform = nullptr; // platform[i] is the index of this line's forward platform in path[i]->platforms
+	std::vector<Segment> segments; // segments[i] is the track between path[i] and path[i+1]
+	int routes[2] = {}; // timetable routes (forward, backward), see Timetable
+
+	inline int platformIndex(int i, char direction) {
+		return platform[i] + (direction == STATUS_FORWARD ? 0 : 1);
+	}
 };
@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "locks.h"
+#include "trace.h"
+
+extern Tracer tracer;
+
+static std::mutex registryMutex;
+
+// locks are globals of other files, so the registry is built on first use instead of relying on initialization order
+static std::vector<std::unique_ptr<LockStats>>& registry() {
+	static std::vector<std::unique_ptr<LockStats>> stats;
+	return stats;
+}
+static std::chrono::steady_clock::time_point registryStart() {
+	static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	return start;
+}
+
+LockStats& lockStats(const char* name, bool condition) {
+	std::lock_guard<std::mutex> registryLock(registryMutex);
+	registryStart();
+	for (std::unique_ptr<LockStats>& stats : registry()) {
+		if (stats->condition == condition && std::strcmp(stats->name, name) == 0) return *stats;
+	}
+	registry().emplace_back(new LockStats());
+	registry().back()->name = name;
+	registry().back()->condition = condition;
+	return *registry().back();
+}
+
+void reportLocks(std::ostream& out) {
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - registryStart()).count();
+	std::vector<LockStats*> sorted;
+	{
+		std::lock_guard<std::mutex> registryLock(registryMutex);
+		for (std::unique_ptr<LockStats>& stats : registry()) {
+			sorted.push_back(stats.get());
+		}
+	}
+	std::sort(sorted.begin(), sorted.end(), [](LockStats* a, LockStats* b) { return a->waitNanos > b->waitNanos; });
+
+	char line[160];
+	std::snprintf(line, sizeof(line), "%-22s %12s %9s %11s %11s %11s %11s %8s\n", "Lock", "acquired", "contended", "wait ms", "max wait us", "hold ms", "max hold us", "waiting");
+	out << line;
+	for (LockStats* stats : sorted) {
+		if (stats->condition) continue;
+		uint64_t acquisitions = stats->acquisitions;
+		std::snprintf(line, sizeof(line), "%-22s %12llu %8.2f%% %11.1f %11.1f %11.1f %11.1f %8.3f\n", stats->name, (unsigned long long)acquisitions,
+			acquisitions > 0 ? 100.0 * stats->contended / acquisitions : 0.0, stats->waitNanos / 1e6, stats->maxWaitNanos / 1e3,
+			stats->holdNanos / 1e6, stats->maxHoldNanos / 1e3, seconds > 0 ? stats->waitNanos / 1e9 / seconds : 0.0);
+		out << line;
+	}
+	std::snprintf(line, sizeof(line), "%-22s %12s %11s %11s %8s\n", "Condition", "waits", "wait ms", "max wait us", "waiting");
+	out << line;
+	for (LockStats* stats : sorted) {
+		if (!stats->condition) continue;
+		std::snprintf(line, sizeof(line), "%-22s %12llu %11.1f %11.1f %8.3f\n", stats->name, (unsigned long long)stats->acquisitions.load(),
+			stats->waitNanos / 1e6, stats->maxWaitNanos / 1e3, seconds > 0 ? stats->waitNanos / 1e9 / seconds : 0.0);
+		out << line;
+	}
+}
+
+InstrumentedMutex::InstrumentedMutex(const char* name) : lockName(name), stats(&lockStats(name, false)) {}
+
+void InstrumentedMutex::lockContended() {
+	#if LOCK_STATS == true
+	auto start = std::chrono::steady_clock::now();
+	#endif
+	{
+		TraceScope wait(tracer, lockName, "lock");
+		mutex.lock();
+	}
+	#if LOCK_STATS == true
+	holdStart = std::chrono::steady_clock::now();
+	uint64_t nanos = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(holdStart - start).count());
+	stats->acquisitions.fetch_add(1, std::memory_order_relaxed);
+	stats->contended.fetch_add(1, std::memory_order_relaxed);
+	stats->waitNanos.fetch_add(nanos, std::memory_order_relaxed);
+	raiseMax(stats->maxWaitNanos, nanos);
+	#endif
+}
+
+void InstrumentedMutex::released() {
+	uint64_t nanos = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - holdStart).count());
+	stats->holdNanos.fetch_add(nanos, std::memory_order_relaxed);
+	raiseMax(stats->maxHoldNanos, nanos);
+}
+
+InstrumentedCondition::InstrumentedCondition(const char* name) : stats(&lockStats(name, true)) {}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include "macros.h"
+
+// counters of every lock (or condition variable) sharing a name, kept for the whole run (if LOCK_STATS)
+// for a condition variable, acquisitions are waits and waitNanos is the time spent waiting to be signalled
+struct LockStats {
+	const char* name;
+	bool condition;
+	std::atomic<uint64_t> acquisitions{ 0 };
+	std::atomic<uint64_t> contended{ 0 }; // acquisitions that found the lock held
+	std::atomic<uint64_t> waitNanos{ 0 };
+	std::atomic<uint64_t> maxWaitNanos{ 0 };
+	std::atomic<uint64_t> holdNanos{ 0 };
+	std::atomic<uint64_t> maxHoldNanos{ 0 };
+};
+
+inline void raiseMax(std::atomic<uint64_t>& max, uint64_t value) {
+	uint64_t current = max.load(std::memory_order_relaxed);
+	while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed));
+}
+
+// the stats entry of name, created on first use (names must be string literals)
+LockStats& lockStats(const char* name, bool condition);
+
+// prints every lock and condition variable sorted by total wait: acquisitions, contended share, total and max wait and hold,
+// and the average number of threads waiting on it over the run (total wait / wall time), the best hint at what limits scaling
+void reportLocks(std::ostream& out);
+
+// std::mutex that counts acquisitions, contended acquisitions, wait and hold times under its name (if LOCK_STATS)
+// and records waits on it in the trace (if TRACE), it is a plain std::mutex otherwise
+class InstrumentedMutex {
+public:
+	explicit InstrumentedMutex(const char* name);
+	InstrumentedMutex(const InstrumentedMutex&) = delete;
+	InstrumentedMutex& operator=(const InstrumentedMutex&) = delete;
+
+	inline void lock() {
+		#if LOCK_STATS == true || TRACE == true
+		if (!mutex.try_lock()) {
+			lockContended();
+			return;
+		}
+		#if LOCK_STATS == true
+		stats->acquisitions.fetch_add(1, std::memory_order_relaxed);
+		holdStart = std::chrono::steady_clock::now();
+		#endif
+		#else
+		mutex.lock();
+		#endif
+	}
+	inline bool try_lock() {
+		if (!mutex.try_lock()) return false;
+		#if LOCK_STATS == true
+		stats->acquisitions.fetch_add(1, std::memory_order_relaxed);
+		holdStart = std::chrono::steady_clock::now();
+		#endif
+		return true;
+	}
+	inline void unlock() {
+		#if LOCK_STATS == true
+		released();
+		#endif
+		mutex.unlock();
+	}
+
+	inline const char* name() const {
+		return lockName;
+	}
+private:
+	friend class InstrumentedCondition;
+
+	std::mutex mutex;
+	const char* lockName;
+	LockStats* stats;
+	std::chrono::steady_clock::time_point holdStart; // only touched by the thread holding the lock
+
+	// blocks on the mutex after try_lock failed, timing (and tracing) the wait
+	void lockContended();
+	// ends the hold that started at holdStart
+	void released();
+};
+
+// std::condition_variable for InstrumentedMutex, counts waits and the time spent waiting to be signalled (if LOCK_STATS)
+// the mutex is not held while waiting, so that time does not count as holding it
+class InstrumentedCondition {
+public:
+	explicit InstrumentedCondition(const char* name);
+	InstrumentedCondition(const InstrumentedCondition&) = delete;
+	InstrumentedCondition& operator=(const InstrumentedCondition&) = delete;
+
+	template<class Predicate>
+	void wait(std::unique_lock<InstrumentedMutex>& lock, Predicate pred) {
+		InstrumentedMutex& m = *lock.mutex();
+		#if LOCK_STATS == true
+		if (pred()) return;
+		m.released();
+		auto start = std::chrono::steady_clock::now();
+		#endif
+		std::unique_lock<std::mutex> inner(m.mutex, std::adopt_lock);
+		condition.wait(inner, pred);
+		inner.release();
+		#if LOCK_STATS == true
+		m.holdStart = std::chrono::steady_clock::now();
+		uint64_t nanos = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(m.holdStart - start).count());
+		stats->acquisitions.fetch_add(1, std::memory_order_relaxed);
+		stats->waitNanos.fetch_add(nanos, std::memory_order_relaxed);
+		raiseMax(stats->maxWaitNanos, nanos);
+		#endif
+	}
+	inline void notify_one() {
+		condition.notify_one();
+	}
+	inline void notify_all() {
+		condition.notify_all();
+	}
+private:
+	std::condition_variable condition;
+	LockStats* stats;
+};
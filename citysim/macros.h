@@ -27,18 +27,37 @@
 #define NODE_N_POINTS				8
 #define TEXT_REFRESH_RATE			10 // every n frames
 #define BACKGROUND_COLOR			sf::Color::White
+#define HEATMAP						false // keep per segment rider counts and draw a crowding overlay (4 toggles it)
+#define HEATMAP_DECAY				0.9f // the overlay moves 1 - n of the way to the current loads every frame
+#define HEATMAP_SEGMENT_SCALE		1.0f // riders on a segment drawn hottest, in train capacities (`train_capacity=`)
+#define HEATMAP_NODE_MAX			NODE_CAPACITY // waiting citizens at a station drawn hottest
+#define HEATMAP_WIDTH				6.0f // of the segment overlay
+#define HEATMAP_ALPHA				160
+#define HEADLESS_FRAME_INTERVAL		60 // `citysim headless` renders a frame every n simulation ticks (frames are dropped, never waited for)
+#define HEADLESS_DIRECTORY			"frames" // numbered PNG frames are written here...
+#define HEADLESS_PIPE				"" // ...unless this is a command (e.g. "ffmpeg -f rawvideo -pixel_format rgba -video_size 1000x1200 -i - out.mp4"), which gets raw RGBA frames on stdin
+#define HEADLESS_LINE_WIDTH			1.5f
+#define REPLAY_SPEED				60 // initial ticks per frame of `citysim replay` (, and . halve/double it, r reverses)
+#define REPLAY_JUMP					3600 // ticks skipped by [ and ] during replays
+#define REPLAY_STUCK_TICKS			3600 // replayed citizens count as stuck after n ticks without a transition (walking ones never do)
+#define REPLAY_STUCK_COLOR			sf::Color::Red // nodes with more than CITIZEN_STUCK_THRESH stuck citizens during replays
 
 // Simulation size
-#define MAX_LINES					32
-#define MAX_NODES					512
-#define MAX_TRAINS					1024
+#define TRAIN_VEC_RESERVE			1024 // trains are stored in growable arrays, this only sets the initial reservation
 #define MAX_CITIZENS				200000
 #define NUM_CITIZEN_WORKER_THREADS	8 // important to adjust for performance depending on your machine
+#define MAX_CITIZEN_WORKER_THREADS	256 // upper bound of `threads=`
 #define DISTANCE_SCALE				128
 
 // File loading
 #define STATIONS_CSV_NUM_COLUMNS	6
 #define GEOM_CSV_NUM_COLUMNS		9
+#define NETWORK_IMAGE_FILE			"network.bin" // written by `citysim compile`
+#define NETWORK_IMAGE_LOAD			true // load NETWORK_IMAGE_FILE instead of parsing the CSVs if it is up to date
+#define NETWORK_IMAGE_VERIFY		true // check the image checksum on load (one pass over the file)
+#define CHECKPOINT_FILE				"checkpoint.bin" // written on k press or at CHECKPOINT_TICK, read by `citysim resume`
+#define CHECKPOINT_TICK				0 // also save a checkpoint at the end of this tick (0 to disable)
+#define CONFIG_FILE					"citysim.cfg" // key=value run settings (see SimConfig), read if it exists, `config=file` to read another
 
 // Node and Train status flags
 #define STATUS_DESPAWNED			0
@@ -48,27 +67,39 @@
 #define STATUS_TRANSFER				4
 #define STATUS_WALK					5
 #define STATUS_BOARDED				6
+#define STATUS_COUNT				7 // number of citizen status flags above
 #define STATUS_FORWARD				1
 #define STATUS_BACKWARD				-1
-#define STATUS_AMBIVALENT			3
 #define STATUS_HIGHLIGHTED			2
 
 // Line
-#define LINE_PATH_SIZE				64
 #define LINE_ID_SIZE				4 // size of char buffer
 #define WALK_LINE_ID_STR			"WLK"
 
 // Nodes
 #define NODE_ID_SIZE				36 // size of char buffer
 #define NODE_CAPACITY				256u // cosmetic only
-#define NODE_GRID_ROWS				10
-#define NODE_GRID_COLS				12
+#define NODE_PICK_DIST				100.0f // the mouse selects the nearest node within n units
+
+// Spatial index (see SpatialGrid)
+#define SPATIAL_CELL_POINTS			2 // average points per grid cell
+#define SPATIAL_MAX_CELLS_PER_AXIS	4096 // caps the grid for badly spread points
 
 // Train
-#define DEFAULT_TRAIN_STOP_SPACING	4 // spawn trains every n stops
-#define TRAIN_SPEED					8.0f
+#define TRAIN_SPEED					8.0f // average speed, used for pathfinding
+#define TRAIN_MAX_SPEED				TRAIN_SPEED // default cruise speed (per tick) for segments without a geometry.csv limit
+#define TRAIN_ACCEL					(TRAIN_SPEED / 15.0f) // default acceleration (per tick^2)
+#define TRAIN_DECEL					(TRAIN_SPEED / 12.0f) // default deceleration (per tick^2)
 #define TRAIN_CAPACITY				750 // citizens cannot board trains if they are at max capacity
-#define TRAIN_STOP_THRESH			750 * TRAIN_SPEED // how long trains wait at stops
+#define TRAIN_DWELL_TIME			30 // default ticks trains wait at stops
+#define TRAIN_NONE					-1 // empty train id
+#define TRAIN_PARALLEL_CHUNK		2048 // minimum trains per worker task, smaller train counts are updated on the simulation thread
+
+// Timetable
+#define TICKS_PER_MINUTE			60 // one simulation tick is one simulated second
+#define SIM_DAY_TICKS				(24 * 60 * TICKS_PER_MINUTE)
+#define SIM_START_TIME				(6 * 60 * TICKS_PER_MINUTE) // time of day at tick 0
+#define TIMETABLE_DEFAULT_HEADWAY	10 // minutes, for lines/times without a timetable.csv entry
 
 // Citizen
 constexpr float CITIZEN_SPEED = 1.0f;
@@ -81,12 +112,51 @@ constexpr float CITIZEN_SPEED = 1.0f;
 #define TARGET_CITIZEN_COUNT		40000
 #define CITIIZEN_VEC_RESERVE		TARGET_CITIZEN_COUNT * 2
 #define CUSTOM_CITIZEN_SPAWN_AMT	250
+#define SPAWN_QUEUE_SIZE			8192 // routed citizens waiting for the next tick (power of two)
 #define CITIZEN_DESPAWN_THRESH		CITIZEN_DESPAWN_WARN * 8
 
+// Demand (time bands start at the given hour and last until the next one, night wraps around midnight)
+#define DEMAND_PROFILE				true // false to spawn at a flat rate all day
+#define DEMAND_NUM_BANDS			4
+#define DEMAND_AM_START				6
+#define DEMAND_MIDDAY_START			10
+#define DEMAND_PM_START				16
+#define DEMAND_NIGHT_START			20
+#define DEMAND_AM_RATE				1.5f // spawn multipliers
+#define DEMAND_MIDDAY_RATE			0.8f
+#define DEMAND_PM_RATE				1.4f
+#define DEMAND_NIGHT_RATE			0.3f
+#define DEMAND_TOP_DESTINATIONS		128 // destinations kept per origin and band
+#define DEMAND_GRAVITY_DISTANCE		200.0 // screen units, trips fall off as exp(-distance / n)
+#define DEMAND_GRAVITY_CUTOFF		8.0 // destinations farther than n * DEMAND_GRAVITY_DISTANCE are not weighed (exp(-8) of a next-door one)
+#define DEMAND_GRAVITY_CANDIDATES	4096 // ...nor those beyond the radius holding about n stations on average, so large networks synthesize in linear time
+#define DEMAND_PEAK_SKEW			1.5 // exponent applied to the ridership of destinations (AM) or origins (PM) during peaks
+
+// Synthetic networks (`citysim generate`), every parameter can be overridden on the command line
+#define GENERATOR_STATIONS			10000
+#define GENERATOR_LINES				100
+#define GENERATOR_TRANSFERS			0.2 // chance that a stop reuses a nearby station of another line
+#define GENERATOR_EXTENT			50.0 // km
+#define GENERATOR_RIDERSHIP			8000.0 // median daily ridership per station
+#define GENERATOR_RIDERSHIP_SPREAD	1.0 // sigma of the log-normal ridership distribution
+#define GENERATOR_SEED				1
+#define GENERATOR_TURN				0.15 // standard deviation of a line's change of heading per stop (radians)
+#define GENERATOR_MAX_LINES			46656 // 3 character base 36 line ids
+#define GENERATOR_MAX_TOTAL_RIDERSHIP	2e9 // station ridership is scaled down to keep the total below this
+#define GENERATOR_ORIGIN_LON		-74.05 // south-west corner of the extent
+#define GENERATOR_ORIGIN_LAT		40.55
+
+// Random number streams (one per thread, all derived from the same seed)
+#define RNG_SEED					0 // 0 to seed from std::random_device
+#define RNG_STREAM_INIT				0
+#define RNG_STREAM_PATHFINDING		1
+#define RNG_STREAM_GENERATOR		2
+#define RNG_STREAM_CUSTOM			3 // citizens spawned by the user
+#define RNG_STREAM_MICROBENCH		4
+#define RNG_STREAM_BENCHMARK		16 // + thread number
+
 // Pathfinding
 #define CITIZEN_PATH_SIZE			64 // this value is not mathematically guaranteed to exceed the maximum number of possible lines in a path (but errors are handled)
-#define NODE_N_NEIGHBORS			16
-#define NODE_N_TRAINS				8
 #define TRANSFER_MAX_DIST			10.0f
 #define STOP_PENALTY				20 // fixed penalty for each stop
 #define TRANSFER_PENALTY			STOP_PENALTY * 2 // fixed penalty for transferring to another line/walking
@@ -102,15 +172,53 @@ constexpr int CACHE_TRANSFERS_THRESHOLD = 2; // paths with n or different lines
 // Debugging
 #define AOK							0
 #define ERROR_OPENING_FILE			1
-#define BENCHMARK_MODE				false
-#define BENCHMARK_TICK_AMT			50000
+#define ERROR_INVALID_FILE			2
+#define ERROR_USAGE					3
+#define BENCHMARK_MODE				false // run every launch as `citysim bench` with the default options
+#define BENCHMARK_TICK_AMT			50000 // measured ticks of a benchmark (`citysim bench ticks=n`)
+#define BENCHMARK_WARMUP_TICKS		2000 // ticks run before a benchmark starts measuring (`citysim bench warmup=n`)
+#define BENCHMARK_REPORT_FILE		"benchmark.json" // JSON report of a benchmark (`citysim bench output=file`)
+#define MICROBENCH_MIN_TIME			0.5 // seconds each microbenchmark runs at least (`citysim microbench [filter] [min_time=s]`)
+#define MICROBENCH_MAX_ITERATIONS	1000000000
+#define MICROBENCH_WARMUP_TICKS		1800 // ticks simulated before the microbenchmarks
+#define MICROBENCH_PAIRS			256 // origin-destination pairs per path benchmark
+#define MICROBENCH_TRAIN_TICKS		600 // train updates advance this many ticks before starting over
+#define MICROBENCH_COUNT_ALLOCATIONS	false // count allocations per operation (replaces the global operator new in the whole program, so leave it off outside microbenchmark builds)
 #define STAT_RATE					1000 // every n simulation ticks
+#define PROFILER					false // time the phases of every tick into histograms, reported when the simulation ends
+#define PROFILER_REPORT_FREQ		0 // also report every n simulation ticks (0 to only report at the end)
+#define PROFILER_HISTOGRAM_BITS		5 // significant bits kept per histogram bucket (about 3% precision)
+#define LOCK_STATS					false // count acquisitions, contention, wait and hold times of every named lock (see InstrumentedMutex)
+#define LOCK_STATS_REPORT_FREQ		0 // report them every n simulation ticks (0 to only report when the simulation ends)
+#define TRACE						false // record every thread's timeline (tick phases, pathfinding, lock waits) and write it to TRACE_FILE on exit
+#define TRACE_FILE					"trace.json" // Chrome trace-event JSON, opens in Perfetto (ui.perfetto.dev) or chrome://tracing
+#define TRACE_RING_EVENTS			65536 // most recent events kept per thread (power of two)
+#define TELEMETRY					false // stream per-tick metrics (see TelemetryRecord) to TELEMETRY_FILE
+#define TELEMETRY_FILE				"telemetry.csv"
+#define TELEMETRY_RATE				1 // record every n simulation ticks
+#define TELEMETRY_RING_SIZE			4096 // records buffered for the writer thread (power of two), more are dropped
+#define TELEMETRY_FLUSH_MS			50 // writer wakes up (and flushes the file) every n milliseconds
+#define TRAJECTORY					false // record citizen state transitions to TRAJECTORY_FILE (played back by `citysim replay`)
+#define TRAJECTORY_FILE				"trajectory.bin"
+#define TRAJECTORY_BLOCK_EVENTS		65536 // a block is compressed and written once it holds n events...
+#define TRAJECTORY_BLOCK_TICKS		600 // ...or spans n ticks
+#define TRAJECTORY_KEYFRAME_TICKS	3600 // every n ticks a block starts with the state of every citizen (replays seek to these)
+#define TRAJECTORY_RING_SIZE		16 // blocks queued for the writer thread (power of two), the simulation waits if it falls this far behind
+#define TRAJECTORY_WRITER_MS		20 // writer wakes up every n milliseconds
 #define BENCHMARK_RESERVE			BENCHMARK_TICK_AMT / STAT_RATE * 2
+#define BENCHMARK_SAMPLER_SAMPLES	(1 << 24) // spawn sampler draws per thread, checked against node ridership at init
 #define USER_INFO_MODE				true
 #define PATHFINDER_ERRORS			false
 #define TRAIN_ERRORS				false
 #define CITIZEN_SPAWN_ERRORS		false
 #define DISABLE_SIMULATION			false
+#define SIM_DETERMINISTIC			false // spawn on the simulation thread and update citizens on one thread, so runs (and checkpoint restores) repeat exactly for a fixed RNG_SEED
 #define NODE_CAPACITY_WARN			512
 #define CITIZEN_DESPAWN_WARN		500000 * CITIZEN_SPEED
+#define SPATIAL_INDEX_CHECK			false // checks the node index against a linear scan at init (walking transfer radius around every node, SPATIAL_CHECK_QUERIES nearest node queries)
+#define SPATIAL_CHECK_QUERIES		100000
+#define PLATFORM_STRESS_TEST		false // runs every route through a hub at PLATFORM_STRESS_HEADWAY and checks platform bookkeeping every STAT_RATE ticks
+#define PLATFORM_STRESS_HUB_LINES	4 // nodes served by at least n lines count as hubs
+#define PLATFORM_STRESS_HEADWAY		1 // minutes
+#define PLATFORM_STRESS_DWELL		120 // ticks, long enough for several trains of a route to share a platform
 #define CITIZEN_STUCK_THRESH		10 // ignore nodes with below n stuck citizens when outputting debug info
\ No newline at end of file
@@ -0,0 +1,382 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include "microbench.h"
+#include "citizen.h"
+#include "config.h"
+#include "demand.h"
+#include "node.h"
+#include "pathcache.h"
+#include "train.h"
+#include "util.h"
+
+extern int VALID_NODES;
+extern std::vector<Node> nodes;
+extern TrainStore trains;
+extern CitizenVector citizens;
+extern SpawnQueue<Citizen> spawnQueue;
+extern DemandModel demand;
+extern PathCache cache;
+extern unsigned int rngSeed;
+extern SimConfig config;
+extern long unsigned int simTick;
+extern std::atomic<unsigned int> simTime;
+
+// sim.cpp
+int generateRandomCitizens(int spawnAmount, unsigned int time, std::mt19937_64& rng, bool waitIfFull);
+
+#if MICROBENCH_COUNT_ALLOCATIONS == true
+// every allocation of the program goes through these, counting costs one thread-local increment
+static thread_local uint64_t allocationCounter = 0;
+static thread_local uint64_t allocatedByteCounter = 0;
+
+void* operator new(std::size_t size) {
+	allocationCounter++;
+	allocatedByteCounter += size;
+	void* p = std::malloc(size > 0 ? size : 1);
+	if (p == nullptr) throw std::bad_alloc();
+	return p;
+}
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+uint64_t threadAllocations() {
+	return allocationCounter;
+}
+uint64_t threadAllocatedBytes() {
+	return allocatedByteCounter;
+}
+#else
+uint64_t threadAllocations() {
+	return 0;
+}
+uint64_t threadAllocatedBytes() {
+	return 0;
+}
+#endif
+
+MicrobenchState::MicrobenchState(uint64_t n) : iterations(n) {
+	startAllocations = threadAllocations();
+	startBytes = threadAllocatedBytes();
+	started = std::chrono::steady_clock::now();
+}
+
+void MicrobenchState::pause() {
+	if (!running) return;
+	auto now = std::chrono::steady_clock::now();
+	elapsed += std::chrono::duration<double>(now - started).count();
+	allocationCount += threadAllocations() - startAllocations;
+	allocatedByteCount += threadAllocatedBytes() - startBytes;
+	running = false;
+}
+
+void MicrobenchState::resume() {
+	if (running) return;
+	running = true;
+	startAllocations = threadAllocations();
+	startBytes = threadAllocatedBytes();
+	started = std::chrono::steady_clock::now();
+}
+
+void MicrobenchState::stop() {
+	pause();
+}
+
+void MicrobenchSuite::add(const std::string& name, std::function<void(MicrobenchState&)> body) {
+	benchmarks.push_back({ name, std::move(body) });
+}
+
+void MicrobenchSuite::run(const std::string& filter, double minSeconds) {
+	std::printf("%-36s %14s %12s %12s %12s\n", "Benchmark", "Time", "Iterations", "Allocs/op", "Bytes/op");
+	for (Benchmark& benchmark : benchmarks) {
+		if (benchmark.name.find(filter) == std::string::npos) continue;
+		// grow the iteration count until a run is long enough to time (aiming a little past minSeconds)
+		uint64_t n = 1;
+		while (true) {
+			MicrobenchState state(n);
+			benchmark.body(state);
+			state.stop();
+			if (state.seconds() >= minSeconds || n >= MICROBENCH_MAX_ITERATIONS) {
+				double ns = state.seconds() * 1e9 / n;
+				std::printf("%-36s %11.1f ns %12llu %12.2f %12.1f\n", benchmark.name.c_str(), ns, (unsigned long long)n,
+					double(state.allocations()) / n, double(state.allocatedBytes()) / n);
+				break;
+			}
+			double scale = state.seconds() > 0 ? minSeconds * 1.4 / state.seconds() : 100;
+			n = std::min(uint64_t(MICROBENCH_MAX_ITERATIONS), uint64_t(n * std::max(2.0, std::min(100.0, scale))));
+		}
+	}
+	#if MICROBENCH_COUNT_ALLOCATIONS == false
+	std::cout << "(allocations are not counted, set MICROBENCH_COUNT_ALLOCATIONS)" << std::endl;
+	#endif
+}
+
+// runs the simulation single-threaded (trains, citizens, spawning) like simulationThread does
+static void simulate(unsigned long ticks, std::mt19937_64& rng) {
+	std::vector<TrainEvent> events;
+	for (unsigned long i = 0; i < ticks; i++) {
+		simTick++;
+		simTime = SIM_START_TIME + (unsigned int)simTick;
+		citizens.drain(spawnQueue);
+		trains.spawn(simTime);
+		trains.update(0, trains.size(), simTime, events);
+		trains.applyEvents(events);
+		events.clear();
+		for (size_t c = 0; c < citizens.size(); c++) {
+			if (citizens[int(c)].status != STATUS_DESPAWNED && citizens[int(c)].updatePositionAlongPath()) {
+				citizens.remove(int(c));
+			}
+		}
+		if (simTick % config.spawnFrequency == 0) {
+			int target = int(config.agents * demand.rateAt(simTime)) - int(citizens.activeSize() + spawnQueue.size());
+			generateRandomCitizens(std::min(target, SPAWN_QUEUE_SIZE), simTime, rng, false);
+		}
+	}
+}
+
+// an origin-destination pair and the path found for it
+struct RoutedPair {
+	Node* start;
+	Node* end;
+	char size;
+	bool cached; // the pathfinder stores paths with CACHE_TRANSFERS_THRESHOLD or more transfers
+	PathWrapper path[CITIZEN_PATH_SIZE];
+};
+
+// empties spawnQueue without keeping what was in it
+static void discardSpawnQueue() {
+	static Citizen discarded;
+	while (spawnQueue.pop(discarded));
+}
+
+int runMicrobenchmarks(const std::string& filter, double minSeconds) {
+	std::mt19937_64 rng = util::rngStream(rngSeed, RNG_STREAM_MICROBENCH);
+	std::cout << "Simulating " << MICROBENCH_WARMUP_TICKS << " ticks for a realistic state mix" << std::endl;
+	simulate(MICROBENCH_WARMUP_TICKS, rng);
+	citizens.drain(spawnQueue);
+	discardSpawnQueue();
+	std::cout << citizens.activeSize() << " active citizens, " << trains.activeSize() << " trains" << std::endl;
+
+	// origin-destination pairs drawn from the demand in effect, sorted by path length
+	std::vector<RoutedPair> pairs;
+	int band = demand.bandAt(simTime);
+	for (int i = 0; i < MICROBENCH_PAIRS * 8; i++) {
+		int origin, destination;
+		if (!demand.sample(band, rng, &origin, &destination) || origin == destination) continue;
+		RoutedPair pair;
+		pair.start = &nodes[origin];
+		pair.end = &nodes[destination];
+		if (!pair.start->findPath(pair.end, pair.path, &pair.size)) continue;
+		pair.cached = cache.get(pair.start, pair.end).size > 0;
+		pairs.push_back(pair);
+	}
+	if (pairs.size() < 2) {
+		std::cout << "ERR: found no routable origin-destination pairs" << std::endl;
+		return ERROR_INVALID_FILE;
+	}
+	std::stable_sort(pairs.begin(), pairs.end(), [](const RoutedPair& a, const RoutedPair& b) { return a.size < b.size; });
+	size_t half = std::min(size_t(MICROBENCH_PAIRS), pairs.size() / 2);
+	std::vector<RoutedPair> shortPairs(pairs.begin(), pairs.begin() + half);
+	std::vector<RoutedPair> longPairs(pairs.end() - half, pairs.end());
+	std::vector<RoutedPair> cachedPairs;
+	for (RoutedPair& pair : pairs) {
+		if (pair.cached) cachedPairs.push_back(pair);
+	}
+	std::vector<RoutedPair> cachedShort(cachedPairs.begin(), cachedPairs.begin() + cachedPairs.size() / 2);
+	std::vector<RoutedPair> cachedLong(cachedPairs.begin() + cachedPairs.size() / 2, cachedPairs.end());
+	std::cout << pairs.size() << " routed pairs (" << cachedPairs.size() << " cached), paths of " << int(shortPairs.back().size)
+		<< " stops or less count as short, " << int(longPairs.front().size) << " or more as long" << std::endl << std::endl;
+
+	MicrobenchSuite suite;
+
+	// Node::findPath, hitting the cache (paths with enough transfers are stored on the first search)
+	auto findCached = [](std::vector<RoutedPair>& set) {
+		return [&set](MicrobenchState& state) {
+			PathWrapper path[CITIZEN_PATH_SIZE];
+			char size;
+			for (uint64_t i = 0; i < state.iterations; i++) {
+				RoutedPair& pair = set[i % set.size()];
+				pair.start->findPath(pair.end, path, &size);
+			}
+		};
+	};
+	// Node::findPath, searching every time (the pair's cache entries are dropped between searches)
+	auto findUncached = [](std::vector<RoutedPair>& set) {
+		return [&set](MicrobenchState& state) {
+			PathWrapper path[CITIZEN_PATH_SIZE];
+			char size;
+			for (uint64_t i = 0; i < state.iterations; i++) {
+				RoutedPair& pair = set[i % set.size()];
+				state.pause();
+				cache.erase(pair.start, pair.end);
+				cache.erase(pair.end, pair.start);
+				state.resume();
+				pair.start->findPath(pair.end, path, &size);
+			}
+		};
+	};
+	if (!cachedShort.empty()) suite.add("path/find_cached_short", findCached(cachedShort));
+	if (!cachedLong.empty()) suite.add("path/find_cached_long", findCached(cachedLong));
+	suite.add("path/find_uncached_short", findUncached(shortPairs));
+	suite.add("path/find_uncached_long", findUncached(longPairs));
+
+	// PathCache::get/put on their own
+	if (!cachedPairs.empty()) {
+		suite.add("pathcache/get_hit", [&cachedPairs](MicrobenchState& state) {
+			for (uint64_t i = 0; i < state.iterations; i++) {
+				RoutedPair& pair = cachedPairs[i % cachedPairs.size()];
+				cache.get(pair.start, pair.end);
+			}
+		});
+	}
+	suite.add("pathcache/get_miss", [&shortPairs](MicrobenchState& state) {
+		for (uint64_t i = 0; i < state.iterations; i++) {
+			// a node is never routed to itself, so this pair is never cached
+			Node* node = shortPairs[i % shortPairs.size()].start;
+			cache.get(node, node);
+		}
+	});
+	suite.add("pathcache/put", [&longPairs](MicrobenchState& state) {
+		for (uint64_t i = 0; i < state.iterations; i++) {
+			RoutedPair& pair = longPairs[i % longPairs.size()];
+			state.pause();
+			cache.erase(pair.start, pair.end);
+			state.resume();
+			cache.put(pair.start, pair.end, pair.path, pair.size);
+		}
+	});
+
+	// Citizen::updatePositionAlongPath on copies of the simulated citizens, one update each before they are restored
+	// (boarding and alighting change node and train counters, so those are restored with them)
+	std::vector<Citizen> active;
+	for (size_t c = 0; c < citizens.size(); c++) {
+		if (citizens[int(c)].status != STATUS_DESPAWNED) active.push_back(citizens[int(c)]);
+	}
+	std::vector<unsigned int> nodeCapacities(VALID_NODES);
+	for (int i = 0; i < VALID_NODES; i++) {
+		nodeCapacities[i] = nodes[i].capacity;
+	}
+	std::vector<unsigned int> trainCapacities = trains.capacity;
+	auto updateCitizens = [&nodeCapacities, &trainCapacities](std::vector<Citizen> set) {
+		return [set, &nodeCapacities, &trainCapacities](MicrobenchState& state) {
+			state.pause();
+			std::vector<Citizen> work = set;
+			state.resume();
+			for (uint64_t i = 0; i < state.iterations; i++) {
+				size_t c = i % work.size();
+				if (c == 0 && i > 0) {
+					state.pause();
+					work = set;
+					for (int n = 0; n < VALID_NODES; n++) {
+						nodes[n].capacity = nodeCapacities[n];
+					}
+					trains.capacity = trainCapacities;
+					state.resume();
+				}
+				work[c].updatePositionAlongPath();
+			}
+			state.pause();
+			for (int n = 0; n < VALID_NODES; n++) {
+				nodes[n].capacity = nodeCapacities[n];
+			}
+			trains.capacity = trainCapacities;
+		};
+	};
+	if (!active.empty()) suite.add("citizen/update_mixed", updateCitizens(active));
+	const std::pair<int, const char*> statuses[] = {
+		{ STATUS_SPAWNED, "spawned" }, { STATUS_IN_TRANSIT, "in_transit" }, { STATUS_AT_STOP, "at_stop" },
+		{ STATUS_TRANSFER, "transfer" }, { STATUS_WALK, "walk" }, { STATUS_BOARDED, "boarded" }
+	};
+	for (const std::pair<int, const char*>& status : statuses) {
+		std::vector<Citizen> set;
+		for (Citizen& c : active) {
+			if (c.status == status.first) set.push_back(c);
+		}
+		if (!set.empty()) suite.add(std::string("citizen/update_") + status.second, updateCitizens(set));
+	}
+
+	// TrainStore::update on a copy of the trains, advancing one tick per pass and restarting every MICROBENCH_TRAIN_TICKS passes
+	suite.add("train/update", [](MicrobenchState& state) {
+		state.pause();
+		TrainStore pristine = trains;
+		TrainStore work = pristine;
+		std::vector<TrainEvent> events;
+		unsigned int now = simTime;
+		int t = 0;
+		state.resume();
+		for (uint64_t i = 0; i < state.iterations;) {
+			int last = int(std::min(uint64_t(work.size()), t + (state.iterations - i)));
+			work.update(t, last, now, events);
+			i += last - t;
+			t = last;
+			if (t == work.size()) {
+				state.pause();
+				t = 0;
+				events.clear();
+				if (++now - simTime >= MICROBENCH_TRAIN_TICKS) {
+					now = simTime;
+					work = pristine;
+				}
+				state.resume();
+			}
+		}
+	});
+
+	// generateRandomCitizens (demand sampling, pathfinding, publishing), per citizen
+	suite.add("spawn/generate_random_citizens", [&rng](MicrobenchState& state) {
+		uint64_t i = 0;
+		while (i < state.iterations) {
+			int batch = int(std::min(uint64_t(SPAWN_QUEUE_SIZE), state.iterations - i));
+			int spawned = generateRandomCitizens(batch, simTime, rng, false);
+			state.pause();
+			discardSpawnQueue();
+			state.resume();
+			if (spawned == 0) break;
+			i += spawned;
+		}
+	});
+
+	// CitizenVector::drain, per citizen, into free slots of a vector that already holds them and into new ones
+	Citizen spawned = active.empty() ? Citizen() : active.front();
+	auto drainCitizens = [spawned](bool reuse) {
+		return [spawned, reuse](MicrobenchState& state) {
+			state.pause();
+			// CitizenVector holds an atomic, so a full one is replaced rather than reassigned
+			std::unique_ptr<CitizenVector> vec(new CitizenVector(CITIIZEN_VEC_RESERVE, MAX_CITIZENS));
+			if (reuse) {
+				for (int c = 0; c < SPAWN_QUEUE_SIZE; c++) spawnQueue.push(spawned);
+				vec->drain(spawnQueue);
+			}
+			state.resume();
+			uint64_t i = 0;
+			while (i < state.iterations) {
+				state.pause();
+				int batch = int(std::min(uint64_t(SPAWN_QUEUE_SIZE), state.iterations - i));
+				if (reuse) {
+					// the slots removed here are exactly the ones the drain refills
+					for (int c = 0; c < batch; c++) vec->remove(c);
+				}
+				else if (vec->size() + batch > vec->max()) {
+					vec.reset(new CitizenVector(CITIIZEN_VEC_RESERVE, MAX_CITIZENS));
+				}
+				for (int c = 0; c < batch; c++) spawnQueue.push(spawned);
+				state.resume();
+				vec->drain(spawnQueue);
+				i += batch;
+			}
+		};
+	};
+	suite.add("citizens/drain_reuse", drainCitizens(true));
+	suite.add("citizens/drain_append", drainCitizens(false));
+
+	suite.run(filter, minSeconds);
+	return AOK;
+}
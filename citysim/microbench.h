@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "macros.h"
+
+// allocations made by the calling thread so far (0 unless MICROBENCH_COUNT_ALLOCATIONS)
+uint64_t threadAllocations();
+uint64_t threadAllocatedBytes();
+
+// handed to a microbenchmark body, which runs the measured operation exactly iterations times
+// work between pause() and resume() (setup, restoring state) is neither timed nor counted as allocations
+class MicrobenchState {
+public:
+	explicit MicrobenchState(uint64_t n);
+
+	const uint64_t iterations;
+
+	void pause();
+	void resume();
+	// ends the measurement (called by the suite after the body returns)
+	void stop();
+
+	inline double seconds() const {
+		return elapsed;
+	}
+	inline uint64_t allocations() const {
+		return allocationCount;
+	}
+	inline uint64_t allocatedBytes() const {
+		return allocatedByteCount;
+	}
+private:
+	std::chrono::steady_clock::time_point started;
+	uint64_t startAllocations;
+	uint64_t startBytes;
+	bool running = true;
+	double elapsed = 0;
+	uint64_t allocationCount = 0;
+	uint64_t allocatedByteCount = 0;
+};
+
+// named microbenchmarks, each run with growing iteration counts until one run lasts minSeconds
+class MicrobenchSuite {
+public:
+	void add(const std::string& name, std::function<void(MicrobenchState&)> body);
+	// runs every benchmark whose name contains filter and prints ns/op and allocations/op per benchmark
+	void run(const std::string& filter, double minSeconds);
+private:
+	struct Benchmark {
+		std::string name;
+		std::function<void(MicrobenchState&)> body;
+	};
+	std::vector<Benchmark> benchmarks;
+};
+
+// builds the simulation hot path suite on the initialized simulation (see init) and runs it
+// the simulation is advanced single-threaded for MICROBENCH_WARMUP_TICKS first, so citizens and trains are in a realistic mix of states
+int runMicrobenchmarks(const std::string& filter, double minSeconds);
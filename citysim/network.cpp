@@ -0,0 +1,403 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include "network.h"
+#include "line.h"
+#include "node.h"
+#include "graph.h"
+#include "spatial.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+extern int VALID_LINES;
+extern int VALID_NODES;
+extern std::vector<Line> lines;
+extern std::vector<Node> nodes;
+extern Graph graph;
+extern Line WALKING_LINE;
+extern unsigned int totalRidership;
+extern SpatialGrid nodeIndex;
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(const std::string& filename) {
+	close();
+	#ifdef _WIN32
+	HANDLE f = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (f == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(f, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(f);
+		return false;
+	}
+	HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m == nullptr) {
+		CloseHandle(f);
+		return false;
+	}
+	void* view = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr) {
+		CloseHandle(m);
+		CloseHandle(f);
+		return false;
+	}
+	file = f;
+	mapping = m;
+	ptr = static_cast<const uint8_t*>(view);
+	length = size_t(fileSize.QuadPart);
+	#else
+	int f = ::open(filename.c_str(), O_RDONLY);
+	if (f < 0) return false;
+	struct stat st;
+	if (fstat(f, &st) != 0 || st.st_size == 0) {
+		::close(f);
+		return false;
+	}
+	void* view = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, f, 0);
+	if (view == MAP_FAILED) {
+		::close(f);
+		return false;
+	}
+	fd = f;
+	ptr = static_cast<const uint8_t*>(view);
+	length = size_t(st.st_size);
+	#endif
+	return true;
+}
+
+void MappedFile::close() {
+	if (ptr == nullptr) return;
+	#ifdef _WIN32
+	UnmapViewOfFile(ptr);
+	CloseHandle(mapping);
+	CloseHandle(file);
+	mapping = file = nullptr;
+	#else
+	munmap(const_cast<uint8_t*>(ptr), length);
+	::close(fd);
+	fd = -1;
+	#endif
+	ptr = nullptr;
+	length = 0;
+}
+
+uint64_t networkChecksum(const uint8_t* data, size_t size) {
+	const uint64_t prime = 0x100000001b3ull;
+	uint64_t hash = 0xcbf29ce484222325ull;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		std::memcpy(&word, data + i, 8);
+		hash = (hash ^ word) * prime;
+	}
+	for (; i < size; i++) {
+		hash = (hash ^ data[i]) * prime;
+	}
+	return hash;
+}
+
+uint64_t networkBuildKey() {
+	const double parameters[] = {
+		WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_SCALE, WINDOW_X_SCALE, WINDOW_Y_SCALE, WINDOW_X_OFFSET, WINDOW_Y_OFFSET,
+		NODE_ID_SIZE, LINE_ID_SIZE,
+		DISTANCE_SCALE, TRANSFER_MAX_DIST, TRANSFER_PENALTY_MULTIPLIER
+	};
+	return networkChecksum(reinterpret_cast<const uint8_t*>(parameters), sizeof(parameters));
+}
+
+int NetworkImage::open(const std::string& filename) {
+	if (!file.open(filename)) {
+		return ERROR_OPENING_FILE;
+	}
+	if (file.size() < sizeof(NetworkHeader)) {
+		std::cout << "WARN: " << filename << " is truncated" << std::endl;
+		return ERROR_INVALID_FILE;
+	}
+
+	const NetworkHeader& h = header();
+	if (std::memcmp(h.magic, NETWORK_IMAGE_MAGIC, sizeof(h.magic)) != 0 || h.byteOrder != NETWORK_BYTE_ORDER_MARK) {
+		std::cout << "WARN: " << filename << " is not a network image for this machine" << std::endl;
+		return ERROR_INVALID_FILE;
+	}
+	if (h.version != NETWORK_IMAGE_VERSION || h.buildKey != networkBuildKey()) {
+		std::cout << "WARN: " << filename << " was compiled by another version or configuration" << std::endl;
+		return ERROR_INVALID_FILE;
+	}
+	if (h.fileSize != file.size() || sizeof(NetworkHeader) + uint64_t(h.numSections) * sizeof(NetworkSection) > file.size()) {
+		std::cout << "WARN: " << filename << " is truncated" << std::endl;
+		return ERROR_INVALID_FILE;
+	}
+	#if NETWORK_IMAGE_VERIFY == true
+	if (networkChecksum(file.data() + sizeof(NetworkHeader), file.size() - sizeof(NetworkHeader)) != h.checksum) {
+		std::cout << "WARN: " << filename << " failed its checksum" << std::endl;
+		return ERROR_INVALID_FILE;
+	}
+	#endif
+
+	sections = reinterpret_cast<const NetworkSection*>(file.data() + sizeof(NetworkHeader));
+	for (const NetworkSection* s = sections; s < sections + h.numSections; s++) {
+		if (s->offset % 8 != 0 || s->offset > file.size() || s->size > file.size() - s->offset || s->elementSize == 0) {
+			std::cout << "WARN: " << filename << " has a section out of bounds" << std::endl;
+			return ERROR_INVALID_FILE;
+		}
+	}
+	return AOK;
+}
+
+int NetworkImageWriter::write(const std::string& filename, NetworkHeader header) {
+	// lay sections out after the section table
+	uint64_t offset = sizeof(NetworkHeader) + sections.size() * sizeof(NetworkSection);
+	for (NetworkSection& s : sections) {
+		offset = (offset + 7) & ~uint64_t(7);
+		s.offset = offset;
+		offset += s.size;
+	}
+
+	std::vector<uint8_t> image(offset, 0);
+	std::memcpy(image.data() + sizeof(NetworkHeader), sections.data(), sections.size() * sizeof(NetworkSection));
+	for (size_t i = 0; i < sections.size(); i++) {
+		if (!payloads[i].empty()) {
+			std::memcpy(image.data() + sections[i].offset, payloads[i].data(), payloads[i].size());
+		}
+	}
+
+	std::memcpy(header.magic, NETWORK_IMAGE_MAGIC, sizeof(header.magic));
+	header.version = NETWORK_IMAGE_VERSION;
+	header.byteOrder = NETWORK_BYTE_ORDER_MARK;
+	header.buildKey = networkBuildKey();
+	header.fileSize = image.size();
+	header.numSections = uint32_t(sections.size());
+	header.checksum = networkChecksum(image.data() + sizeof(NetworkHeader), image.size() - sizeof(NetworkHeader));
+	std::memcpy(image.data(), &header, sizeof(NetworkHeader));
+
+	// never leave a half-written image behind under the real name
+	std::string tempName = filename + ".tmp";
+	{
+		std::ofstream out(tempName, std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) {
+			std::cerr << "Error opening " << tempName << std::endl;
+			return ERROR_OPENING_FILE;
+		}
+		out.write(reinterpret_cast<const char*>(image.data()), std::streamsize(image.size()));
+		if (!out) {
+			std::cerr << "Error writing " << tempName << std::endl;
+			return ERROR_OPENING_FILE;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(tempName, filename, error);
+	if (error) {
+		std::cerr << "Error renaming " << tempName << " to " << filename << ": " << error.message() << std::endl;
+		return ERROR_OPENING_FILE;
+	}
+	return AOK;
+}
+
+int compileNetwork(const std::string& filename) {
+	NetworkHeader header = {};
+	NetworkImageWriter writer;
+
+	std::vector<NetworkNode> nodeRecords(VALID_NODES);
+	for (int i = 0; i < VALID_NODES; i++) {
+		Node& node = nodes[i];
+		NetworkNode& record = nodeRecords[i];
+		std::strncpy(record.id, node.id, NODE_ID_SIZE - 1);
+		record.numerID = node.numerID;
+		record.ridership = node.ridership;
+		record.x = node.getPosition().x;
+		record.y = node.getPosition().y;
+		record.numLines = uint8_t(node.numLines);
+	}
+
+	std::vector<NetworkLine> lineRecords(VALID_LINES);
+	std::vector<uint32_t> stops;
+	std::vector<float> dists;
+	std::vector<NetworkSegment> segments;
+	std::vector<float> points;
+	for (int l = 0; l < VALID_LINES; l++) {
+		Line& line = lines[l];
+		NetworkLine& record = lineRecords[l];
+		std::strncpy(record.id, line.id, LINE_ID_SIZE - 1);
+		record.color = line.color.toInteger();
+		record.size = uint32_t(line.size);
+		record.firstStop = uint32_t(stops.size());
+		record.firstSegment = uint32_t(segments.size());
+		for (int i = 0; i < line.size; i++) {
+			stops.push_back(uint32_t(line.path[i]->index));
+			dists.push_back(line.dist[i]);
+		}
+		for (Segment& segment : line.segments) {
+			segments.push_back({ uint32_t(points.size() / 2), uint32_t(segment.polyline.points.size()), segment.maxSpeed, segment.accel, segment.decel });
+			for (Vector2f& point : segment.polyline.points) {
+				points.push_back(point.x);
+				points.push_back(point.y);
+			}
+		}
+	}
+
+	writer.add(NETWORK_NODES, nodeRecords);
+	writer.add(NETWORK_ADJ_OFFSETS, std::vector<uint32_t>(graph.offsets, graph.offsets + graph.numNodes + 1));
+	writer.add(NETWORK_ADJ_TARGETS, std::vector<uint32_t>(graph.targets, graph.targets + graph.numEdges));
+	writer.add(NETWORK_ADJ_LINES, std::vector<int32_t>(graph.lines, graph.lines + graph.numEdges));
+	writer.add(NETWORK_ADJ_WEIGHTS, std::vector<float>(graph.weights, graph.weights + graph.numEdges));
+	writer.add(NETWORK_LINES, lineRecords);
+	writer.add(NETWORK_LINE_STOPS, stops);
+	writer.add(NETWORK_LINE_DISTS, dists);
+	writer.add(NETWORK_SEGMENTS, segments);
+	writer.add(NETWORK_POINTS, points);
+
+	header.numNodes = uint32_t(VALID_NODES);
+	header.numLines = uint32_t(VALID_LINES);
+	header.numEdges = uint32_t(graph.numEdges);
+	int status = writer.write(filename, header);
+	if (status == AOK) {
+		std::cout << "Compiled " << VALID_NODES << " nodes, " << graph.numEdges << " edges, " << VALID_LINES << " lines into " << filename << std::endl;
+	}
+	return status;
+}
+
+// true if any of the files the image is compiled from changed after it was written
+static bool networkSourcesNewer(const std::string& filename) {
+	std::error_code error;
+	auto imageTime = std::filesystem::last_write_time(filename, error);
+	if (error) return true;
+	for (const char* source : { "lines_stations.csv", "stations_data.csv", "geometry.csv" }) {
+		auto sourceTime = std::filesystem::last_write_time(source, error);
+		if (!error && sourceTime > imageTime) {
+			std::cout << "WARN: " << source << " changed after " << filename << " was compiled" << std::endl;
+			return true;
+		}
+	}
+	return false;
+}
+
+// the graph uses the image's adjacency arrays in place, so it stays mapped
+static NetworkImage image;
+
+int loadNetwork(const std::string& filename) {
+	int status = image.open(filename);
+	if (status != AOK) {
+		if (status == ERROR_OPENING_FILE) {
+			std::cout << "No " << filename << " found" << std::endl;
+		}
+		return status;
+	}
+	if (networkSourcesNewer(filename)) {
+		return ERROR_INVALID_FILE;
+	}
+
+	const NetworkHeader& header = image.header();
+	size_t numNodes, numOffsets, numEdges, numEdgeLines, numWeights, numLines, numStops, numDists, numSegments, numPoints;
+	const NetworkNode* nodeRecords = image.section<NetworkNode>(NETWORK_NODES, &numNodes);
+	const uint32_t* adjOffsets = image.section<uint32_t>(NETWORK_ADJ_OFFSETS, &numOffsets);
+	const uint32_t* targets = image.section<uint32_t>(NETWORK_ADJ_TARGETS, &numEdges);
+	const int32_t* edgeLines = image.section<int32_t>(NETWORK_ADJ_LINES, &numEdgeLines);
+	const float* weights = image.section<float>(NETWORK_ADJ_WEIGHTS, &numWeights);
+	const NetworkLine* lineRecords = image.section<NetworkLine>(NETWORK_LINES, &numLines);
+	const uint32_t* stops = image.section<uint32_t>(NETWORK_LINE_STOPS, &numStops);
+	const float* dists = image.section<float>(NETWORK_LINE_DISTS, &numDists);
+	const NetworkSegment* segments = image.section<NetworkSegment>(NETWORK_SEGMENTS, &numSegments);
+	const float* points = image.section<float>(NETWORK_POINTS, &numPoints);
+
+	// the checksum covers corruption, these cover images written by a buggy compiler
+	bool valid = numNodes == header.numNodes && numLines == header.numLines
+		&& numOffsets == numNodes + 1 && numEdges == header.numEdges && numEdgeLines == numEdges && numWeights == numEdges && adjOffsets[numNodes] == numEdges
+		&& numStops == numDists;
+	for (size_t i = 0; valid && i < numNodes; i++) {
+		valid = adjOffsets[i] <= adjOffsets[i + 1];
+	}
+	for (size_t e = 0; valid && e < numEdges; e++) {
+		valid = targets[e] < numNodes && edgeLines[e] >= GRAPH_WALKING_LINE && edgeLines[e] < int32_t(numLines);
+	}
+	for (size_t l = 0; valid && l < numLines; l++) {
+		const NetworkLine& record = lineRecords[l];
+		valid = record.size >= 2 && record.firstStop + uint64_t(record.size) <= numStops
+			&& record.firstSegment + uint64_t(record.size - 1) <= numSegments;
+		for (uint32_t i = 0; valid && i < record.size; i++) {
+			valid = stops[record.firstStop + i] < numNodes;
+		}
+	}
+	for (size_t s = 0; valid && s < numSegments; s++) {
+		valid = (segments[s].firstPoint + uint64_t(segments[s].numPoints)) * 2 <= numPoints;
+	}
+	if (!valid) {
+		std::cout << "WARN: " << filename << " is inconsistent" << std::endl;
+		return ERROR_INVALID_FILE;
+	}
+
+	// nodes
+	VALID_NODES = int(numNodes);
+	totalRidership = 0;
+	nodes.assign(numNodes, Node());
+	for (int i = 0; i < VALID_NODES; i++) {
+		const NetworkNode& record = nodeRecords[i];
+		Node& node = nodes[i];
+		node.index = i;
+		std::memcpy(node.id, record.id, NODE_ID_SIZE);
+		node.id[NODE_ID_SIZE - 1] = '\0';
+		node.status = STATUS_SPAWNED;
+		node.numerID = record.numerID;
+		node.ridership = record.ridership;
+		node.numLines = char(record.numLines);
+		node.setPosition(record.x, record.y);
+		totalRidership += node.ridership;
+	}
+
+	// lines and their track geometry
+	VALID_LINES = int(numLines);
+	lines.assign(numLines, Line());
+	graph.bind(nodes.data(), lines.data(), &WALKING_LINE);
+	std::vector<std::vector<uint32_t>> lineStops(numLines);
+	for (int l = 0; l < VALID_LINES; l++) {
+		lineStops[l].assign(stops + lineRecords[l].firstStop, stops + lineRecords[l].firstStop + lineRecords[l].size);
+	}
+	graph.buildLines(lines.data(), VALID_LINES, lineStops);
+	for (int l = 0; l < VALID_LINES; l++) {
+		const NetworkLine& record = lineRecords[l];
+		Line& line = lines[l];
+		std::memcpy(line.id, record.id, LINE_ID_SIZE);
+		line.id[LINE_ID_SIZE - 1] = '\0';
+		line.color = sf::Color(record.color);
+		for (uint32_t i = 0; i < record.size; i++) {
+			line.dist[i] = dists[record.firstStop + i];
+		}
+		line.segments.assign(record.size - 1, Segment());
+		for (uint32_t i = 0; i + 1 < record.size; i++) {
+			const NetworkSegment& s = segments[record.firstSegment + i];
+			std::vector<Vector2f> track(s.numPoints);
+			for (uint32_t p = 0; p < s.numPoints; p++) {
+				track[p] = Vector2f(points[(s.firstPoint + p) * 2], points[(s.firstPoint + p) * 2 + 1]);
+			}
+			Segment& segment = line.segments[i];
+			segment.polyline.build(track);
+			segment.maxSpeed = s.maxSpeed;
+			segment.accel = s.accel;
+			segment.decel = s.decel;
+		}
+	}
+
+	// walking and line neighbors
+	graph.borrow(numNodes, numEdges, adjOffsets, targets, edgeLines, weights);
+
+	// node index (building it is linear, cheaper than validating a stored one)
+	std::vector<Vector2f> positions(numNodes);
+	for (int i = 0; i < VALID_NODES; i++) {
+		positions[i] = nodes[i].getPosition();
+	}
+	nodeIndex.build(positions);
+
+	std::cout << "Loaded " << VALID_NODES << " nodes, " << numEdges << " edges, " << VALID_LINES << " lines from " << filename << std::endl;
+	return AOK;
+}
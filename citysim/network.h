@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "macros.h"
+
+// read-only view of a whole file mapped into memory (mmap on POSIX, MapViewOfFile on Windows)
+class MappedFile {
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	bool open(const std::string& filename);
+	void close();
+
+	inline const uint8_t* data() {
+		return ptr;
+	}
+	inline size_t size() {
+		return length;
+	}
+private:
+	const uint8_t* ptr = nullptr;
+	size_t length = 0;
+	#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+	#else
+	int fd = -1;
+	#endif
+};
+
+// Binary network image layout (written by `citysim compile`, native byte order, every section 8 byte aligned):
+// NetworkHeader, NetworkSection[numSections], section payloads
+// node and line references are indices into the NODES and LINES sections, line GRAPH_WALKING_LINE is the walking line
+// the adjacency sections are used in place by the Graph (see Graph::borrow)
+#define NETWORK_IMAGE_MAGIC			"CSNETIMG"
+#define NETWORK_IMAGE_VERSION		4
+#define NETWORK_BYTE_ORDER_MARK		0x01020304u
+
+enum NetworkSectionID : uint32_t {
+	NETWORK_NODES = 1, // NetworkNode[numNodes]
+	NETWORK_ADJ_OFFSETS, // uint32_t[numNodes + 1], CSR row offsets into the NETWORK_ADJ_ arrays
+	NETWORK_ADJ_TARGETS, // uint32_t[numEdges] node index
+	NETWORK_ADJ_LINES, // int32_t[numEdges] line index
+	NETWORK_ADJ_WEIGHTS, // float[numEdges]
+	NETWORK_LINES, // NetworkLine[numLines]
+	NETWORK_LINE_STOPS, // uint32_t node index per stop of every line
+	NETWORK_LINE_DISTS, // float per stop of every line (Line::dist)
+	NETWORK_SEGMENTS, // NetworkSegment per segment of every line
+	NETWORK_POINTS, // float x, y per track point
+};
+
+struct NetworkHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint64_t buildKey; // hash of the macros that preprocessing depends on (see networkBuildKey)
+	uint64_t checksum; // over everything after the header
+	uint64_t fileSize;
+	uint32_t numSections;
+	uint32_t numNodes;
+	uint32_t numLines;
+	uint32_t numEdges;
+};
+
+struct NetworkSection {
+	uint32_t id;
+	uint32_t elementSize;
+	uint64_t offset; // from the start of the file
+	uint64_t size; // bytes
+};
+
+struct NetworkNode {
+	char id[NODE_ID_SIZE];
+	uint32_t numerID;
+	uint32_t ridership;
+	float x; // screen position
+	float y;
+	uint8_t numLines;
+	uint8_t pad[3];
+};
+
+struct NetworkLine {
+	char id[LINE_ID_SIZE];
+	uint32_t color; // RGBA
+	uint32_t size;
+	uint32_t firstStop; // into NETWORK_LINE_STOPS/NETWORK_LINE_DISTS
+	uint32_t firstSegment; // into NETWORK_SEGMENTS, size - 1 segments
+};
+
+struct NetworkSegment {
+	uint32_t firstPoint; // into NETWORK_POINTS
+	uint32_t numPoints;
+	float maxSpeed;
+	float accel;
+	float decel;
+};
+
+// validated, memory-mapped network image
+class NetworkImage {
+public:
+	// maps filename and checks its magic, version, byte order, build key, checksum and section bounds
+	int open(const std::string& filename);
+
+	inline const NetworkHeader& header() {
+		return *reinterpret_cast<const NetworkHeader*>(file.data());
+	}
+
+	// section payload as an array of T, nullptr (and count 0) if the image has no such section
+	template<class T>
+	const T* section(NetworkSectionID id, size_t* count) {
+		for (const NetworkSection* s = sections; s < sections + header().numSections; s++) {
+			if (s->id == id && s->elementSize == sizeof(T)) {
+				*count = size_t(s->size / sizeof(T));
+				return reinterpret_cast<const T*>(file.data() + s->offset);
+			}
+		}
+		*count = 0;
+		return nullptr;
+	}
+private:
+	MappedFile file;
+	const NetworkSection* sections = nullptr;
+};
+
+// collects sections in memory and writes them out as one image
+class NetworkImageWriter {
+public:
+	template<class T>
+	void add(NetworkSectionID id, const std::vector<T>& elements) {
+		NetworkSection s = { id, uint32_t(sizeof(T)), 0, elements.size() * sizeof(T) };
+		sections.push_back(s);
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(elements.data());
+		payloads.emplace_back(bytes, bytes + s.size);
+	}
+
+	// fills in the header's magic, version, offsets and checksum, writes to a temporary file and renames it over filename
+	int write(const std::string& filename, NetworkHeader header);
+private:
+	std::vector<NetworkSection> sections;
+	std::vector<std::vector<uint8_t>> payloads;
+};
+
+// 64 bit FNV-1a over 8 byte words (then the remaining bytes)
+uint64_t networkChecksum(const uint8_t* data, size_t size);
+// hash of every macro that changes the preprocessed network, images built with other values are rejected
+uint64_t networkBuildKey();
+
+// writes the network currently in nodes/lines/graph (as built from the CSVs by init) to filename
+int compileNetwork(const std::string& filename);
+// replaces parsing the CSVs and preprocessing: fills nodes, lines, their track geometry and nodeIndex from an image
+// and maps the graph onto it (the image stays mapped for the rest of the run)
+// fails (leaving them untouched) if the image is missing, invalid, or older than the CSVs it was compiled from
+int loadNetwork(const std::string& filename);
@@ -1,6 +1,13 @@
 #include <iostream>
 #include "node.h"
 #include "pathcache.h"
+#include "graph.h"
+#include "trace.h"
+#include "config.h"
+
+extern Graph graph;
+extern Tracer tracer;
+extern SimConfig config;
 
 PathCache cache = PathCache(PATH_CACHE_BUCKETS, PATH_CACHE_BUCKETS_SIZE);
 
@@ -9,74 +16,46 @@ int pathCacheHits;
 int pathFails;
 
 Node::Node() : Drawable(NODE_MIN_SIZE, NODE_N_POINTS) {
-    numNeighbors = 0;
-    for (int i = 0; i < NODE_N_NEIGHBORS; i++) {
-        neighbors[i] = PathWrapper();
-    }
-    for (int i = 0; i < NODE_N_TRAINS; i++) {
-        trains[i] = nullptr;
-    }
-}
-
-bool Node::addTrain(Train* train) {
-    for (int i = 0; i < NODE_N_TRAINS; i++) {
-        if (trains[i] == nullptr) {
-            trains[i] = train;
-            return true;
-        }
-    }
-    return false;
+    index = 0;
 }
 
-bool Node::removeTrain(Train* train) {
-    for (int i = 0; i < NODE_N_TRAINS; i++) {
-        if (trains[i] == train) {
-            trains[i] = nullptr;
-            return true;
+// returns the index of line's forward platform (the backward platform follows it)
+int Node::addPlatforms(Line* line) {
+    for (size_t i = 0; i < platforms.size(); i += 2) {
+        if (platforms[i].line == line) {
+            return int(i);
         }
     }
-    return false;
+    platforms.push_back(Platform{ line, STATUS_FORWARD, {} });
+    platforms.push_back(Platform{ line, STATUS_BACKWARD, {} });
+    return int(platforms.size()) - 2;
 }
 
-bool Node::addNeighbor(const PathWrapper& neighbor, float weight) {
-    for (int i = 0; i < NODE_N_NEIGHBORS; i++) {
-        if (neighbors[i].node == neighbor.node && neighbors[i].line == neighbor.line) {
-            return false;
-        }
-        if (neighbors[i].node == nullptr) {
-            neighbors[i] = neighbor;
-            weights[i] = weight;
-            numNeighbors++;
-            return true;
-        }
-    }
-    std::cout << "Too big @" << id << std::endl;
-    return false;
+void Node::addTrain(int train, int platform) {
+    platforms[platform].trains.push_back(train);
 }
 
-bool Node::removeNeighbor(const PathWrapper& neighbor) {
-    for (int i = 0; i < NODE_N_NEIGHBORS; i++) {
-        if (neighbors[i].node == neighbor.node && neighbors[i].line == neighbor.line) {
-            neighbors[i].node = nullptr;
-            neighbors[i].line = nullptr;
-            numNeighbors--;
-            return true;
-        }
+bool Node::removeTrain(int train, int platform) {
+    std::vector<int>& platformTrains = platforms[platform].trains;
+    // trains almost always leave in the order they arrived, so this usually stops at the front
+    auto it = std::find(platformTrains.begin(), platformTrains.end(), train);
+    if (it == platformTrains.end()) {
+        return false;
     }
-    return false;
+    platformTrains.erase(it);
+    return true;
 }
 
-char Node::numTrains() {
+int Node::numTrains() {
     int c = 0;
-    for (int i = 0; i < NODE_N_TRAINS; i++) {
-        if (trains[i] != nullptr) {
-            c++; // lol, haha! funny!
-        }
+    for (Platform& platform : platforms) {
+        c += int(platform.trains.size());
     }
     return c;
 }
 
 bool Node::findPath(Node* end, PathWrapper* destPath, char* destPathSize) {
+    TraceScope scope(tracer, "findPath", "path");
     pathRequests++;
     Node* endCopy = end;
 
@@ -99,6 +78,9 @@ bool Node::findPath(Node* end, PathWrapper* destPath, char* destPathSize) {
         }
         return true;
     }
+    #if TRACE == true
+    tracer.instant("path cache miss", "path");
+    #endif
 
     auto compare = [](Node* a, Node* b) { return a->score > b->score; };
     std::priority_queue<Node*, std::vector<Node*>, decltype(compare)> queue(compare);
@@ -157,17 +139,17 @@ bool Node::findPath(Node* end, PathWrapper* destPath, char* destPathSize) {
 
         visited.insert(current);
 
-        for (int i = 0; i < current->numNeighbors; i++) {
-            Node* neighbor = current->neighbors[i].node;
-            if (neighbor == nullptr) continue;
-            Line* line = current->neighbors[i].line;
+        // neighbors are contiguous in the graph's CSR arrays
+        for (uint32_t e = graph.begin(current->index); e < graph.end(current->index); e++) {
+            Node* neighbor = graph.target(e);
+            Line* line = graph.line(e);
 
             if (visited.find(neighbor) != visited.end()) continue;
 
-            float aggregateScore = score[current] + current->weights[i];
+            float aggregateScore = score[current] + graph.weights[e];
 
             if (from[neighbor].line != line) {
-                aggregateScore += TRANSFER_PENALTY;
+                aggregateScore += config.transferPenalty;
             }
 
             if (aggregateScore < score[neighbor] || queueSet.find(neighbor) == queueSet.end()) {
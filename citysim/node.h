@@ -10,7 +10,6 @@
 #include "drawable.h"
 #include "line.h"
 
-class Train;
 class PathCacheWrapper;
 
 struct PathWrapper {
@@ -18,56 +17,34 @@ struct PathWrapper {
     Line* line;
 };
 
+// trains of one line running in one direction, waiting at a node
+struct Platform {
+    Line* line;
+    char direction;
+    std::vector<int> trains; // train ids (see TrainStore) in arrival order
+};
+
 class Node : public Drawable {
 public:
     char id[NODE_ID_SIZE];
     unsigned int ridership;
     unsigned int capacity;
-    unsigned short int numerID;
-    char numNeighbors;
+    unsigned int numerID;
+    int index; // position in nodes (and in the Graph)
     char status;
     float score;
-    unsigned short int gridPos;
     unsigned short int level;
     unsigned long int totalRiders;
     char numLines;
-    PathWrapper neighbors[NODE_N_NEIGHBORS];
-    float weights[NODE_N_NEIGHBORS];
-    Train* trains[NODE_N_TRAINS];
+    std::vector<Platform> platforms; // indexed through Line::platformIndex, must not grow after init
 
     Node();
 
-    bool addTrain(Train* train);
-    bool removeTrain(Train* train);
-    bool addNeighbor(const PathWrapper& neighbor, float weight);
-    bool removeNeighbor(const PathWrapper& neighbor);
+    int addPlatforms(Line* line);
+    void addTrain(int train, int platform);
+    bool removeTrain(int train, int platform);
 
-    inline void setGridPos(char x, char y) {
-        gridPos = x << 8 | y;
-    }
-    inline char gridX() {
-        return gridPos >> 8;
-    }
-    inline char gridY() {
-        return gridPos & 0x0F;
-    }
-    inline char lowerGridX() {
-        char x = gridX();
-        return x > 0 ? x - 1 : x;
-    }
-    inline char upperGridX() {
-        char x = gridX();
-        return x < NODE_GRID_ROWS - 1 ? x + 1 : x;
-    }
-    inline char lowerGridY() {
-        char y = gridY();
-        return y > 0 ? y - 1 : y;
-    }
-    inline char upperGridY() {
-        char y = gridY();
-        return y < NODE_GRID_COLS - 1 ? y + 1 : y;
-    }
-    char numTrains();
+    int numTrains();
 
     static std::vector<PathWrapper> bidirectionalAStar(Node* start, Node* end);
     bool findPath(Node* end, PathWrapper* destPath, char* destPathSize);
@@ -1,4 +1,5 @@
 #include "pathcache.h"
+#include "checkpoint.h"
 #include <iostream>
 
 PathCacheWrapper NULL_WRAPPER;
@@ -91,3 +92,59 @@ PathCacheWrapper& PathCache::get(Node* start, Node* end) {
     return NULL_WRAPPER;
 }
 
+void PathCache::erase(Node* start, Node* end) {
+    int bucket = (start->numerID * PRIME_1 + end->numerID * PRIME_2) % NUM_BUCKETS;
+    int bucketInd = bucket * BUCKET_SIZE;
+    for (int i = 0; i < int(BUCKET_SIZE); i++) {
+        int ind = bucketInd + i;
+        if (cache[ind].startNode == start && cache[ind].endNode == end) {
+            cache[ind].startNode = nullptr;
+            cache[ind].endNode = nullptr;
+            cache[ind].size = -1;
+            cache[ind].lru = -1;
+            return;
+        }
+    }
+}
+
+void PathCache::save(CheckpointWriter& out) {
+    out.put(uint64_t(NUM_BUCKETS * BUCKET_SIZE));
+    for (size_t i = 0; i < NUM_BUCKETS * BUCKET_SIZE; i++) {
+        PathCacheWrapper& entry = cache[i];
+        out.put(out.node(entry.startNode));
+        out.put(out.node(entry.endNode));
+        out.put(entry.size);
+        out.put(entry.lru);
+        for (PathWrapper& p : entry.path) {
+            out.put(out.node(p.node));
+            out.put(out.line(p.line));
+        }
+    }
+}
+
+bool PathCache::restore(CheckpointReader& in) {
+    uint64_t count = 0;
+    if (!in.get(count) || count != NUM_BUCKETS * BUCKET_SIZE) {
+        in.fail();
+        return false;
+    }
+    for (size_t i = 0; in.valid() && i < NUM_BUCKETS * BUCKET_SIZE; i++) {
+        PathCacheWrapper& entry = cache[i];
+        int32_t startNode, endNode;
+        in.get(startNode);
+        in.get(endNode);
+        in.get(entry.size);
+        in.get(entry.lru);
+        entry.startNode = in.node(startNode);
+        entry.endNode = in.node(endNode);
+        for (PathWrapper& p : entry.path) {
+            int32_t node, line;
+            in.get(node);
+            in.get(line);
+            p.node = in.node(node);
+            p.line = in.line(line);
+        }
+        if (entry.size > CITIZEN_PATH_SIZE) in.fail();
+    }
+    return in.valid();
+}
@@ -2,6 +2,9 @@
 
 #include "node.h"
 
+class CheckpointWriter;
+class CheckpointReader;
+
 struct PathCacheWrapper {
     Node* startNode;
     Node* endNode;
@@ -26,6 +29,16 @@ public:
 
     bool put(Node* start, Node* end, PathWrapper* p, int s);
     PathCacheWrapper& get(Node* start, Node* end);
+    // empties the entry for start -> end if there is one (the LRU ages of the bucket are left as they are)
+    void erase(Node* start, Node* end);
+
+    inline size_t memoryBytes() const {
+        return NUM_BUCKETS * BUCKET_SIZE * sizeof(PathCacheWrapper);
+    }
+
+    // every entry with its LRU age, pointers as node/line indices (see saveCheckpoint)
+    void save(CheckpointWriter& out);
+    bool restore(CheckpointReader& in);
 private:
     PathCacheWrapper* cache;
     size_t NUM_BUCKETS;
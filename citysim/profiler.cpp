@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ostream>
+#include "profiler.h"
+
+const char* const PROFILE_PHASE_NAMES[PROFILE_NUM_PHASES] = { "spawn handoff", "train update", "chunk dispatch", "citizen worker", "citizen wait", "despawn merge", "render snapshot", "tick" };
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+	for (int b = 0; b < NUM_BUCKETS; b++) {
+		counts[b] += other.counts[b];
+	}
+	count += other.count;
+	sum += other.sum;
+	max = std::max(max, other.max);
+}
+
+void LatencyHistogram::reset() {
+	counts.fill(0);
+	count = 0;
+	sum = 0;
+	max = 0;
+}
+
+uint64_t LatencyHistogram::bucketHighest(int bucket) {
+	if (bucket < SUB_BUCKETS) return uint64_t(bucket);
+	int k = bucket - SUB_BUCKETS;
+	int shift = k / (SUB_BUCKETS / 2) + 1;
+	uint64_t top = uint64_t(k % (SUB_BUCKETS / 2) + SUB_BUCKETS / 2);
+	return (top << shift) + ((uint64_t(1) << shift) - 1);
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+	if (count == 0) return 0;
+	uint64_t rank = std::max(uint64_t(1), uint64_t(std::ceil(p / 100 * count)));
+	uint64_t seen = 0;
+	for (int b = 0; b < NUM_BUCKETS; b++) {
+		seen += counts[b];
+		if (seen >= rank) return std::min(bucketHighest(b), max);
+	}
+	return max;
+}
+
+void Profiler::setWorkers(int workers) {
+	workerNanos.assign(workers, 0);
+	workerTotals.assign(workers, 0);
+	workerTicks.assign(workers, 0);
+}
+
+void Profiler::endTick(int workers) {
+	uint64_t slowest = 0;
+	uint64_t total = 0;
+	for (int w = 0; w < workers; w++) {
+		phases[PROFILE_CITIZEN_WORKER].record(workerNanos[w]);
+		workerTotals[w] += workerNanos[w];
+		workerTicks[w]++;
+		slowest = std::max(slowest, workerNanos[w]);
+		total += workerNanos[w];
+	}
+	// a single worker is balanced by definition
+	if (workers > 1 && total > 0) {
+		imbalance.record(slowest * 1000 * workers / total);
+	}
+}
+
+void Profiler::report(std::ostream& out) const {
+	char line[128];
+	std::snprintf(line, sizeof(line), "%-16s %10s %10s %10s %10s %10s\n", "Phase (us)", "count", "mean", "p50", "p99", "max");
+	out << line;
+	for (int p = 0; p < PROFILE_NUM_PHASES; p++) {
+		const LatencyHistogram& h = phases[p];
+		std::snprintf(line, sizeof(line), "%-16s %10llu %10.1f %10.1f %10.1f %10.1f\n", PROFILE_PHASE_NAMES[p], (unsigned long long)h.count,
+			h.mean() / 1e3, h.percentile(50) / 1e3, h.percentile(99) / 1e3, h.max / 1e3);
+		out << line;
+	}
+	if (imbalance.count > 0) {
+		std::snprintf(line, sizeof(line), "Worker imbalance (slowest/mean chunk): p50 %.3f, p99 %.3f, max %.3f\n",
+			imbalance.percentile(50) / 1e3, imbalance.percentile(99) / 1e3, imbalance.max / 1e3);
+		out << line;
+	}
+	for (size_t w = 0; w < workerTotals.size(); w++) {
+		if (workerTicks[w] == 0) continue;
+		std::snprintf(line, sizeof(line), "Worker %zu: mean %.1fus over %llu ticks\n", w, workerTotals[w] / 1e3 / workerTicks[w], (unsigned long long)workerTicks[w]);
+		out << line;
+	}
+}
+
+void Profiler::reset() {
+	for (LatencyHistogram& h : phases) {
+		h.reset();
+	}
+	imbalance.reset();
+	std::fill(workerTotals.begin(), workerTotals.end(), 0);
+	std::fill(workerTicks.begin(), workerTicks.end(), 0);
+}
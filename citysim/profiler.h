@@ -0,0 +1,161 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "macros.h"
+#include "trace.h"
+
+// log-linear histogram of non-negative values (HDR style): values below 2^PROFILER_HISTOGRAM_BITS are counted exactly,
+// larger ones in buckets that keep PROFILER_HISTOGRAM_BITS significant bits (relative error below 2^-(PROFILER_HISTOGRAM_BITS-1))
+class LatencyHistogram {
+public:
+	static constexpr int SUB_BUCKETS = 1 << PROFILER_HISTOGRAM_BITS;
+	static constexpr int NUM_BUCKETS = SUB_BUCKETS + (64 - PROFILER_HISTOGRAM_BITS) * (SUB_BUCKETS / 2);
+
+	inline void record(uint64_t value) {
+		counts[bucket(value)]++;
+		count++;
+		sum += value;
+		if (value > max) max = value;
+	}
+	// adds every value recorded by other
+	void merge(const LatencyHistogram& other);
+	void reset();
+
+	// highest value of the bucket holding the pth percentile (0-100), never above max
+	uint64_t percentile(double p) const;
+	inline double mean() const {
+		return count > 0 ? double(sum) / count : 0;
+	}
+
+	uint64_t count = 0;
+	uint64_t sum = 0;
+	uint64_t max = 0;
+private:
+	std::array<uint64_t, NUM_BUCKETS> counts{};
+
+	static inline int bucket(uint64_t value) {
+		if (value < uint64_t(SUB_BUCKETS)) return int(value);
+		int msb = 63 - countLeadingZeros(value);
+		int shift = msb - PROFILER_HISTOGRAM_BITS + 1;
+		return SUB_BUCKETS + (shift - 1) * (SUB_BUCKETS / 2) + int(value >> shift) - SUB_BUCKETS / 2;
+	}
+	static uint64_t bucketHighest(int bucket);
+	static inline int countLeadingZeros(uint64_t value) {
+		#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_clzll(value);
+		#else
+		int n = 0;
+		while (!(value & (uint64_t(1) << 63))) {
+			value <<= 1;
+			n++;
+		}
+		return n;
+		#endif
+	}
+};
+
+// parts of a simulation tick timed by the profiler (PROFILE_TICK is the whole tick)
+enum ProfilePhase {
+	PROFILE_SPAWN_HANDOFF, // draining the spawn queue into the citizen vector
+	PROFILE_TRAIN_UPDATE, // spawning, moving (in parallel chunks) and applying stop events of trains
+	PROFILE_CHUNK_DISPATCH, // handing the citizen chunks to the worker pool
+	PROFILE_CITIZEN_WORKER, // one worker's citizen chunk (recorded once per worker and tick)
+	PROFILE_CITIZEN_WAIT, // from the last chunk handed out until every worker has finished
+	PROFILE_DESPAWN_MERGE, // removing the citizens every worker despawned
+	PROFILE_RENDER_SNAPSHOT, // copying the state for the renderer
+	PROFILE_TICK,
+	PROFILE_NUM_PHASES
+};
+
+extern const char* const PROFILE_PHASE_NAMES[PROFILE_NUM_PHASES];
+
+// wall time histograms (nanoseconds) of the phases of every tick, and how evenly citizen chunks were spread over workers
+// histograms are only written by the simulation thread, workers only write their own slot of workerNanos
+class Profiler {
+public:
+	// sizes the per-worker slots, must not run during a tick
+	void setWorkers(int workers);
+
+	inline void record(ProfilePhase phase, uint64_t nanos) {
+		phases[phase].record(nanos);
+	}
+	// a phase timed without a ProfileScope, also traced if tracer is set
+	inline void span(ProfilePhase phase, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+		#if PROFILER == true
+		record(phase, uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+		#endif
+		#if TRACE == true
+		if (tracer != nullptr) tracer->slice(PROFILE_PHASE_NAMES[phase], "tick", start, end);
+		#endif
+		#if PROFILER == false && TRACE == false
+		(void)phase;
+		(void)start;
+		(void)end;
+		#endif
+	}
+	// worker thread of chunk worker, recorded (with the imbalance) at endTick
+	inline void recordWorker(int worker, uint64_t nanos) {
+		workerNanos[worker] = nanos;
+	}
+	// records the chunk times of the workers that ran this tick (workers runs) and the tick's imbalance
+	void endTick(int workers);
+
+	// prints a table of every phase (count, mean, p50, p99, max in microseconds), the worker imbalance and each worker's mean
+	void report(std::ostream& out) const;
+	void reset();
+	inline size_t memoryBytes() const {
+		return sizeof(phases) + sizeof(imbalance) + (workerNanos.capacity() + workerTotals.capacity() + workerTicks.capacity()) * sizeof(uint64_t);
+	}
+
+	Tracer* tracer = nullptr; // phases are also traced as slices if set (and TRACE is)
+private:
+	LatencyHistogram phases[PROFILE_NUM_PHASES];
+	LatencyHistogram imbalance; // slowest worker's time / mean worker time, in thousandths
+	std::vector<uint64_t> workerNanos; // this tick, by worker
+	std::vector<uint64_t> workerTotals; // whole run, by worker
+	std::vector<uint64_t> workerTicks;
+};
+
+// times the scope it lives in and records it as phase (or as a worker's chunk) when it ends
+// compiles to nothing unless PROFILER or TRACE is set
+class ProfileScope {
+public:
+	inline ProfileScope(Profiler& p, ProfilePhase ph, int w = -1) {
+		#if PROFILER == true || TRACE == true
+		profiler = &p;
+		phase = ph;
+		worker = w;
+		start = std::chrono::steady_clock::now();
+		#else
+		(void)p;
+		(void)ph;
+		(void)w;
+		#endif
+	}
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+	inline ~ProfileScope() {
+		#if PROFILER == true || TRACE == true
+		auto end = std::chrono::steady_clock::now();
+		#endif
+		#if PROFILER == true
+		uint64_t nanos = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+		if (worker >= 0) profiler->recordWorker(worker, nanos);
+		else profiler->record(phase, nanos);
+		#endif
+		#if TRACE == true
+		if (profiler->tracer != nullptr) profiler->tracer->slice(PROFILE_PHASE_NAMES[phase], "tick", start, end);
+		#endif
+	}
+private:
+	#if PROFILER == true || TRACE == true
+	Profiler* profiler;
+	ProfilePhase phase;
+	int worker;
+	std::chrono::steady_clock::time_point start;
+	#endif
+};
@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "raster.h"
+
+Raster::Raster(int width, int height) : w(width), h(height), pixels(size_t(width) * height * 4, 255) {}
+
+void Raster::clear(sf::Color color) {
+	for (size_t i = 0; i < pixels.size(); i += 4) {
+		pixels[i] = color.r;
+		pixels[i + 1] = color.g;
+		pixels[i + 2] = color.b;
+		pixels[i + 3] = 255;
+	}
+}
+
+void Raster::copy(const Raster& other) {
+	std::memcpy(pixels.data(), other.pixels.data(), std::min(pixels.size(), other.pixels.size()));
+}
+
+void Raster::fillCircle(Vector2f center, float radius, sf::Color color) {
+	int x0 = std::max(0, int(std::floor(center.x - radius - 1)));
+	int x1 = std::min(w - 1, int(std::ceil(center.x + radius + 1)));
+	int y0 = std::max(0, int(std::floor(center.y - radius - 1)));
+	int y1 = std::min(h - 1, int(std::ceil(center.y + radius + 1)));
+	for (int y = y0; y <= y1; y++) {
+		float dy = y + 0.5f - center.y;
+		for (int x = x0; x <= x1; x++) {
+			float dx = x + 0.5f - center.x;
+			float coverage = radius + 0.5f - std::sqrt(dx * dx + dy * dy);
+			if (coverage > 0) blend(x, y, color, std::min(coverage, 1.0f));
+		}
+	}
+}
+
+void Raster::line(Vector2f a, Vector2f b, float width, sf::Color color) {
+	float half = width / 2;
+	int x0 = std::max(0, int(std::floor(std::min(a.x, b.x) - half - 1)));
+	int x1 = std::min(w - 1, int(std::ceil(std::max(a.x, b.x) + half + 1)));
+	int y0 = std::max(0, int(std::floor(std::min(a.y, b.y) - half - 1)));
+	int y1 = std::min(h - 1, int(std::ceil(std::max(a.y, b.y) + half + 1)));
+	Vector2f ab = b - a;
+	float lengthSquared = ab.x * ab.x + ab.y * ab.y;
+	for (int y = y0; y <= y1; y++) {
+		for (int x = x0; x <= x1; x++) {
+			// distance from the pixel center to the closest point of the segment
+			Vector2f ap = Vector2f(x + 0.5f, y + 0.5f) - a;
+			float t = lengthSquared > 0 ? std::max(0.0f, std::min(1.0f, (ap.x * ab.x + ap.y * ab.y) / lengthSquared)) : 0.0f;
+			Vector2f d = ap - ab * t;
+			float coverage = half + 0.5f - std::sqrt(d.x * d.x + d.y * d.y);
+			if (coverage > 0) blend(x, y, color, std::min(coverage, 1.0f));
+		}
+	}
+}
+
+// deflate (RFC 1951) bits are packed starting at the least significant bit
+class BitWriter {
+public:
+	std::vector<uint8_t>& out;
+	uint32_t bits = 0;
+	int count = 0;
+
+	explicit BitWriter(std::vector<uint8_t>& o) : out(o) {}
+
+	inline void put(uint32_t value, int n) {
+		bits |= value << count;
+		count += n;
+		while (count >= 8) {
+			out.push_back(uint8_t(bits));
+			bits >>= 8;
+			count -= 8;
+		}
+	}
+	// Huffman codes are stored most significant bit first
+	inline void putCode(uint32_t code, int n) {
+		uint32_t reversed = 0;
+		for (int i = 0; i < n; i++) {
+			reversed |= ((code >> i) & 1) << (n - 1 - i);
+		}
+		put(reversed, n);
+	}
+	inline void flush() {
+		if (count > 0) out.push_back(uint8_t(bits));
+		bits = 0;
+		count = 0;
+	}
+};
+
+static const int LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const int LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const int DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const int DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// fixed literal/length code of symbol (0-287)
+static void putSymbol(BitWriter& bits, int symbol) {
+	if (symbol < 144) bits.putCode(0x30 + symbol, 8);
+	else if (symbol < 256) bits.putCode(0x190 + symbol - 144, 9);
+	else if (symbol < 280) bits.putCode(symbol - 256, 7);
+	else bits.putCode(0xC0 + symbol - 280, 8);
+}
+
+static void putMatch(BitWriter& bits, int length, int distance) {
+	int l = 28;
+	while (LENGTH_BASE[l] > length) l--;
+	putSymbol(bits, 257 + l);
+	bits.put(length - LENGTH_BASE[l], LENGTH_EXTRA[l]);
+	int d = 29;
+	while (DISTANCE_BASE[d] > distance) d--;
+	bits.putCode(d, 5);
+	bits.put(distance - DISTANCE_BASE[d], DISTANCE_EXTRA[d]);
+}
+
+// one fixed Huffman block, matching only at the distances where images repeat (one pixel back and one row up)
+static void deflate(const std::vector<uint8_t>& in, int stride, std::vector<uint8_t>& out) {
+	BitWriter bits(out);
+	bits.put(1, 1); // final block
+	bits.put(1, 2); // fixed Huffman codes
+	const int distances[2] = { 4, stride };
+	size_t i = 0;
+	while (i < in.size()) {
+		int bestLength = 0;
+		int bestDistance = 0;
+		for (int distance : distances) {
+			if (distance > 32768 || size_t(distance) > i) continue;
+			int length = 0;
+			while (length < 258 && i + length < in.size() && in[i + length] == in[i + length - distance]) {
+				length++;
+			}
+			if (length > bestLength) {
+				bestLength = length;
+				bestDistance = distance;
+			}
+		}
+		if (bestLength >= 3) {
+			putMatch(bits, bestLength, bestDistance);
+			i += bestLength;
+		}
+		else {
+			putSymbol(bits, in[i]);
+			i++;
+		}
+	}
+	putSymbol(bits, 256);
+	bits.flush();
+}
+
+static uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+	static uint32_t table[256];
+	static bool tableReady = [] {
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+		return true;
+	}();
+	(void)tableReady;
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++) {
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static void putBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+	out.push_back(uint8_t(value >> 24));
+	out.push_back(uint8_t(value >> 16));
+	out.push_back(uint8_t(value >> 8));
+	out.push_back(uint8_t(value));
+}
+
+static void putChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+	putBigEndian(out, uint32_t(data.size()));
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data.begin(), data.end());
+	putBigEndian(out, crc32(&out[start], out.size() - start));
+}
+
+std::vector<uint8_t> encodePNG(const Raster& raster) {
+	int stride = raster.width() * 4 + 1;
+
+	// every row starts with filter type 0 (none)
+	std::vector<uint8_t> rows;
+	rows.reserve(size_t(stride) * raster.height());
+	for (int y = 0; y < raster.height(); y++) {
+		rows.push_back(0);
+		const uint8_t* row = raster.data() + size_t(y) * raster.width() * 4;
+		rows.insert(rows.end(), row, row + raster.width() * 4);
+	}
+
+	// zlib stream: header, deflate data, Adler-32 of the uncompressed rows
+	std::vector<uint8_t> idat = { 0x78, 0x01 };
+	deflate(rows, stride, idat);
+	uint32_t a = 1, b = 0;
+	for (uint8_t byte : rows) {
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	putBigEndian(idat, b << 16 | a);
+
+	std::vector<uint8_t> ihdr;
+	putBigEndian(ihdr, uint32_t(raster.width()));
+	putBigEndian(ihdr, uint32_t(raster.height()));
+	ihdr.insert(ihdr.end(), { 8, 6, 0, 0, 0 }); // 8 bit RGBA, deflate, adaptive filtering, no interlace
+
+	std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	putChunk(png, "IHDR", ihdr);
+	putChunk(png, "IDAT", idat);
+	putChunk(png, "IEND", {});
+	return png;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <SFML/Graphics.hpp>
+
+typedef sf::Vector2f Vector2f;
+
+// RGBA image drawn on the CPU, for rendering without a window or an OpenGL context (see headlessThread)
+// shapes are blended with one pixel of antialiasing along their edges
+class Raster {
+public:
+	Raster(int w, int h);
+
+	void clear(sf::Color color);
+	// copies another raster of the same size (e.g. a prerendered background)
+	void copy(const Raster& other);
+
+	void fillCircle(Vector2f center, float radius, sf::Color color);
+	// straight line of the given width with round ends
+	void line(Vector2f a, Vector2f b, float width, sf::Color color);
+
+	inline int width() const {
+		return w;
+	}
+	inline int height() const {
+		return h;
+	}
+	inline const uint8_t* data() const {
+		return pixels.data();
+	}
+	inline size_t size() const {
+		return pixels.size();
+	}
+private:
+	int w;
+	int h;
+	std::vector<uint8_t> pixels;
+
+	// blends color into pixel (x, y) with coverage in [0, 1]
+	inline void blend(int x, int y, sf::Color color, float coverage) {
+		uint8_t* p = &pixels[(size_t(y) * w + x) * 4];
+		float a = color.a / 255.0f * coverage;
+		p[0] = uint8_t(p[0] + (color.r - p[0]) * a);
+		p[1] = uint8_t(p[1] + (color.g - p[1]) * a);
+		p[2] = uint8_t(p[2] + (color.b - p[2]) * a);
+		p[3] = 255;
+	}
+};
+
+// PNG file (8 bit RGBA, deflate with fixed Huffman codes and runs matched against the previous pixel and the row above)
+std::vector<uint8_t> encodePNG(const Raster& raster);
@@ -0,0 +1,35 @@
+#include <algorithm>
+#include "sampler.h"
+
+bool AliasSampler::build(const std::vector<double>& weights) {
+	size_t n = weights.size();
+	table.assign(n, AliasEntry{ UINT32_MAX, 0 });
+	double total = 0;
+	for (double w : weights) total += w;
+	if (n == 0 || total <= 0) {
+		return false;
+	}
+
+	// scale so the average column holds exactly 1, then pair every underfull column with an overfull one
+	std::vector<double> scaled(n);
+	std::vector<int> small, large;
+	for (size_t i = 0; i < n; i++) {
+		scaled[i] = weights[i] * n / total;
+		table[i].alias = int(i);
+		(scaled[i] < 1.0 ? small : large).push_back(int(i));
+	}
+	while (!small.empty() && !large.empty()) {
+		int s = small.back(); small.pop_back();
+		int l = large.back(); large.pop_back();
+		// rounding can leave a column that was overfull slightly below 0, the conversion needs [0, 1)
+		double p = std::min(std::max(scaled[s], 0.0), 1.0 - 1.0 / 4294967296.0);
+		table[s].threshold = uint32_t(p * 4294967296.0);
+		table[s].alias = l;
+		scaled[l] -= 1.0 - scaled[s];
+		(scaled[l] < 1.0 ? small : large).push_back(l);
+	}
+	// leftovers are full columns (off by rounding error only)
+	for (int i : small) table[i].threshold = UINT32_MAX;
+	for (int i : large) table[i].threshold = UINT32_MAX;
+	return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// weighted random index selection in O(1) per sample (Vose's alias method), built in O(n)
+class AliasSampler {
+public:
+	// weights do not need to be normalized, returns false if they are all zero
+	bool build(const std::vector<double>& weights);
+
+	inline size_t size() {
+		return table.size();
+	}
+	inline size_t memoryBytes() const {
+		return table.capacity() * sizeof(AliasEntry);
+	}
+
+	// one 64 bit draw picks both the column (high bits) and the biased coin (low bits)
+	template<class RNG>
+	inline int sample(RNG& rng) {
+		uint64_t r = rng();
+		uint32_t column = uint32_t(((r >> 32) * table.size()) >> 32);
+		const AliasEntry& entry = table[column];
+		return uint32_t(r) < entry.threshold ? int(column) : entry.alias;
+	}
+private:
+	struct AliasEntry {
+		uint32_t threshold; // probability of keeping the column, scaled to 2^32
+		int alias;
+	};
+	std::vector<AliasEntry> table;
+};
@@ -11,105 +11,283 @@
 #include <set>
 #include <future>
 #include <random>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+#include <array>
 
 #include "macros.h"
 #include "line.h"
 #include "node.h"
 #include "pathcache.h"
 #include "train.h"
+#include "timetable.h"
 #include "citizen.h"
 #include "util.h"
-
-// weighted-random node selection
+#include "demand.h"
+#include "network.h"
+#include "graph.h"
+#include "generator.h"
+#include "checkpoint.h"
+#include "telemetry.h"
+#include "trajectory.h"
+#include "snapshot.h"
+#include "circles.h"
+#include "heatmap.h"
+#include "raster.h"
+#include "spatial.h"
+#include "bench.h"
+#include "microbench.h"
+#include "profiler.h"
+#include "trace.h"
+#include "footprint.h"
+#include "locks.h"
+#include "config.h"
+
+// run settings (macro defaults, overridden by CONFIG_FILE and key=value arguments)
+SimConfig config;
+
+// benchmarking (`citysim bench`, or every run if BENCHMARK_MODE): no rendering, stops after benchParams.warmup + benchParams.ticks
+bool benchMode;
+BenchmarkParams benchParams;
+
+// time-of-day origin-destination node selection
 unsigned int totalRidership;
-std::random_device rd;
-std::mt19937 gen(rd());
-std::uniform_int_distribution<int> dis;
+DemandModel demand;
+unsigned int rngSeed;
+std::mt19937_64 spawnRNG; // continuous spawning (pathfinding thread, or simulation thread if SIM_DETERMINISTIC), saved in checkpoints
 
 // simulation controls
 bool toggleSpawn;
-bool simPause;
+std::atomic<bool> simPause; // also read by spawners
 long unsigned int simTick;
+long unsigned int startTick; // simTick the run started (or was restored) at
+std::atomic<unsigned int> simTime; // time of day clock (ticks since midnight of the first day), drives the timetable and demand
 long unsigned int renderTick;
+bool headlessMode; // render to files without a window (`citysim headless`)
+long unsigned int headlessTicks; // ticks a headless run lasts (0 to run until killed)
 
 // statistics
-unsigned int handledCitizens;
+std::atomic<unsigned int> handledCitizens;
 std::vector<int> activeCitizensStat;
-std::vector<double> clockStat;
+std::vector<std::chrono::steady_clock::time_point> clockStat; // wall time every STAT_RATE ticks
 std::vector<int> simSpeedStat;
 extern int pathRequests;
 extern int pathCacheHits;
 extern int pathFails;
+Profiler profiler; // phase timings of every tick (if PROFILER)
+Tracer tracer; // timelines of every thread, written to TRACE_FILE on exit (if TRACE)
+MemoryTracker memory; // heap bytes per subsystem, sampled every STAT_RATE ticks
+Telemetry telemetry; // per-tick metrics streamed to TELEMETRY_FILE (if TELEMETRY)
+Trajectory trajectory; // citizen state transitions recorded to TRAJECTORY_FILE (if TRAJECTORY)
+Heatmap heatmap; // riders per track segment (if HEATMAP)
+
+// trajectory playback (`citysim replay`), the renderer draws the replay instead of the simulation
+bool replayMode;
+TrajectoryReplay replay;
 
-// node grid
-int NODE_GRID_ROW_SIZE;
-int NODE_GRID_COL_SIZE;
-std::vector<std::vector<std::vector<Node*>>> nodeGrid;
+// node index
+SpatialGrid nodeIndex; // node positions, for walking transfers and mouse picking
 
 // global arrays
 int VALID_LINES;
 int VALID_NODES;
-int VALID_TRAINS;
-Line lines[MAX_LINES];
-Node nodes[MAX_NODES];
-Train trains[MAX_TRAINS];
+std::vector<Line> lines; // sized from the input, must not reallocate after init
+std::vector<Node> nodes; // sized from the input, must not reallocate after init
+Graph graph;
+TrainStore trains;
+Timetable timetable;
 CitizenVector citizens(CITIIZEN_VEC_RESERVE, MAX_CITIZENS);
+SpawnQueue<Citizen> spawnQueue(SPAWN_QUEUE_SIZE); // routed citizens published by spawners, drained at the start of every tick
 
 // multithreading managers
-std::mutex trainsMutex; // locks trains array for drawing/simulating
-std::mutex pathsMutex; // pause helper
-std::mutex customCitizenSpawnMutex; // pause helper
-extern std::mutex blockStack; // see citizen.cpp
+InstrumentedMutex pathsMutex("pathsMutex"); // pause helper
+InstrumentedMutex customCitizenSpawnMutex("customCitizenSpawnMutex"); // pause helper
+extern InstrumentedMutex citizensMutex; // see citizen.cpp
+extern PathCache cache; // see node.cpp
 std::atomic<bool> customSpawnCitizens(false); // pause helper
 std::atomic<bool> justDidPathfinding(false); // pause helper
 std::atomic<bool> shouldExit(false); // global thread control
-std::condition_variable doPathfinding; // pauses pathfinding thread
-std::condition_variable doCustomCitizenSpawn; // pings pathfinding thread for custom citizen spawning
-std::condition_variable doSimulation; // pauses simulation thread
+std::atomic<bool> checkpointRequested(false); // saves CHECKPOINT_FILE at the end of the current tick
+InstrumentedCondition doPathfinding("doPathfinding"); // pauses pathfinding thread
+InstrumentedCondition doCustomCitizenSpawn("doCustomCitizenSpawn"); // pings pathfinding thread for custom citizen spawning
+InstrumentedCondition doSimulation("doSimulation"); // pauses simulation thread
+
+// what the renderer draws, published by the simulation thread between ticks (the renderer never reads simulation state directly)
+TripleBuffer<RenderSnapshot> snapshots;
 
 // misc
 Node* nearestNode;
 Line WALKING_LINE;
 
-// spawns spawnAmount citizens at random nodes (selection weighted by ridership)
-static void generateRandomCitizens(int spawnAmount) {
-	if (spawnAmount <= 0) return;
+// times demand sampling on every worker thread and compares the sampled origin frequencies to the band's demand
+static void benchmarkDemandSampler(int band) {
+	std::vector<std::vector<unsigned int>> counts(config.threads, std::vector<unsigned int>(VALID_NODES, 0));
+	std::vector<std::thread> threads;
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (int t = 0; t < config.threads; t++) {
+		threads.emplace_back([&counts, t](int band) {
+			std::mt19937_64 rng = util::rngStream(rngSeed, RNG_STREAM_BENCHMARK + t);
+			std::vector<unsigned int>& threadCounts = counts[t];
+			int origin, destination;
+			for (int i = 0; i < BENCHMARK_SAMPLER_SAMPLES; i++) {
+				if (demand.sample(band, rng, &origin, &destination)) threadCounts[origin]++;
+			}
+		}, band);
+	}
+	for (std::thread& thread : threads) thread.join();
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	// total variation distance between sampled and expected distributions
+	double totalSamples = double(BENCHMARK_SAMPLER_SAMPLES) * config.threads;
+	double error = 0;
+	double totalDemand = 0;
+	for (double w : demand.bands[band].originWeights) totalDemand += w;
+	for (int i = 0; i < VALID_NODES; i++) {
+		unsigned long long count = 0;
+		for (int t = 0; t < config.threads; t++) count += counts[t][i];
+		error += std::abs(count / totalSamples - demand.bands[band].originWeights[i] / totalDemand);
+	}
+	std::cout << "Demand sampler (" << DemandModel::bandName(band) << "): " << totalSamples / seconds / 1e6 << "M samples/s on " << config.threads << " threads, ";
+	std::cout << "total variation distance " << error / 2 << std::endl;
+}
 
+// routes a citizen from start to end and publishes it to spawnQueue
+// if the queue is full, waits for the simulation to drain it when waitIfFull is set and gives up otherwise
+static bool publishCitizen(Node* start, Node* end, bool waitIfFull) {
+	Citizen c = Citizen();
+	if (!c.spawn(start, end)) {
+		return false;
+	}
+	while (!spawnQueue.push(c)) {
+		if (!waitIfFull || shouldExit || simPause) return false;
+		std::this_thread::yield();
+	}
+	handledCitizens++;
+	return true;
+}
+
+// spawns spawnAmount citizens with origins and destinations drawn from the demand of the time band in effect at time
+// rng must only be used by the calling thread (see util::rngStream), returns the number of citizens published
+int generateRandomCitizens(int spawnAmount, unsigned int time, std::mt19937_64& rng, bool waitIfFull) {
+	if (spawnAmount <= 0) return 0;
+
+	int band = demand.bandAt(time);
 	int spawnedCount = 0;
 
 	while (spawnedCount < spawnAmount && !simPause) {
-		int startRidership = dis(gen);
-		int endRidership;
-		int startNode, startRidershipCount;
-		int endNode, endRidershipCount;
-		int i;
-		do {
-			i = 0;
-			startNode = 0; startRidershipCount = 0;
-			endNode = 0; endRidershipCount = 0;
-			endRidership = dis(gen);
-			while (startRidershipCount < startRidership || endRidershipCount < endRidership) {
-				if (startRidershipCount < startRidership) {
-					startRidershipCount += nodes[i].ridership;
-					startNode = i;
-				}
-				if (endRidershipCount < endRidership) {
-					endRidershipCount += nodes[i].ridership;
-					endNode = i;
-				}
-				i++;
-			}
-		} while (endNode == startNode);
+		int startNode, endNode;
+		if (!demand.sample(band, rng, &startNode, &endNode)) break;
 
-		if (citizens.add(&nodes[startNode], &nodes[endNode])) {
-			handledCitizens++;
+		if (publishCitizen(&nodes[startNode], &nodes[endNode], waitIfFull)) {
 			spawnedCount++;
 		}
+		else if (spawnQueue.size() >= spawnQueue.capacity()) {
+			break;
+		}
+	}
+	return spawnedCount;
+}
+
+// continuous spawning following the demand model (amounts scale with the time band's rate)
+static void spawnCitizens(bool waitIfFull) {
+	unsigned int time = simTime;
+
+	if (config.spawnMethod == 1) {
+		// spawn a constant amount of citizens config.spawnAmount
+		generateRandomCitizens(int(config.spawnAmount * demand.rateAt(time)), time, spawnRNG, waitIfFull);
+	}
+	else {
+		// spawn citizens up to a target amount config.agents (counting those not drained yet)
+		int target = int(config.agents * demand.rateAt(time)) - int(citizens.activeSize() + spawnQueue.size());
+		generateRandomCitizens(target, time, spawnRNG, waitIfFull);
+	}
+}
+
+// saves CHECKPOINT_FILE from the simulation thread between ticks
+static void checkpoint() {
+	// the pathfinding thread holds pathsMutex while spawning (and may be waiting for spawnQueue to drain)
+	std::unique_lock<InstrumentedMutex> pathsLock(pathsMutex, std::defer_lock);
+	while (!pathsLock.try_lock()) {
+		citizens.drain(spawnQueue);
+		std::this_thread::yield();
+	}
+	// citizens that were already published are saved as part of the simulation
+	citizens.drain(spawnQueue);
+	saveCheckpoint(CHECKPOINT_FILE);
+}
+
+// copies train positions and loads, node loads and counters into a snapshot for the renderer
+// only runs on the simulation thread (or before it starts)
+static void publishSnapshot() {
+	ProfileScope scope(profiler, PROFILE_RENDER_SNAPSHOT);
+	RenderSnapshot& snapshot = snapshots.back();
+	snapshot.tick = simTick;
+	snapshot.time = simTime;
+	snapshot.activeCitizens = citizens.activeSize();
+	snapshot.simSpeed = simSpeedStat.empty() ? 0 : simSpeedStat.back();
+
+	// finished trips are left out, their ids are reused by new trips
+	snapshot.trainPositions.clear();
+	snapshot.trainLoads.clear();
+	snapshot.trainColors.clear();
+	for (int t = 0; t < trains.size(); t++) {
+		if (trains.status[t] == STATUS_DESPAWNED) continue;
+		snapshot.trainPositions.push_back(trains.getPosition(t));
+		snapshot.trainLoads.push_back(trains.capacity[t] / float(config.trainCapacity));
+		snapshot.trainColors.push_back(trains.line[t]->color);
+	}
+
+	snapshot.nodeLoads.resize(VALID_NODES);
+	for (int i = 0; i < VALID_NODES; i++) {
+		snapshot.nodeLoads[i] = nodes[i].capacity;
+	}
+	#if HEATMAP == true
+	snapshot.segmentLoads = heatmap.loads;
+	#endif
+	snapshots.publish();
+}
+
+// counts the heap bytes held by every subsystem (see MemorySubsystem) and records them in memory
+// only runs on the simulation thread (or before it starts)
+static void sampleMemory() {
+	MemoryUsage usage;
+	usage.agents = citizens.activeSize();
+
+	size_t paths = citizens.capacity() * sizeof(Citizen::path);
+	usage.bytes[MEMORY_CITIZENS] = citizens.memoryBytes() - paths;
+	usage.bytes[MEMORY_CITIZEN_PATHS] = paths;
+	usage.bytes[MEMORY_SPAWN_QUEUE] = spawnQueue.memoryBytes();
+	usage.bytes[MEMORY_PATH_CACHE] = cache.memoryBytes();
+	usage.bytes[MEMORY_GRAPH] = graph.memoryBytes();
+
+	size_t network = util::vectorBytes(nodes) + util::vectorBytes(lines) + nodeIndex.memoryBytes();
+	for (Node& node : nodes) {
+		network += util::vectorBytes(node.platforms);
+		for (Platform& platform : node.platforms) {
+			network += util::vectorBytes(platform.trains);
+		}
 	}
+	for (Line& line : lines) {
+		network += util::vectorBytes(line.segments);
+		for (Segment& segment : line.segments) {
+			network += util::vectorBytes(segment.polyline.points) + util::vectorBytes(segment.polyline.arcLength);
+		}
+	}
+	usage.bytes[MEMORY_NETWORK] = network;
+	usage.bytes[MEMORY_TRAINS] = trains.memoryBytes() + timetable.memoryBytes();
+	usage.bytes[MEMORY_DEMAND] = demand.memoryBytes();
+	usage.bytes[MEMORY_RENDER] = snapshots.memoryBytes() + heatmap.memoryBytes();
+	usage.bytes[MEMORY_TELEMETRY] = telemetry.memoryBytes() + trajectory.memoryBytes() + profiler.memoryBytes() + tracer.memoryBytes();
+	memory.sample(usage);
 }
 
 // prints a bunch of stuff to the console on ; press
 static void debugReport() {
+	std::lock_guard<InstrumentedMutex> citizensLock(citizensMutex);
 	std::cout << "Report at tick " << simTick << ":" << std::endl;
 
 	// display problematic path steps, statuses of allocated citizens
@@ -199,12 +377,72 @@ static void debugReport() {
 	pathCacheHits = 0;
 	pathFails = 0;
 
-	// display memory information (citizen vector)
+	// display memory information (citizen vector, bytes per subsystem as of the last STAT_RATE tick)
 	std::cout << "Citizen vector size=" << citizens.size() << " active=" << citizens.activeSize() << " inactive=" << citizens.size() - citizens.activeSize() << " cap=" << citizens.capacity() << " max=" << citizens.max() << std::endl;
+	memory.report(std::cout);
+
+	std::cout << std::endl;
+}
 
+// prints the nodes where replayed citizens are stuck on ; press (replay counterpart of debugReport)
+static void replayReport() {
+	std::vector<unsigned int> waiting, stuck;
+	replay.countNodes(REPLAY_STUCK_TICKS, waiting, stuck);
+	std::cout << "Replay report at tick " << replay.tick() << ": " << replay.active << " active citizens" << std::endl;
+	bool actuallyStuck = false;
+	for (int i = 0; i < VALID_NODES; i++) {
+		if (stuck[i] > CITIZEN_STUCK_THRESH) {
+			if (!actuallyStuck) std::cout << "Citizens stuck for over " << REPLAY_STUCK_TICKS << " ticks at: " << std::endl;
+			actuallyStuck = true;
+			std::cout << nodes[i].id << " (" << stuck[i] << " stuck, " << waiting[i] << " waiting)\n";
+		}
+	}
 	std::cout << std::endl;
 }
 
+#if PLATFORM_STRESS_TEST == true
+// checks that every dwelling train sits on exactly its own platform, in arrival order, and prints platform occupancy
+static void checkPlatforms() {
+	static int maxPlatformTrains = 0;
+	static int maxNodeTrains = 0;
+	static Node* busiestNode = nullptr;
+	int errors = 0;
+
+	for (int t = 0; t < trains.size(); t++) {
+		if (trains.status[t] != STATUS_AT_STOP) continue;
+		Platform& platform = trains.getLastStop(t)->platforms[trains.line[t]->platformIndex(trains.index[t], trains.statusForward[t])];
+		if (std::count(platform.trains.begin(), platform.trains.end(), t) != 1) {
+			std::cout << "ERR: [" << trains.line[t]->id << "] train " << t << " missing from platform at " << trains.getLastStop(t)->id << std::endl;
+			errors++;
+		}
+	}
+
+	for (int i = 0; i < VALID_NODES; i++) {
+		for (Platform& platform : nodes[i].platforms) {
+			unsigned int lastArrival = 0;
+			for (int t : platform.trains) {
+				TimetableRoute& route = timetable.routes[trains.route[t]];
+				unsigned int arrival = trains.start[t] + route.arriveOffset[route.pathIndex(trains.index[t])];
+				if (trains.status[t] != STATUS_AT_STOP || trains.getLastStop(t) != &nodes[i] || trains.line[t] != platform.line || trains.statusForward[t] != platform.direction || arrival < lastArrival) {
+					std::cout << "ERR: platform [" << platform.line->id << "] at " << nodes[i].id << " holds misplaced train " << t << std::endl;
+					errors++;
+				}
+				lastArrival = arrival;
+			}
+			maxPlatformTrains = std::max(maxPlatformTrains, int(platform.trains.size()));
+		}
+		if (nodes[i].numTrains() > maxNodeTrains) {
+			maxNodeTrains = nodes[i].numTrains();
+			busiestNode = &nodes[i];
+		}
+	}
+
+	std::cout << "Platform check at tick " << simTick << ": " << trains.activeSize() << " trains, " << errors << " errors, max " << maxPlatformTrains << " trains/platform, max " << maxNodeTrains << " trains/node";
+	if (busiestNode != nullptr) std::cout << " (" << busiestNode->id << ")";
+	std::cout << std::endl;
+}
+#endif
+
 // utility class to manage threads used for updating citizens every simulation tick
 class CitizenThreadPool {
 public:
@@ -212,14 +450,14 @@ public:
 	CitizenThreadPool(size_t numThreads) {
 		stop = false;
 		for (size_t i = 0; i < numThreads; ++i) {
-			workers.emplace_back([this] { workerThread(); });
+			workers.emplace_back([this, i] { workerThread(int(i)); });
 		}
 	}
 
 	// kills all worker threads
 	~CitizenThreadPool() {
 		{
-			std::unique_lock<std::mutex> threadPoolQueueLock(threadPoolQueueMutex);
+			std::unique_lock<InstrumentedMutex> threadPoolQueueLock(threadPoolQueueMutex);
 			stop = true;
 		}
 		citizenThreadCV.notify_all();
@@ -232,7 +470,7 @@ public:
 	template<class F>
 	void enqueue(F&& f) {
 		{
-			std::unique_lock<std::mutex> threadPoolQueueLock(threadPoolQueueMutex);
+			std::unique_lock<InstrumentedMutex> threadPoolQueueLock(threadPoolQueueMutex);
 			tasks.emplace(std::forward<F>(f));
 		}
 		citizenThreadCV.notify_one();
@@ -240,50 +478,58 @@ public:
 
 	// waits until a worker has finished its tasks
 	void waitForCompletion() {
-		std::unique_lock<std::mutex> threadPoolQueueLock(threadPoolQueueMutex);
+		std::unique_lock<InstrumentedMutex> threadPoolQueueLock(threadPoolQueueMutex);
 		citizenThreadDoneCV.wait(threadPoolQueueLock, [this] { return tasks.empty() && activeThreads == 0; });
 	}
 private:
 	std::vector<std::thread> workers;
 	std::queue<std::function<void()>> tasks;
-	std::mutex threadPoolQueueMutex;
-	std::condition_variable citizenThreadCV; // start task
-	std::condition_variable citizenThreadDoneCV; // complete task
+	InstrumentedMutex threadPoolQueueMutex{ "threadPoolQueueMutex" };
+	InstrumentedCondition citizenThreadCV{ "citizenThreadCV" }; // start task
+	InstrumentedCondition citizenThreadDoneCV{ "citizenThreadDoneCV" }; // complete task
 	std::atomic<bool> stop; // used to kill all threads on thread pool close
 	std::atomic<int> activeThreads{ 0 };
 
 	// worker executes functions in the function queue
-	void workerThread() {
-		while (!shouldExit) {
+	void workerThread(int index) {
+		#if TRACE == true
+		tracer.nameThread("worker " + std::to_string(index));
+		#else
+		(void)index;
+		#endif
+		// only exits through stop, leaving on shouldExit could strand tasks that waitForCompletion is waiting on
+		while (true) {
 			std::function<void()> task;
 			{
-				std::unique_lock<std::mutex> threadPoolQueueLock(threadPoolQueueMutex);
+				std::unique_lock<InstrumentedMutex> threadPoolQueueLock(threadPoolQueueMutex);
 				citizenThreadCV.wait(threadPoolQueueLock, [this] { return stop || !tasks.empty(); });
 				if (stop && tasks.empty()) {
 					return;
 				}
 				task = std::move(tasks.front());
 				tasks.pop();
+				activeThreads++; // counted before the lock is released so waitForCompletion can't miss a running task
 			}
-			activeThreads++;
 			task();
-			activeThreads--;
-			if (tasks.empty() && activeThreads == 0) {
-				citizenThreadDoneCV.notify_one();
+			{
+				std::unique_lock<InstrumentedMutex> threadPoolQueueLock(threadPoolQueueMutex);
+				activeThreads--;
+				if (tasks.empty() && activeThreads == 0) {
+					citizenThreadDoneCV.notify_one();
+				}
 			}
 		}
 	}
 };
 
 // initializes simulation variables
-int init() {
-	// utility arrays for node position normalization
-	float* nodesX = new float[MAX_NODES];
-	float* nodesY = new float[MAX_NODES];
-
+// parses the CSVs and builds nodes, lines, their neighbors and track geometry and the node index
+// (loadNetwork reads the same from a compiled image)
+static int readNetwork() {
 	// read files
 	int row = 0;
 	std::string fileLine;
+	std::vector<std::vector<uint32_t>> lineStops; // node indices, resolved once nodes are read
 
 	// parse [id, color, {path}] to generate lines
 	std::ifstream linesCSV("lines_stations.csv");
@@ -294,10 +540,13 @@ int init() {
 
 	std::cout << "Reading lines_stations.csv" << std::endl;
 
+	lines.clear();
 	while (std::getline(linesCSV, fileLine)) {
 		std::stringstream lineStream(fileLine);
 		std::string cell;
-		Line& line = lines[row];
+		lines.emplace_back();
+		lineStops.emplace_back();
+		Line& line = lines.back();
 
 		int col = 0;
 		while (std::getline(lineStream, cell, ',')) {
@@ -308,8 +557,8 @@ int init() {
 				// color (type sf::Color)
 				util::colorConvert(&line.color, cell);
 			} else {
-				// add Node ref to path (before Node initialization)
-				line.path[col - 2] = &nodes[std::stoi(cell)];
+				// add node index to path (before Node initialization)
+				lineStops.back().push_back(std::stoi(cell));
 			}
 			col++;
 		}
@@ -328,11 +577,20 @@ int init() {
 
 	std::cout << "Reading stations_data.csv" << std::endl;
 
+	// utility arrays for node position normalization
+	std::vector<float> nodesX;
+	std::vector<float> nodesY;
+
 	row = 0;
+	nodes.clear();
 	while (std::getline(stationsCSV, fileLine)) {
 		std::stringstream lineStream(fileLine);
 		std::string cell;
-		Node& node = nodes[row];
+		nodes.emplace_back();
+		nodesX.push_back(0);
+		nodesY.push_back(0);
+		Node& node = nodes.back();
+		node.index = row;
 		node.status = STATUS_SPAWNED;
 
 		int col = 0;
@@ -367,10 +625,6 @@ int init() {
 
 	VALID_NODES = row;
 	std::cout << "Processed " << VALID_NODES << " nodes (stations)" << std::endl;
-	std::cout << "Total system ridership: " << totalRidership << std::endl;
-
-	// update randint generator for citizen generation
-	dis.param(std::uniform_int_distribution<int>::param_type(0, totalRidership));
 
 	// normalize node position data to screen boundaries
 	float minNodeX = nodesX[0]; float maxNodeX = nodesX[0];
@@ -379,128 +633,192 @@ int init() {
 		if (nodesX[i] < minNodeX) minNodeX = nodesX[i];
 		if (nodesX[i] > maxNodeX) maxNodeX = nodesX[i];
 		if (nodesY[i] < minNodeY) minNodeY = nodesY[i];
-		if (nodesY[i] > minNodeY) maxNodeY = nodesY[i];
+		if (nodesY[i] > maxNodeY) maxNodeY = nodesY[i];
 	}
 	float minMaxDiffX = maxNodeX - minNodeX;
 	float minMaxDiffY = maxNodeY - minNodeY;
+	// also used for track geometry, which shares the stations' coordinate space
+	auto normalize = [=](float x, float y) {
+		return Vector2f(
+			WINDOW_X_OFFSET + WINDOW_SCALE * WINDOW_X_SCALE * WINDOW_WIDTH * (x - minNodeX) / minMaxDiffX,
+			WINDOW_Y_OFFSET + WINDOW_HEIGHT - WINDOW_SCALE * WINDOW_Y_SCALE * WINDOW_HEIGHT * (y - minNodeY) / minMaxDiffY
+		);
+	};
 	for (int i = 0; i < VALID_NODES; i++) {
-		nodes[i].setPosition(Vector2f(
-			WINDOW_X_OFFSET + WINDOW_SCALE * WINDOW_X_SCALE * WINDOW_WIDTH * (nodesX[i] - minNodeX) / minMaxDiffX,
-			WINDOW_Y_OFFSET + WINDOW_HEIGHT - WINDOW_SCALE * WINDOW_Y_SCALE * WINDOW_HEIGHT * (nodesY[i] - minNodeY) / minMaxDiffY
-		));
+		nodes[i].setPosition(normalize(nodesX[i], nodesY[i]));
 	}
 
 	std::cout << "Normalized node positions" << std::endl;
 
-	// place nodes onto grid to normalize neighborly calculations (can reduce comparisons to only nodes in adjacent grid squares)
-	NODE_GRID_ROW_SIZE = WINDOW_WIDTH / NODE_GRID_ROWS;
-	NODE_GRID_COL_SIZE = WINDOW_HEIGHT / NODE_GRID_COLS;
-	for (int i = 0; i < NODE_GRID_ROWS; i++) {
-		std::vector<std::vector<Node*>> row;
-		for (int j = 0; j < NODE_GRID_COLS; j++) {
-			std::vector<Node*> cell;
-			for (int k = 0; k < VALID_NODES; k++) {
-				Vector2f p = nodes[k].getPosition();
-				if (p.x >= i * NODE_GRID_ROW_SIZE && p.x < (i + 1) * NODE_GRID_ROW_SIZE && p.y >= j * NODE_GRID_COL_SIZE && p.y < (j + 1) * NODE_GRID_COL_SIZE) {
-					cell.push_back(&nodes[k]);
-					nodes[k].setGridPos(i, j);
-				}
-			}
-			cell.shrink_to_fit();
-			row.push_back(cell);
-		}
-		row.shrink_to_fit();
-		nodeGrid.push_back(row);
+	// index node positions for neighborly calculations
+	std::vector<Vector2f> positions(VALID_NODES);
+	for (int i = 0; i < VALID_NODES; i++) {
+		positions[i] = nodes[i].getPosition();
 	}
-	nodeGrid.shrink_to_fit();
+	nodeIndex.build(positions);
 
-	std::cout << "Generated node grid" << std::endl;
+	std::cout << "Generated node index (" << nodeIndex.numCells() << " cells)" << std::endl;
 
-	// add node walking transfer neighbors (all nodes within TRANSFER_MAX_DIST units)
-	WALKING_LINE = Line();
-	WALKING_LINE.color = sf::Color::Black;
-	std::strcpy(WALKING_LINE.id, WALK_LINE_ID_STR);
+	// collect edges, then pack them into the graph's CSR arrays
+	std::vector<GraphEdge> edges;
 
+	// add node walking transfer neighbors (all nodes within TRANSFER_MAX_DIST units)
 	int transferNeighbors = 0;
+	std::vector<uint32_t> neighbors;
 	for (int n = 0; n < VALID_NODES; n++) {
 		Node& node = nodes[n];
-		// uses the node grid to optimize calculations: may result in issues with high TRANSFER_MAX_DIST and high NODE_GRID_ROWS/COLS
-		for (int i = node.lowerGridX(); i <= node.upperGridX(); i++) {
-			for (int j = node.lowerGridY(); j <= node.upperGridY(); j++) {
-				for (Node* other : nodeGrid[i][j]) {
-					float dist = node.dist(other);
-					if (dist < TRANSFER_MAX_DIST) {
-						dist *= DISTANCE_SCALE * TRANSFER_PENALTY_MULTIPLIER;
-						node.addNeighbor({ other, &WALKING_LINE }, dist);
-						other->addNeighbor({ &node, &WALKING_LINE }, dist);
-						transferNeighbors++;
-					}
-				}
-			}
+		neighbors.clear();
+		nodeIndex.radius(node.getPosition(), TRANSFER_MAX_DIST, neighbors);
+		// sorted so the graph's edge order does not depend on the index layout
+		std::sort(neighbors.begin(), neighbors.end());
+		for (uint32_t o : neighbors) {
+			Node* other = &nodes[o];
+			if (other == &node) continue;
+			float dist = node.dist(other) * DISTANCE_SCALE * TRANSFER_PENALTY_MULTIPLIER;
+			edges.push_back({ uint32_t(node.index), uint32_t(other->index), GRAPH_WALKING_LINE, dist });
+			edges.push_back({ uint32_t(other->index), uint32_t(node.index), GRAPH_WALKING_LINE, dist });
+			transferNeighbors++;
 		}
 	}
 
 	std::cout << "Generated " << transferNeighbors << " walking transfer neighbors" << std::endl;
 
-	// various preprocessing steps, generate train objects
+	// lay out line paths (cut off at the first stop that is not a known node)
+	for (std::vector<uint32_t>& stops : lineStops) {
+		size_t j = 0;
+		while (j < stops.size() && stops[j] < uint32_t(VALID_NODES)) {
+			j++;
+		}
+		stops.resize(j);
+	}
+	graph.bind(nodes.data(), lines.data(), &WALKING_LINE);
+	graph.buildLines(lines.data(), VALID_LINES, lineStops);
+
+	// load track geometry between adjacent stops (straight lines if there is none)
+	loadGeometry("geometry.csv", lines.data(), VALID_LINES, normalize);
+
+	// various preprocessing steps
 	int lineNeighbors = 0;
 
 	for (int i = 0; i < VALID_LINES; i++) {
 		int j = 0;
 		Line& line = lines[i];
 
-		// add line neighbors (adjacent nodes along line)
-		// update node colors for each line
-		while (j < LINE_PATH_SIZE && line.path[j] != nullptr && line.path[j]->status == STATUS_SPAWNED) {
+		// add line neighbors (adjacent nodes along line, weighted by track length)
+		while (j < line.size) {
 			if (j > 0) {
-				float dist = line.path[j]->dist(line.path[j - 1]) * DISTANCE_SCALE;
+				float dist = line.segments[j - 1].polyline.length() * DISTANCE_SCALE;
 				line.dist[j - 1] = dist;
-				struct PathWrapper one = { line.path[j], &line };
-				struct PathWrapper two = { line.path[j - 1], &line };
-				line.path[j]->addNeighbor(two, dist);
-				line.path[j - 1]->addNeighbor(one, dist);
+				edges.push_back({ uint32_t(line.path[j]->index), uint32_t(line.path[j - 1]->index), int32_t(i), dist });
+				edges.push_back({ uint32_t(line.path[j - 1]->index), uint32_t(line.path[j]->index), int32_t(i), dist });
 				lineNeighbors++;
 			}
-			line.path[j]->setFillColor(line.color);
 			j++;
 		}
 
 		// generate distances between nodes on each line
-		line.dist[j - 1] = line.dist[j - 2];
-
-		// update line size (length)
-		line.size = j;
-
-		// generate train objects
-		std::string idStr = line.id;
-		int spacing = idStr.find("A_") == std::string::npos ? DEFAULT_TRAIN_STOP_SPACING / 2 : DEFAULT_TRAIN_STOP_SPACING; // avoid excessive generation for the A train
-		for (int k = 0; k < j; k+= DEFAULT_TRAIN_STOP_SPACING) {
-			// generate 2 trains (one going backward, one forward) except if at first/last stop
-			int repeat = (k == 0 || k == j - 1) ? 1 : 2;
-			for (int l = 0; l < repeat; l++) {
-				Train& train = trains[VALID_TRAINS++];
-				train.setPosition(line.path[k]->getPosition());
-				train.line = &line;
-				train.index = k;
-				train.status = STATUS_TRANSFER;
-				train.statusForward = (l == 1) ? STATUS_BACKWARD : (k == j - 1) ? STATUS_BACKWARD : STATUS_FORWARD;
-				train.setFillColor(line.color);
-			}
+		if (j >= 2) {
+			line.dist[j - 1] = line.dist[j - 2];
 		}
 	}
-	std::cout << "Generated " << VALID_TRAINS << " trains" << std::endl;
 	std::cout << "Generated " << lineNeighbors << " line neighbors" << std::endl;
-	std::cout << "Total neighbors: " << transferNeighbors + lineNeighbors << std::endl;
+	graph.build(VALID_NODES, edges);
+	std::cout << "Total neighbors: " << transferNeighbors + lineNeighbors << " (" << graph.numEdges << " edges)" << std::endl;
+
+	return AOK;
+}
+
+// loads the network (and its platforms), all that replays need
+static int initNetwork() {
+	WALKING_LINE = Line();
+	WALKING_LINE.color = sf::Color::Black;
+	std::strcpy(WALKING_LINE.id, WALK_LINE_ID_STR);
+
+	// load the compiled network image if there is an up to date one, parse the CSVs otherwise
+	#if NETWORK_IMAGE_LOAD == true
+	int networkStatus = loadNetwork(config.network.empty() ? NETWORK_IMAGE_FILE : config.network);
+	if (networkStatus != AOK && config.network.empty()) {
+		std::cout << "Reading CSVs instead (run `citysim compile` to build an image)" << std::endl;
+		networkStatus = readNetwork();
+	}
+	#else
+	int networkStatus = config.network.empty() ? readNetwork() : loadNetwork(config.network);
+	#endif
+	if (networkStatus != AOK) {
+		return networkStatus;
+	}
+	std::cout << "Total system ridership: " << totalRidership << std::endl;
+
+	#if SPATIAL_INDEX_CHECK == true
+	std::vector<Vector2f> positions(VALID_NODES);
+	for (int i = 0; i < VALID_NODES; i++) {
+		positions[i] = nodes[i].getPosition();
+	}
+	int mismatches = nodeIndex.check(positions, TRANSFER_MAX_DIST, SPATIAL_CHECK_QUERIES, RNG_SEED);
+	if (mismatches > 0) {
+		std::cout << "ERR: node index disagrees with a linear scan on " << mismatches << " queries" << std::endl;
+	}
+	else {
+		std::cout << "Node index matches a linear scan (" << VALID_NODES << " radius, " << SPATIAL_CHECK_QUERIES << " nearest queries)" << std::endl;
+	}
+	#endif
+
+	// add platforms for each line
+	// update node colors for each line
+	for (int i = 0; i < VALID_LINES; i++) {
+		Line& line = lines[i];
+		for (int j = 0; j < line.size; j++) {
+			line.platform[j] = line.path[j]->addPlatforms(&line);
+			line.path[j]->setFillColor(line.color);
+		}
+	}
+	return AOK;
+}
+
+int init() {
+	int networkStatus = initNetwork();
+	if (networkStatus != AOK) {
+		return networkStatus;
+	}
+
+	rngSeed = config.seed ? config.seed : std::random_device()();
+	std::cout << "Random seed: " << rngSeed << std::endl;
+	spawnRNG = util::rngStream(rngSeed, RNG_STREAM_PATHFINDING);
+
+	#if HEATMAP == true
+	heatmap.build(lines.data(), VALID_LINES);
+	#endif
+
+	// compile timetable (needs line sizes and distances for default run times)
+	timetable.load("timetable.csv", lines.data(), VALID_LINES);
+
+	// compile demand (needs node positions)
+	demand.load("od_matrix.csv", nodes.data(), VALID_NODES, nodeIndex);
+
+	// start every trip that is already underway at SIM_START_TIME
+	simTime = SIM_START_TIME;
+	trains.reserve(TRAIN_VEC_RESERVE);
+	trains.spawn(simTime);
+	std::cout << "Generated " << trains.activeSize() << " trains" << std::endl;
 
 	// enable continuous citizen spawning by default (necessary to generate initial citizen batch)
 	toggleSpawn = true;
 
 	// generate initial batch of citizens
-	generateRandomCitizens(CITIZEN_SPAWN_INIT);
-	std::cout << "Generated " << CITIZEN_SPAWN_INIT << " initial citizens" << std::endl;
-
-	delete[] nodesX;
-	delete[] nodesY;
+	if (benchMode) {
+		benchmarkDemandSampler(demand.bandAt(simTime));
+	}
+	std::mt19937_64 initRNG = util::rngStream(rngSeed, RNG_STREAM_INIT);
+	// (the simulation is not draining spawnQueue yet, so fill and drain it in batches)
+	int initialCitizens = int(config.initialAgents * demand.rateAt(simTime));
+	int generated = 0;
+	while (generated < initialCitizens) {
+		int batch = generateRandomCitizens(std::min(initialCitizens - generated, SPAWN_QUEUE_SIZE), simTime, initRNG, false);
+		citizens.drain(spawnQueue);
+		if (batch == 0) break;
+		generated += batch;
+	}
+	std::cout << "Generated " << generated << " initial citizens" << std::endl;
 
 	std::cout << "INIT DONE!" << std::endl << std::endl;
 	return AOK;
@@ -513,6 +831,9 @@ void renderingThread() {
 	sf::RenderWindow window(sf::VideoMode(WINDOW_WIDTH, WINDOW_HEIGHT), "CitySim", sf::Style::Titlebar | sf::Style::Close, settings);
 	window.setFramerateLimit(TARGET_FPS);
 	window.requestFocus();
+	#if TRACE == true
+	tracer.nameThread("rendering");
+	#endif
 
 	// white background
 	sf::RectangleShape bg(Vector2f(WINDOW_WIDTH * ZOOM_MIN * 2, WINDOW_HEIGHT * ZOOM_MIN * 2));
@@ -539,20 +860,17 @@ void renderingThread() {
 	bool drawTrains = true;
 
 	// generate vertex buffer for line (path) shapes
-	// copy line data to 1 dimensional vertex vector
+	// copy track geometry to 1 dimensional vertex vector
 	std::vector<sf::Vertex> lineVertices;
-	lineVertices.reserve(VALID_NODES);
+	lineVertices.reserve(VALID_NODES * 2);
 	for (int i = 0; i < VALID_LINES; i++) {
-		int j = 0;
-		while (lines[i].path[j] != nullptr && lines[i].path[j]->status == STATUS_SPAWNED) {
-			sf::Vector2f position = lines[i].path[j]->getPosition();
-			sf::Color color = lines[i].path[j]->getFillColor();
-
-			if (j != 0) lineVertices.push_back(sf::Vertex(position, color));
-			lineVertices.push_back(sf::Vertex(position, color));
-			j++;
+		for (Segment& segment : lines[i].segments) {
+			std::vector<Vector2f>& points = segment.polyline.points;
+			for (size_t j = 1; j < points.size(); j++) {
+				lineVertices.push_back(sf::Vertex(points[j - 1], lines[i].color));
+				lineVertices.push_back(sf::Vertex(points[j], lines[i].color));
+			}
 		}
-		if (!lineVertices.empty()) lineVertices.pop_back();
 	}
 
 	// copy vector data to buffer and clear leftovers
@@ -562,15 +880,43 @@ void renderingThread() {
 	lineVertices.clear();
 	lineVertices.shrink_to_fit();
 
-	// initialize vertex array for nodes, trains
-	// not sure if I should be using a VertexBuffer for these
-	sf::VertexArray nodeVertices(sf::Triangles);
-	sf::VertexArray trainVertices(sf::Triangles);
-	nodeVertices.resize(VALID_NODES * NODE_N_POINTS * 3);
-	trainVertices.resize(VALID_TRAINS * TRAIN_N_POINTS * 3);
+	// nodes and trains are drawn as circle batches (one circle per node/train, only changed ones are re-uploaded)
+	CircleBatch nodeCircles(NODE_N_POINTS);
+	CircleBatch trainCircles(TRAIN_N_POINTS);
+	nodeCircles.resize(VALID_NODES);
+
+	#if HEATMAP == true
+	// crowding overlay: a band along the track of every segment and a disc around every station,
+	// colored from loads smoothed over frames (recoloring only, the geometry is built once)
+	bool drawHeatmap = true;
+	std::vector<sf::Vertex> heatVertices;
+	std::vector<size_t> heatSegmentStart; // first vertex of every segment, then the total
+	for (int i = 0; i < VALID_LINES; i++) {
+		for (Segment& segment : lines[i].segments) {
+			heatSegmentStart.push_back(heatVertices.size());
+			std::vector<Vector2f>& points = segment.polyline.points;
+			for (size_t j = 1; j < points.size(); j++) {
+				Vector2f along = points[j] - points[j - 1];
+				float length = std::sqrt(along.x * along.x + along.y * along.y);
+				if (length == 0) continue;
+				Vector2f side = Vector2f(-along.y, along.x) * (HEATMAP_WIDTH / 2 / length);
+				Vector2f quad[6] = { points[j - 1] - side, points[j - 1] + side, points[j] + side, points[j - 1] - side, points[j] + side, points[j] - side };
+				for (Vector2f& corner : quad) {
+					heatVertices.push_back(sf::Vertex(corner, sf::Color::Transparent));
+				}
+			}
+		}
+	}
+	heatSegmentStart.push_back(heatVertices.size());
+	sf::VertexBuffer heatVertexBuffer(sf::Triangles, sf::VertexBuffer::Usage::Stream);
+	heatVertexBuffer.create(heatVertices.size());
+	std::vector<float> segmentHeat(heatmap.size(), 0.0f);
+	std::vector<float> nodeHeat(VALID_NODES, 0.0f);
+	CircleBatch nodeHeatCircles(NODE_N_POINTS);
+	nodeHeatCircles.resize(VALID_NODES);
+	#endif
 
-	// used to properly render node/train sizes
-	float TRAIN_CAPACITY_FLOAT = float(TRAIN_CAPACITY);
+	// used to properly render node sizes
 	float NODE_CAPACITY_FLOAT = float(NODE_CAPACITY);
 
 	// handlers to draw custom user paths
@@ -583,42 +929,30 @@ void renderingThread() {
 	sf::Color firstColor;
 	sf::Color secondColor;
 
-	// prevent out of bounds access
-	simSpeedStat.push_back(0);
-	clockStat.push_back(1);
-	clockStat.push_back(2);
-
 	// default render text
 	Node NEARBY_NODE = Node();
 	strcpy(NEARBY_NODE.id, "No nearby station");
 
+	// replay controls and per node counts of the replayed citizens (replayMode only)
+	double replayPosition = double(replay.firstTick());
+	double replaySpeed = REPLAY_SPEED;
+	bool replayPaused = false;
+	std::vector<unsigned int> replayWaiting;
+	std::vector<unsigned int> replayStuck;
+
 	while (window.isOpen() && !shouldExit) {
+		TraceScope frameScope(tracer, "frame", "render");
 		renderTick++;
 
 		// fps limiter
 		sf::Time frameStart = clock.getElapsedTime();
 
-		// get nearest node (uses node grid)
-		float minDist = FLT_MAX;
-		nearestNode = &NEARBY_NODE;
+		// get nearest node (uses node index)
 		// calculate relative mouse position (in terms of window units, scaled to zoom + pan)
 		Vector2f relMousePos = Vector2f(sf::Mouse::getPosition(window)) + view.getCenter() - Vector2f(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2);
 		relMousePos = view.getCenter() + (relMousePos - view.getCenter()) * simZoom;
-		int mx = std::max(std::min((int) relMousePos.x / NODE_GRID_ROW_SIZE, NODE_GRID_ROWS - 1), 0);
-		int my = std::max(std::min((int) relMousePos.y / NODE_GRID_COL_SIZE, NODE_GRID_COLS - 1), 0);
-		int mouseXLower = mx > 0 ? mx - 1 : mx; int mouseXUpper = mx < NODE_GRID_ROWS - 1 ? mx + 1 : mx;
-		int mouseYLower = my > 0 ? my - 1 : my; int mouseYUpper = my < NODE_GRID_COLS - 1 ? my + 1 : my;
-		for (int i = mouseXLower; i <= mouseXUpper; i++) {
-			for (int j = mouseYLower; j <= mouseYUpper; j++) {
-				for (Node* node : nodeGrid[i][j]) {
-					float dist = node->dist(relMousePos.x, relMousePos.y);
-					if (dist < minDist) {
-						minDist = dist;
-						nearestNode = node;
-					}
-				}
-			}
-		}
+		uint32_t nearestIndex = nodeIndex.nearest(relMousePos, NODE_PICK_DIST);
+		nearestNode = nearestIndex == SPATIAL_NONE ? &NEARBY_NODE : &nodes[nearestIndex];
 
 		// handle window events
 		sf::Event event;
@@ -739,15 +1073,50 @@ void renderingThread() {
 				if (event.key.code == sf::Keyboard::Num3) {
 					drawTrains = !drawTrains;
 				}
-				// press p to toggle simulation pause
+				#if HEATMAP == true
+				// press 4 to toggle the crowding overlay
+				if (event.key.code == sf::Keyboard::Num4) {
+					drawHeatmap = !drawHeatmap;
+				}
+				#endif
+				// press p to toggle simulation (or replay) pause
 				if (event.key.code == sf::Keyboard::P) {
+					if (replayMode) {
+						replayPaused = !replayPaused;
+						continue;
+					}
 					simPause = !simPause;
 					doSimulation.notify_all();
 					doPathfinding.notify_all();
 				}
+				if (replayMode) {
+					// press , or . to halve or double replay speed, r to reverse it
+					if (event.key.code == sf::Keyboard::Comma) {
+						replaySpeed = replaySpeed / 2;
+					}
+					if (event.key.code == sf::Keyboard::Period) {
+						replaySpeed = replaySpeed * 2;
+					}
+					if (event.key.code == sf::Keyboard::R) {
+						replaySpeed = -replaySpeed;
+					}
+					// press [ or ] to jump REPLAY_JUMP ticks back or ahead
+					if (event.key.code == sf::Keyboard::LBracket) {
+						replayPosition -= REPLAY_JUMP;
+					}
+					if (event.key.code == sf::Keyboard::RBracket) {
+						replayPosition += REPLAY_JUMP;
+					}
+					// press semicolon to print the nodes where citizens are stuck
+					if (event.key.code == sf::Keyboard::Semicolon) {
+						replayReport();
+					}
+					// nothing is simulated, so the other keys do not apply
+					continue;
+				}
 				// press space to spawn CUSTOM_CITIZEN_SPAWN_AMT citizens at the nearest node
 				if (event.key.code == sf::Keyboard::Space) {
-					std::unique_lock<std::mutex> customCitizenSpawnLock(customCitizenSpawnMutex);
+					std::unique_lock<InstrumentedMutex> customCitizenSpawnLock(customCitizenSpawnMutex);
 					customSpawnCitizens = true;
 					doPathfinding.notify_one();
 					doCustomCitizenSpawn.wait(customCitizenSpawnLock, [] {return !customSpawnCitizens;  });
@@ -756,6 +1125,10 @@ void renderingThread() {
 				if (event.key.code == sf::Keyboard::Semicolon) {
 					debugReport();
 				}
+				// press k to save a checkpoint at the end of the current tick
+				if (event.key.code == sf::Keyboard::K) {
+					checkpointRequested = true;
+				}
 				// press backspace to toggle "passive" citizen spawning
 				if (event.key.code == sf::Keyboard::Backspace) {
 					toggleSpawn = !toggleSpawn;
@@ -769,59 +1142,98 @@ void renderingThread() {
 		panVelocity.y = std::max(std::min(panVelocity.y, MAX_PAN_VELOCITY), -MAX_PAN_VELOCITY);
 		view.move(panVelocity);
 
+		// advance the replay (seeking backwards restarts from the last keyframe)
+		if (replayMode) {
+			if (!replayPaused) {
+				replayPosition += replaySpeed;
+			}
+			replayPosition = std::max(double(replay.firstTick()), std::min(replayPosition, double(replay.lastTick())));
+			replay.seek(uint64_t(replayPosition));
+			replay.countNodes(REPLAY_STUCK_TICKS, replayWaiting, replayStuck);
+		}
+
+		// the latest state published by the simulation, unchanged until the next frame takes a newer one
+		const RenderSnapshot& frame = snapshots.front();
+
 		window.clear();
 		window.setView(view);
 		window.draw(bg);
 
 		// refresh text every TEXT_REFRESH_RATE frames
-		if (renderTick % TEXT_REFRESH_RATE == 0) {
-			size_t c = citizens.activeSize();
+		if (renderTick % TEXT_REFRESH_RATE == 0 && replayMode) {
+			unsigned int minuteOfDay = (SIM_START_TIME + (unsigned int)replay.tick()) % SIM_DAY_TICKS / TICKS_PER_MINUTE;
+			char clockString[16];
+			std::snprintf(clockString, sizeof(clockString), "%02u:%02u ", minuteOfDay / 60, minuteOfDay % 60);
+			std::string speedString = replayPaused ? "paused" : std::to_string(int(replaySpeed)) + " ticks/frame";
+			unsigned int waiting = nearestNode == &NEARBY_NODE ? 0 : replayWaiting[nearestNode->index];
+			text.setString(std::to_string(replay.active) + " active citizens\n" + clockString + "replay tick " + std::to_string(replay.tick()) + " (" + speedString + ")\n" + nearestNode->id + " [" + std::to_string(waiting) + "]");
+		}
+		else if (renderTick % TEXT_REFRESH_RATE == 0) {
+			size_t c = frame.activeCitizens;
 			std::string speedString;
 			if (!simPause) {
-				int s = simSpeedStat[simSpeedStat.size() - 1];
-				speedString = std::to_string(s) + " ticks/sec\n";
+				speedString = std::to_string(frame.simSpeed) + " ticks/sec\n";
 			}
 			else {
-				speedString = "Simulation paused (tick " + std::to_string(simTick) + ")\n";
+				speedString = "Simulation paused (tick " + std::to_string(frame.tick) + ")\n";
 			}
-			text.setString(std::to_string(c) + " active citizens\n" + speedString + nearestNode->id + " [" + std::to_string(nearestNode->capacity) + "]");
-		}
-
-		if (drawTrains) {
-			std::lock_guard<std::mutex> trainsLock(trainsMutex);
-			for (int i = 0; i < VALID_TRAINS; i++) {
-				float newRadius = TRAIN_MIN_SIZE + trains[i].capacity / TRAIN_CAPACITY_FLOAT * (TRAIN_SIZE_DIFF);
-				trains[i].updateRadius(newRadius);
-				sf::Vector2f trainPosition = trains[i].getPosition();
-				sf::Vector2f trainPositionNormalized = trainPosition - sf::Vector2f(newRadius, newRadius);
-				sf::Color trainColor = trains[i].getFillColor();
-				for (int j = 0; j < TRAIN_N_POINTS; j++) {
-					int idx = i * TRAIN_N_POINTS * 3 + j * 3;
-					trainVertices[idx] = sf::Vertex(trains[i].getPoint(j) + trainPositionNormalized, trainColor);
-					trainVertices[idx+1] = sf::Vertex(trainPosition, trainColor);
-					trainVertices[idx+2] = sf::Vertex(trains[i].getPoint((j + 1) % TRAIN_N_POINTS) + trainPositionNormalized, trainColor);
+			unsigned int minuteOfDay = frame.time % SIM_DAY_TICKS / TICKS_PER_MINUTE;
+			char clockString[16];
+			std::snprintf(clockString, sizeof(clockString), "%02u:%02u ", minuteOfDay / 60, minuteOfDay % 60);
+			speedString = std::string(DemandModel::bandName(demand.bandAt(frame.time))) + "\n" + speedString;
+			speedString = clockString + speedString;
+			unsigned int nodeLoad = nearestNode == &NEARBY_NODE ? 0 : frame.nodeLoads[nearestNode->index];
+			text.setString(std::to_string(c) + " active citizens\n" + speedString + nearestNode->id + " [" + std::to_string(nodeLoad) + "]");
+		}
+
+		#if HEATMAP == true
+		// segment loads are not recorded, so there is no overlay during replays
+		if (drawHeatmap && !replayMode) {
+			float segmentMax = HEATMAP_SEGMENT_SCALE * config.trainCapacity;
+			for (size_t s = 0; s < segmentHeat.size(); s++) {
+				segmentHeat[s] = segmentHeat[s] * HEATMAP_DECAY + frame.segmentLoads[s] * (1 - HEATMAP_DECAY);
+				sf::Color color = heatmapColor(segmentHeat[s] / segmentMax);
+				for (size_t v = heatSegmentStart[s]; v < heatSegmentStart[s + 1]; v++) {
+					heatVertices[v].color = color;
 				}
 			}
+			heatVertexBuffer.update(heatVertices.data());
+			window.draw(heatVertexBuffer);
 
-			window.draw(trainVertices);
+			for (int i = 0; i < VALID_NODES; i++) {
+				nodeHeat[i] = nodeHeat[i] * HEATMAP_DECAY + frame.nodeLoads[i] * (1 - HEATMAP_DECAY);
+				float heat = std::min(1.0f, nodeHeat[i] / HEATMAP_NODE_MAX);
+				nodeHeatCircles.set(i, nodes[i].getPosition(), NODE_MAX_SIZE * 2 * heat, heatmapColor(heat));
+			}
+			nodeHeatCircles.update();
+			window.draw(nodeHeatCircles);
+		}
+		#endif
+
+		// trains are not recorded, so replays only show the citizens at nodes
+		if (drawTrains && !replayMode) {
+			// the number of trains follows the timetable
+			size_t numTrains = frame.trainPositions.size();
+			trainCircles.resize(numTrains);
+			for (size_t i = 0; i < numTrains; i++) {
+				float newRadius = TRAIN_MIN_SIZE + frame.trainLoads[i] * (TRAIN_SIZE_DIFF);
+				trainCircles.set(i, frame.trainPositions[i], newRadius, frame.trainColors[i]);
+			}
+			trainCircles.update();
+
+			window.draw(trainCircles);
 		}
 
 		if (drawNodes) {
 			for (int i = 0; i < VALID_NODES; i++) {
-				float newRadius = NODE_MIN_SIZE + std::min(NODE_CAPACITY, nodes[i].capacity) / NODE_CAPACITY_FLOAT * (NODE_SIZE_DIFF);
-				nodes[i].updateRadius(newRadius);
-				sf::Vector2f nodePosition = nodes[i].getPosition();
-				sf::Vector2f nodePositionNormalized = nodePosition - sf::Vector2f(newRadius, newRadius);
-				sf::Color nodeColor = nodes[i].getFillColor();
-				for (int j = 0; j < NODE_N_POINTS; j++) {
-					int idx = i * NODE_N_POINTS * 3 + j * 3;
-					nodeVertices[idx] = sf::Vertex(nodes[i].getPoint(j) + nodePositionNormalized, nodeColor);
-					nodeVertices[idx+1] = sf::Vertex(nodePosition, nodeColor);
-					nodeVertices[idx+2] = sf::Vertex(nodes[i].getPoint((j + 1) % NODE_N_POINTS) + nodePositionNormalized, nodeColor);
-				}
+				unsigned int capacity = replayMode ? replayWaiting[i] : frame.nodeLoads[i];
+				float newRadius = NODE_MIN_SIZE + std::min(NODE_CAPACITY, capacity) / NODE_CAPACITY_FLOAT * (NODE_SIZE_DIFF);
+				sf::Color nodeColor = replayMode && replayStuck[i] > CITIZEN_STUCK_THRESH ? REPLAY_STUCK_COLOR : nodes[i].getFillColor();
+				nodeCircles.set(i, nodes[i].getPosition(), newRadius, nodeColor);
 			}
+			nodeCircles.update();
 
-			window.draw(nodeVertices);
+			window.draw(nodeCircles);
 		}
 
 		if (drawLines) {
@@ -840,8 +1252,110 @@ void renderingThread() {
 	}
 }
 
+// renders every snapshot published at HEADLESS_FRAME_INTERVAL ticks on the CPU (no window or OpenGL context needed)
+// and writes it to a numbered PNG in HEADLESS_DIRECTORY or as raw RGBA to the HEADLESS_PIPE command
+// runs on its own thread, the simulation replaces snapshots this thread has not taken yet instead of waiting
+void headlessThread() {
+	#if TRACE == true
+	tracer.nameThread("headless");
+	#endif
+	// track geometry never changes, so it is drawn once and copied under every frame
+	Raster background(WINDOW_WIDTH, WINDOW_HEIGHT);
+	background.clear(BACKGROUND_COLOR);
+	for (int i = 0; i < VALID_LINES; i++) {
+		for (Segment& segment : lines[i].segments) {
+			std::vector<Vector2f>& points = segment.polyline.points;
+			for (size_t j = 1; j < points.size(); j++) {
+				background.line(points[j - 1], points[j], HEADLESS_LINE_WIDTH, lines[i].color);
+			}
+		}
+	}
+	Raster raster(WINDOW_WIDTH, WINDOW_HEIGHT);
+
+	std::string pipeCommand = HEADLESS_PIPE;
+	FILE* pipe = nullptr;
+	if (!pipeCommand.empty()) {
+		#ifdef _WIN32
+		pipe = _popen(pipeCommand.c_str(), "wb");
+		#else
+		// a consumer that exits would otherwise kill the process with SIGPIPE on the next write, instead of failing it
+		signal(SIGPIPE, SIG_IGN);
+		pipe = popen(pipeCommand.c_str(), "w");
+		#endif
+		if (pipe == nullptr) {
+			std::cerr << "Error opening pipe to " << pipeCommand << std::endl;
+			std::cout << "WARN: writing PNG frames to " << HEADLESS_DIRECTORY << " instead" << std::endl;
+			pipeCommand.clear();
+		}
+	}
+	if (pipeCommand.empty()) {
+		std::error_code error;
+		std::filesystem::create_directories(HEADLESS_DIRECTORY, error);
+	}
+
+	unsigned long lastTick = 0;
+	unsigned int frames = 0;
+	unsigned int dropped = 0;
+	float NODE_CAPACITY_FLOAT = float(NODE_CAPACITY);
+	while (true) {
+		// checked before taking a snapshot, so the one published last is always rendered
+		bool stopping = shouldExit;
+		const RenderSnapshot& frame = snapshots.front();
+		if (frames > 0 && frame.tick == lastTick) {
+			if (stopping) break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+		if (frames > 0 && frame.tick - lastTick > HEADLESS_FRAME_INTERVAL) {
+			dropped += unsigned((frame.tick - lastTick) / HEADLESS_FRAME_INTERVAL - 1);
+		}
+		lastTick = frame.tick;
+
+		TraceScope frameScope(tracer, "frame", "render");
+		raster.copy(background);
+		for (int i = 0; i < VALID_NODES; i++) {
+			float radius = NODE_MIN_SIZE + std::min(NODE_CAPACITY, frame.nodeLoads[i]) / NODE_CAPACITY_FLOAT * (NODE_SIZE_DIFF);
+			raster.fillCircle(nodes[i].getPosition(), radius, nodes[i].getFillColor());
+		}
+		for (size_t i = 0; i < frame.trainPositions.size(); i++) {
+			raster.fillCircle(frame.trainPositions[i], TRAIN_MIN_SIZE + frame.trainLoads[i] * (TRAIN_SIZE_DIFF), frame.trainColors[i]);
+		}
+
+		if (pipe != nullptr) {
+			if (std::fwrite(raster.data(), 1, raster.size(), pipe) != raster.size()) {
+				std::cout << "WARN: pipe to " << pipeCommand << " closed, no more frames are written" << std::endl;
+				break;
+			}
+		}
+		else {
+			char name[32];
+			std::snprintf(name, sizeof(name), "/frame_%06u.png", frames);
+			std::vector<uint8_t> png = encodePNG(raster);
+			std::ofstream out(HEADLESS_DIRECTORY + std::string(name), std::ios::binary | std::ios::trunc);
+			if (!out.write(reinterpret_cast<const char*>(png.data()), std::streamsize(png.size()))) {
+				std::cerr << "Error writing " << HEADLESS_DIRECTORY << name << std::endl;
+				break;
+			}
+		}
+		frames++;
+	}
+
+	if (pipe != nullptr) {
+		#ifdef _WIN32
+		_pclose(pipe);
+		#else
+		pclose(pipe);
+		#endif
+	}
+	std::cout << "Headless renderer: " << frames << " frames written to " << (pipeCommand.empty() ? HEADLESS_DIRECTORY : pipeCommand) << " (" << dropped << " dropped)" << std::endl;
+}
+
 void pathfindingThread() {
-	std::unique_lock<std::mutex> pathsLock(pathsMutex);
+	#if TRACE == true
+	tracer.nameThread("pathfinding");
+	#endif
+	std::mt19937_64 rng = util::rngStream(rngSeed, RNG_STREAM_CUSTOM);
+	std::unique_lock<InstrumentedMutex> pathsLock(pathsMutex);
 	while (!shouldExit) {
 		doPathfinding.wait(pathsLock, [] {return !justDidPathfinding || customSpawnCitizens || shouldExit; });
 		if (shouldExit) break;
@@ -850,9 +1364,8 @@ void pathfindingThread() {
 		if (customSpawnCitizens) {
 			int spawned = 0;
 			for (int i = 0; i < CUSTOM_CITIZEN_SPAWN_AMT; i++) {
-				Node* end = &nodes[rand() % VALID_NODES];
-				if (nearestNode != end && citizens.add(nearestNode, end)) {
-					handledCitizens++;
+				Node* end = &nodes[std::uniform_int_distribution<int>(0, VALID_NODES - 1)(rng)];
+				if (nearestNode != end && publishCitizen(nearestNode, end, true)) {
 					spawned++;
 				}
 			}
@@ -860,16 +1373,12 @@ void pathfindingThread() {
 			customSpawnCitizens = false;
 			doCustomCitizenSpawn.notify_one();
 		}
-		// spawn citizens using weighted-random node selection if spawning is enabled
+		// spawn citizens following the demand model if spawning is enabled (the simulation thread does this itself if SIM_DETERMINISTIC)
 		else if (toggleSpawn) {
 			justDidPathfinding = true;
-
-			#if CITIZEN_SPAWN_METHOD == 1
-			// spawn a constant amount of citizens CITIZEN_SPAWN_AMT
-			generateRandomCitizens(CITIZEN_SPAWN_AMT);
-			#else
-			// spawn citizens up to a target amount TARGET_CITIZEN_COUNT
-			generateRandomCitizens(TARGET_CITIZEN_COUNT - citizens.activeSize());
+			#if SIM_DETERMINISTIC == false
+			TraceScope spawnScope(tracer, "spawn citizens", "path");
+			spawnCitizens(true);
 			#endif
 		}
 	}
@@ -877,134 +1386,527 @@ void pathfindingThread() {
 	std::cout << "Pathfinding thread shut down" << std::endl;
 }
 
+// updates citizens [start, end) of one worker, collecting those to remove in toDelete
+// the per-citizen options are template parameters so every combination is compiled without their branches,
+// simulationThread picks the variant once per chunk (see CITIZEN_CHUNK_VARIANTS)
+template<bool Cull, bool CountStatus, bool RecordTransitions>
+static void updateCitizenChunk(size_t start, size_t end, std::vector<int>& toDelete, unsigned int* counts, std::vector<TrajectoryEvent>& changed) {
+	for (size_t ind = start; ind < end; ind++) {
+		Citizen& cit = citizens[ind];
+		if (cit.status != STATUS_DESPAWNED) {
+			char previousStatus = cit.status;
+			Node* previousNode = cit.currentNode;
+			if (cit.updatePositionAlongPath()) {
+				toDelete.push_back(ind);
+			}
+			else if (Cull && cit.cull()) {
+				std::cout << "Scheduled deletion for timed out citizen" << std::endl; // this never prints, but for some reason, it needs to be here. lol
+				toDelete.push_back(ind);
+			}
+			if (RecordTransitions && (cit.status != previousStatus || cit.currentNode != previousNode)) {
+				changed.push_back(trajectoryEvent(cit, int(ind), simTick));
+			}
+		}
+		if (CountStatus) {
+			counts[int(cit.status)]++;
+		}
+	}
+}
+
+typedef void (*CitizenChunkFunction)(size_t, size_t, std::vector<int>&, unsigned int*, std::vector<TrajectoryEvent>&);
+
+// indexed by cull | telemetry << 1 | trajectory << 2
+static const CitizenChunkFunction CITIZEN_CHUNK_VARIANTS[8] = {
+	updateCitizenChunk<false, false, false>, updateCitizenChunk<true, false, false>,
+	updateCitizenChunk<false, true, false>, updateCitizenChunk<true, true, false>,
+	updateCitizenChunk<false, false, true>, updateCitizenChunk<true, false, true>,
+	updateCitizenChunk<false, true, true>, updateCitizenChunk<true, true, true>
+};
+
 void simulationThread() {
 	simPause = false;
+	#if TRACE == true
+	tracer.nameThread("simulation");
+	#endif
 
-	// initialize stat recorders
-	double timeElapsed = double(clock());
+	// initialize stat recorders (wall time, clock() would add up the CPU time of every worker)
+	auto simStartTime = std::chrono::steady_clock::now();
 	activeCitizensStat.reserve(BENCHMARK_RESERVE);
 	clockStat.reserve(BENCHMARK_RESERVE);
 	simSpeedStat.reserve(BENCHMARK_RESERVE);
+	clockStat.push_back(simStartTime);
+
+	CitizenThreadPool pool(config.threads);
+	profiler.setWorkers(config.threads);
+
+	std::cout << "Initializing " << config.threads << " threads for citizen processing" << std::endl;
+
+	// stop arrivals/departures found by each train update task
+	std::vector<std::vector<TrainEvent>> trainEvents(config.threads);
+	// citizens despawned by each citizen update task
+	std::vector<std::vector<int>> despawned(config.threads);
+	// citizen slots per status after each citizen update task (only counted for telemetry)
+	std::vector<std::array<unsigned int, STATUS_COUNT>> statusCounts(config.threads);
+	// citizens that changed status or node in each citizen update task (only collected for the trajectory)
+	std::vector<std::vector<TrajectoryEvent>> transitions(config.threads);
+
+	// the benchmark measures the ticks after its warm-up, counters are differences from where measuring started
+	BenchmarkRecorder benchRecorder;
+	BenchmarkTotals benchStart = {};
+	auto benchStartTime = std::chrono::steady_clock::now();
+	if (benchMode) {
+		benchRecorder.reserve(benchParams.ticks);
+	}
 
-	CitizenThreadPool pool(NUM_CITIZEN_WORKER_THREADS);
-
-	std::cout << "Initializing " << NUM_CITIZEN_WORKER_THREADS << " threads for citizen processing" << std::endl;
+	// without a writer thread the rings would only fill up (and the trajectory would wait for room forever), so a failed open turns recording off
+	if (config.telemetry) {
+		config.telemetry = telemetry.open(TELEMETRY_FILE) == AOK;
+		std::cout << (config.telemetry ? "Streaming telemetry to " : "WARN: telemetry disabled, could not open ") << TELEMETRY_FILE << std::endl;
+	}
+	if (config.trajectory) {
+		config.trajectory = trajectory.open(TRAJECTORY_FILE) == AOK;
+		std::cout << (config.trajectory ? "Recording trajectories to " : "WARN: trajectory disabled, could not open ") << TRAJECTORY_FILE << std::endl;
+	}
 	
-	std::mutex simMutex;
-	std::unique_lock<std::mutex> simLock(simMutex);
+	InstrumentedMutex simMutex("simMutex");
+	std::unique_lock<InstrumentedMutex> simLock(simMutex);
 	while (!shouldExit) {
 		// wait if paused
 		doSimulation.wait(simLock, [] { return !simPause; } );
+		ProfileScope tickScope(profiler, PROFILE_TICK);
+		if (benchMode && simTick - startTick == benchParams.warmup) {
+			benchStartTime = std::chrono::steady_clock::now();
+			benchStart = { 0, simTick, handledCitizens, uint64_t(pathRequests), uint64_t(pathCacheHits), uint64_t(pathFails) };
+			profiler.reset();
+		}
+		auto tickStart = std::chrono::steady_clock::now();
 		simTick++;
+		simTime = SIM_START_TIME + (unsigned int)simTick;
+
+		// take in every citizen spawned since the last tick at once (spawners never wait on the tick)
+		size_t spawned;
+		{
+			ProfileScope scope(profiler, PROFILE_SPAWN_HANDOFF);
+			spawned = citizens.drain(spawnQueue);
+		}
+		size_t despawnedCount = 0;
+		#if PROFILER == true
+		int numCitizenTasks = 0;
+		#endif
+		auto spawnEnd = std::chrono::steady_clock::now();
 
-		#if BENCHMARK_MODE == true
 		// benchmark mode disables rendering and exits after fixed amount of ticks
-		if (simTick % STAT_RATE == 0) {
-			std::cout << "\rProgress: " << float(simTick) / BENCHMARK_TICK_AMT * 100 << "%" << ", " << citizens.activeSize() << " active citizens" << std::flush;
+		if (benchMode) {
+			unsigned long benchTicks = benchParams.warmup + benchParams.ticks;
+			if (simTick % STAT_RATE == 0) {
+				std::cout << "\rProgress: " << float(simTick - startTick) / benchTicks * 100 << "%" << ", " << citizens.activeSize() << " active citizens" << std::flush;
+			}
+			if (simTick - startTick >= benchTicks) {
+				std::cout << std::endl << "Benchmark concluded at tick " << simTick << std::endl;
+				shouldExit = true;
+			}
 		}
-		if (simTick >= BENCHMARK_TICK_AMT) {
-			std::cout << std::endl << "Benchmark concluded at tick " << simTick << std::endl;
+		if (headlessMode && headlessTicks > 0 && simTick - startTick >= headlessTicks) {
 			shouldExit = true;
 		}
-		#endif
 
 		// record statistics
 		if (simTick % STAT_RATE == 0) {
+			sampleMemory();
 			activeCitizensStat.push_back(citizens.activeSize());
-			clockStat.push_back(double(clock()));
+			clockStat.push_back(std::chrono::steady_clock::now());
 			size_t clockSize = clockStat.size();
-			simSpeedStat.push_back(STAT_RATE / ((clockStat[clockSize-1] - clockStat[clockSize-2]) / CLOCKS_PER_SEC));
+			simSpeedStat.push_back(int(STAT_RATE / std::chrono::duration<double>(clockStat[clockSize-1] - clockStat[clockSize-2]).count()));
 		}
 		
-		// ping pathfinding thread to spawn citizens
-		if (simTick % CITIZEN_SPAWN_FREQ == 0 && toggleSpawn) {
+		// ping pathfinding thread to spawn citizens (they are drained at the start of a later tick)
+		if (simTick % config.spawnFrequency == 0 && toggleSpawn) {
+			#if SIM_DETERMINISTIC == true
+			spawnCitizens(false);
+			#else
 			justDidPathfinding = false;
 			doPathfinding.notify_one();
+			#endif
 		}
 
 		// run simulation on trains and citizens
 		{
-			std::lock_guard<std::mutex> trainsLock(trainsMutex);
-			for (int i = 0; i < VALID_TRAINS; i++) {
-				trains[i].updatePositionAlongLine();
+			ProfileScope scope(profiler, PROFILE_TRAIN_UPDATE);
+			trains.spawn(simTime);
+			int numTrains = trains.size();
+			int numTasks = std::min(numTrains / TRAIN_PARALLEL_CHUNK, config.threads);
+			if (numTasks <= 1) {
+				trains.update(0, numTrains, simTime, trainEvents[0]);
 			}
+			else {
+				// trains only touch their own state here, nodes are updated afterwards in train order
+				// (trips that finished are skipped, their ids are reused by new trips)
+				int chunkSize = numTrains / numTasks + 1;
+				for (int i = 0; i < numTasks; i++) {
+					pool.enqueue([i, chunkSize, numTrains, &trainEvents]() {
+						TraceScope scope(tracer, "train chunk", "tick");
+						int start = i * chunkSize;
+						trains.update(start, std::min(start + chunkSize, numTrains), simTime, trainEvents[i]);
+					});
+				}
+				pool.waitForCompletion();
+			}
+			for (std::vector<TrainEvent>& events : trainEvents) {
+				trains.applyEvents(events);
+				events.clear();
+			}
+
+			#if PLATFORM_STRESS_TEST == true
+			if (simTick % STAT_RATE == 0) {
+				checkPlatforms();
+			}
+			#endif
 		}
+		auto trainsEnd = std::chrono::steady_clock::now();
 
 		{
-			size_t chunkSize = citizens.activeSize() / NUM_CITIZEN_WORKER_THREADS + 1;
-			for (int i = 0; i < NUM_CITIZEN_WORKER_THREADS; i++) {
-				pool.enqueue([i, chunkSize]() {
-					std::vector<int> toDelete;
+			// despawned citizens stay in place until their slot is reused, so the whole vector is scanned
+			// (citizens share train and node counters, so a deterministic run updates them all in one task)
+			size_t numCitizens = citizens.size();
+			int numTasks = SIM_DETERMINISTIC ? 1 : config.threads;
+			size_t chunkSize = numCitizens / numTasks + 1;
+			#if PROFILER == true
+			numCitizenTasks = numTasks;
+			#endif
+			#if PROFILER == true || TRACE == true
+			auto dispatchStart = std::chrono::steady_clock::now();
+			#endif
+			for (int i = 0; i < numTasks; i++) {
+				pool.enqueue([i, chunkSize, numCitizens, &despawned, &statusCounts, &transitions]() {
+					ProfileScope scope(profiler, PROFILE_CITIZEN_WORKER, i);
+					std::vector<int>& toDelete = despawned[i];
+					unsigned int* counts = statusCounts[i].data();
+					std::vector<TrajectoryEvent>& changed = transitions[i];
 					size_t start = i * chunkSize;
-					size_t end = std::min(start + chunkSize, citizens.activeSize());
-					bool doCull = simTick % CITIZEN_CULL_FREQ == 0;
-					for (size_t ind = start; ind < end; ind++) {
-						Citizen& cit = citizens[ind];
-						if (!cit.status == STATUS_DESPAWNED) {
-							if (cit.updatePositionAlongPath()) {
-								toDelete.push_back(ind);
-							}
-							else if (doCull && cit.cull()) {
-								std::cout << "Scheduled deletion for timed out citizen" << std::endl; // this never prints, but for some reason, it needs to be here. lol
-								toDelete.push_back(ind);
-							}
-						}
-					}
-					{
-						std::lock_guard<std::mutex> citizenLock(blockStack);
-						for (int& i : toDelete) {
-							citizens.remove(i);
-						}
-					}
+					size_t end = std::min(start + chunkSize, numCitizens);
+					bool doCull = simTick % config.cullFrequency == 0;
+					int variant = (doCull ? 1 : 0) | (config.telemetry ? 2 : 0) | (config.trajectory ? 4 : 0);
+					CITIZEN_CHUNK_VARIANTS[variant](start, end, toDelete, counts, changed);
 				});
 			}
 
+			#if PROFILER == true || TRACE == true
+			auto dispatchEnd = std::chrono::steady_clock::now();
+			profiler.span(PROFILE_CHUNK_DISPATCH, dispatchStart, dispatchEnd);
+			#endif
 			pool.waitForCompletion();
+			#if PROFILER == true || TRACE == true
+			profiler.span(PROFILE_CITIZEN_WAIT, dispatchEnd, std::chrono::steady_clock::now());
+			#endif
+			ProfileScope scope(profiler, PROFILE_DESPAWN_MERGE);
+			for (std::vector<int>& toDelete : despawned) {
+				for (int ind : toDelete) {
+					citizens.remove(ind);
+				}
+				despawnedCount += toDelete.size();
+				toDelete.clear();
+			}
+		}
+		auto citizensEnd = std::chrono::steady_clock::now();
+
+		if (config.telemetry) {
+			if (simTick % TELEMETRY_RATE == 0) {
+				TelemetryRecord r = {};
+				r.tick = simTick;
+				r.time = simTime;
+				r.tickMicros = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - tickStart).count();
+				r.citizens = uint32_t(citizens.activeSize());
+				for (std::array<unsigned int, STATUS_COUNT>& counts : statusCounts) {
+					for (int s = 0; s < STATUS_COUNT; s++) {
+						r.status[s] += counts[s];
+						counts[s] = 0;
+					}
+				}
+				r.spawned = uint32_t(spawned);
+				r.despawned = uint32_t(despawnedCount);
+				r.queued = uint32_t(spawnQueue.size());
+				r.pathRequests = pathRequests;
+				r.pathCacheHits = pathCacheHits;
+				r.pathFails = pathFails;
+				r.trains = trains.activeSize();
+				for (int t = 0; t < trains.size(); t++) {
+					if (trains.status[t] == STATUS_DESPAWNED) continue;
+					r.riders += trains.capacity[t];
+					r.maxLoad = std::max(r.maxLoad, uint32_t(trains.capacity[t]));
+				}
+				telemetry.record(r);
+			}
+			else {
+				for (std::array<unsigned int, STATUS_COUNT>& counts : statusCounts) {
+					counts.fill(0u);
+				}
+			}
+		}
+
+		if (config.trajectory) {
+			// tasks cover ascending ranges of citizens, so events stay in citizen order
+			for (std::vector<TrajectoryEvent>& changed : transitions) {
+				trajectory.record(changed);
+				changed.clear();
+			}
+			trajectory.endTick(simTick);
+		}
+
+		// a snapshot the renderer has not taken yet would only be replaced, so snapshots cost at most one copy per frame
+		// headless frames are rendered at fixed tick intervals, the window takes a snapshot whenever it has drawn the last one
+		if (headlessMode) {
+			if (simTick % HEADLESS_FRAME_INTERVAL == 0) {
+				publishSnapshot();
+			}
+		}
+		else if (!benchMode && snapshots.taken()) {
+			publishSnapshot();
+		}
+
+		#if LOCK_STATS == true
+		if (LOCK_STATS_REPORT_FREQ > 0 && simTick % LOCK_STATS_REPORT_FREQ == 0) {
+			std::cout << "Lock contention at tick " << simTick << ":" << std::endl;
+			reportLocks(std::cout);
+		}
+		#endif
+
+		#if PROFILER == true
+		profiler.endTick(numCitizenTasks);
+		if (PROFILER_REPORT_FREQ > 0 && simTick % PROFILER_REPORT_FREQ == 0) {
+			std::cout << "Profile at tick " << simTick << ":" << std::endl;
+			profiler.report(std::cout);
+		}
+		#endif
+
+		if (checkpointRequested || simTick == CHECKPOINT_TICK) {
+			checkpointRequested = false;
+			checkpoint();
+		}
+
+		if (benchMode && simTick - startTick > benchParams.warmup) {
+			auto tickEnd = std::chrono::steady_clock::now();
+			float micros[BENCH_NUM_PHASES] = {
+				std::chrono::duration<float, std::micro>(spawnEnd - tickStart).count(),
+				std::chrono::duration<float, std::micro>(trainsEnd - spawnEnd).count(),
+				std::chrono::duration<float, std::micro>(citizensEnd - trainsEnd).count(),
+				std::chrono::duration<float, std::micro>(tickEnd - citizensEnd).count(),
+				std::chrono::duration<float, std::micro>(tickEnd - tickStart).count()
+			};
+			benchRecorder.record(micros, citizens.activeSize());
 		}
 	}
 
 	std::cout << "Simulation thread shut down" << std::endl;
 	std::cout << std::endl << "SIM DONE!" << std::endl;
-	std::cout << "Simulation ticks elapsed: " << simTick << std::endl;
-	timeElapsed = (double(clock()) - timeElapsed) / CLOCKS_PER_SEC;
+	std::cout << "Simulation ticks elapsed: " << simTick - startTick << std::endl;
+	double timeElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - simStartTime).count();
 	std::cout << "Simulation time elapsed: " << timeElapsed << "s" << std::endl;
-	std::cout << "Averaged " << simTick / timeElapsed << "t/s" << std::endl;
+	std::cout << "Averaged " << (simTick - startTick) / timeElapsed << "t/s" << std::endl;
 	std::cout << "Averaged " << float(handledCitizens) / timeElapsed << "c/s (citizen agents per second)" << std::endl;
 	long int averageActiveCitizens = 0;
 	for (int i : activeCitizensStat) averageActiveCitizens += i;
 	averageActiveCitizens /= activeCitizensStat.size();
 	std::cout << "Averaged " << averageActiveCitizens << " concurrent citizen agents" << std::endl;
 	std::cout << "Handled total " << handledCitizens << " citizen agents" << std::endl;
+	sampleMemory();
+	std::cout << std::endl;
+	memory.report(std::cout);
+	#if PROFILER == true
+	std::cout << std::endl;
+	profiler.report(std::cout);
+	#endif
+	#if LOCK_STATS == true
+	std::cout << std::endl;
+	reportLocks(std::cout);
+	#endif
+	if (config.telemetry) {
+		telemetry.close();
+		std::cout << "Telemetry: " << telemetry.recordsWritten() << " records written to " << TELEMETRY_FILE << " (" << telemetry.recordsDropped() << " dropped)" << std::endl;
+	}
+	if (config.trajectory) {
+		trajectory.close();
+		std::cout << "Trajectory: " << trajectory.eventsWritten() << " events (" << trajectory.bytesWritten() / 1024 << " KiB) written to " << TRAJECTORY_FILE << std::endl;
+	}
+	if (benchMode) {
+		BenchmarkTotals totals = {
+			std::chrono::duration<double>(std::chrono::steady_clock::now() - benchStartTime).count(),
+			simTick - benchStart.ticks,
+			handledCitizens - benchStart.spawned,
+			uint64_t(pathRequests) - benchStart.pathRequests,
+			uint64_t(pathCacheHits) - benchStart.pathCacheHits,
+			uint64_t(pathFails) - benchStart.pathFails
+		};
+		writeBenchmarkReport(benchParams, benchRecorder, totals, memory);
+	}
 
 	doPathfinding.notify_one();
 }
 
-int main() {
+int main(int argc, char** argv) {
+	#if TRACE == true
+	tracer.nameThread("main");
+	profiler.tracer = &tracer;
+	#endif
+	#if BENCHMARK_MODE == true
+	benchMode = true;
+	#endif
+
+	// subcommands (the first argument, unless it is already a key=value setting)
+	std::string command = argc > 1 && std::strchr(argv[1], '=') == nullptr ? argv[1] : "";
+	if (command == "compile") {
+		// citysim compile [output]: parse and preprocess the CSVs once, write them out as a network image
+		std::string output = argc > 2 ? argv[2] : NETWORK_IMAGE_FILE;
+		int status = readNetwork();
+		return status == AOK ? compileNetwork(output) : status;
+	}
+	if (command == "generate" && argc > 2) {
+		// citysim generate <directory> [key=value ...]: write a synthetic network's CSVs (see GeneratorParams for the keys)
+		GeneratorParams params;
+		for (int i = 3; i < argc; i++) {
+			if (!params.set(argv[i])) {
+				std::cout << "ERR: invalid generator parameter " << argv[i] << std::endl;
+				return ERROR_USAGE;
+			}
+		}
+		return params.validate() ? generateNetwork(argv[2], params) : ERROR_USAGE;
+	}
+
+	// run settings: CONFIG_FILE (or config=file) first, then every key=value argument with a key SimConfig knows
+	// the remaining arguments belong to the subcommand
+	std::string configFile = CONFIG_FILE;
+	bool configRequired = false;
+	std::vector<std::string> arguments;
+	for (int i = command.empty() ? 1 : 2; i < argc; i++) {
+		std::string argument = argv[i];
+		if (argument.rfind("config=", 0) == 0) {
+			configFile = argument.substr(7);
+			configRequired = true;
+		}
+		else {
+			arguments.push_back(argument);
+		}
+	}
+	if (configRequired || std::ifstream(configFile).is_open()) {
+		int status = config.load(configFile);
+		if (status != AOK) {
+			return status;
+		}
+		std::cout << "Read settings from " << configFile << std::endl;
+	}
+	std::vector<std::string> commandArguments;
+	for (const std::string& argument : arguments) {
+		if (!SimConfig::knows(argument)) {
+			commandArguments.push_back(argument);
+		}
+		else if (!config.set(argument)) {
+			std::cout << "ERR: invalid setting " << argument << std::endl;
+			return ERROR_USAGE;
+		}
+	}
+	if (!config.validate()) {
+		return ERROR_USAGE;
+	}
+
+	std::string checkpointFile;
+	if (command == "replay") {
+		// citysim replay [trajectory]: play a recorded trajectory back in the renderer, without simulating
+		int status = initNetwork();
+		if (status == AOK) {
+			status = replay.open(commandArguments.empty() ? TRAJECTORY_FILE : commandArguments[0]);
+		}
+		if (status != AOK) {
+			return status;
+		}
+		replayMode = true;
+		renderingThread();
+		return AOK;
+	}
+	if (command == "microbench") {
+		// citysim microbench [filter] [min_time=s]: time the simulation's hot paths one operation at a time on the initialized simulation
+		std::string filter;
+		double minSeconds = MICROBENCH_MIN_TIME;
+		for (const std::string& argument : commandArguments) {
+			if (argument.rfind("min_time=", 0) == 0) {
+				if (!util::parseDouble(argument.substr(9), &minSeconds) || minSeconds <= 0) {
+					std::cout << "ERR: invalid microbenchmark option " << argument << " (min_time must be a positive number of seconds)" << std::endl;
+					return ERROR_USAGE;
+				}
+			}
+			else {
+				filter = argument;
+			}
+		}
+		int status = init();
+		return status == AOK ? runMicrobenchmarks(filter, minSeconds) : status;
+	}
+	if (command == "bench") {
+		// citysim bench [key=value ...]: run without rendering for a fixed number of ticks and write a JSON report (see BenchmarkParams for the keys)
+		for (const std::string& argument : commandArguments) {
+			if (!benchParams.set(argument)) {
+				std::cout << "ERR: invalid benchmark option " << argument << std::endl;
+				return ERROR_USAGE;
+			}
+		}
+		if (!benchParams.validate()) {
+			return ERROR_USAGE;
+		}
+		benchMode = true;
+	}
+	else if (command == "headless" && (commandArguments.empty() || (commandArguments.size() == 1 && util::parseUnsigned(commandArguments[0], &headlessTicks)))) {
+		// citysim headless [ticks]: render frames to files instead of a window, stop after ticks (0 to run until killed)
+		headlessMode = true;
+	}
+	else if (command == "resume" && commandArguments.size() <= 1) {
+		// citysim resume [checkpoint]: run from a saved checkpoint instead of the initial state
+		checkpointFile = commandArguments.empty() ? CHECKPOINT_FILE : commandArguments[0];
+	}
+	else if (!command.empty() || !commandArguments.empty()) {
+		std::cerr << "Usage: citysim [compile [output] | resume [checkpoint] | replay [trajectory] | headless [ticks] | bench [ticks=n] [warmup=n] [output=file] | microbench [filter] [min_time=s] | generate <directory> [stations=n] [lines=n] [transfers=p] [extent=km] [ridership=n] [spread=sigma] [seed=n]] [config=file] [setting=value ...]" << std::endl;
+		std::cerr << "Settings (see SimConfig): " << SimConfig().arguments() << " network=file" << std::endl;
+		return ERROR_USAGE;
+	}
+	std::cout << "Settings: " << config.arguments() << std::endl;
+
 	// initialize memory
-	double progStartTime = double(clock());
+	auto progStartTime = std::chrono::steady_clock::now();
 	int initStatus = init();
+	if (initStatus == AOK && !checkpointFile.empty()) {
+		initStatus = loadCheckpoint(checkpointFile);
+		startTick = simTick;
+		#if HEATMAP == true
+		heatmap.rebuild(trains);
+		#endif
+	}
 	if (initStatus == AOK) {
-		std::cout << "Simulation initialized successfully (" << (double(clock()) - progStartTime) / CLOCKS_PER_SEC << "s)" << std::endl << std::endl;
+		publishSnapshot();
+		sampleMemory();
+		std::cout << "Simulation initialized successfully (" << std::chrono::duration<double>(std::chrono::steady_clock::now() - progStartTime).count() << "s)" << std::endl << std::endl;
 	} else {
 		return initStatus;
 	}
 
 	// initialize threads
 	std::thread renThread;
-	#if BENCHMARK_MODE == true
-	// disable rendering
-	std::cout << "Simulation running in benchmark mode (" << BENCHMARK_TICK_AMT << " ticks)" << std::endl;
-	std::cout << "Citizens spawn ";
-	#if CITIZEN_SPAWN_METHOD == 1
-	std::cout << CITIZEN_SPAWN_AMT << "/";
-	#else
-	std::cout << TARGET_CITIZEN_COUNT << "-N/";
-	#endif
-	std::cout << CITIZEN_SPAWN_FREQ << " ticks, max " << MAX_CITIZENS << std::endl;
-	#else
-	// enable rendering
-	renThread = std::thread(renderingThread);
-	#endif
+	if (benchMode) {
+		// disable rendering
+		std::cout << "Simulation running in benchmark mode (" << benchParams.warmup << " warm-up + " << benchParams.ticks << " ticks)" << std::endl;
+		std::cout << "Citizens spawn ";
+		if (config.spawnMethod == 1) {
+			std::cout << config.spawnAmount << "/";
+		}
+		else {
+			std::cout << config.agents << "-N/";
+		}
+		std::cout << config.spawnFrequency << " ticks, max " << MAX_CITIZENS << std::endl;
+	}
+	else if (headlessMode) {
+		std::cout << "Simulation running headless, rendering every " << HEADLESS_FRAME_INTERVAL << " ticks" << std::endl;
+		renThread = std::thread(headlessThread);
+	}
+	else {
+		// enable rendering
+		renThread = std::thread(renderingThread);
+	}
 
 	#if DISABLE_SIMULATION == false
 	std::thread simThread(simulationThread);
@@ -1012,7 +1914,7 @@ int main() {
 	#endif
 
 	// exit
-	if (!BENCHMARK_MODE && renThread.joinable()) {
+	if (renThread.joinable()) {
 		renThread.join();
 	}
 	#if DISABLE_SIMULATION == false
@@ -1024,5 +1926,9 @@ int main() {
 	}
 	#endif
 
+	#if TRACE == true
+	tracer.write(TRACE_FILE);
+	#endif
+
 	return 0;
 }
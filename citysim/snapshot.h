@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <SFML/Graphics.hpp>
+
+using sf::Vector2f;
+
+// everything the renderer draws of the simulation, copied by the simulation thread between ticks
+struct RenderSnapshot {
+	unsigned long tick = 0;
+	unsigned int time = 0; // simTime
+	size_t activeCitizens = 0;
+	int simSpeed = 0; // ticks/sec over the last STAT_RATE ticks
+
+	// active trains only
+	std::vector<Vector2f> trainPositions;
+	std::vector<float> trainLoads; // citizens on board / train_capacity
+	std::vector<sf::Color> trainColors;
+
+	std::vector<unsigned int> nodeLoads; // Node::capacity, indexed like nodes
+	std::vector<unsigned int> segmentLoads; // Heatmap::loads (HEATMAP only)
+
+	inline size_t memoryBytes() const {
+		return trainPositions.capacity() * sizeof(Vector2f) + trainLoads.capacity() * sizeof(float) + trainColors.capacity() * sizeof(sf::Color)
+			+ (nodeLoads.capacity() + segmentLoads.capacity()) * sizeof(unsigned int);
+	}
+};
+
+// lock-free triple buffer: one writer publishes complete values, one reader takes the latest published one
+// neither side ever waits, the writer always has a buffer to itself and the reader keeps its buffer until it takes a newer one
+template<class T>
+class TripleBuffer {
+public:
+	// writer only, the buffer to fill before publish()
+	inline T& back() {
+		return buffers[backIndex];
+	}
+	// writer only, swaps the filled buffer with the shared one
+	inline void publish() {
+		backIndex = shared.exchange(backIndex | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+	// writer only, false until the reader has taken the last published value (publishing again would only replace it)
+	inline bool taken() {
+		return !(shared.load(std::memory_order_relaxed) & FRESH);
+	}
+	// heap bytes of all three buffers (T::memoryBytes), the reader may be using one of them
+	inline size_t memoryBytes() const {
+		return buffers[0].memoryBytes() + buffers[1].memoryBytes() + buffers[2].memoryBytes();
+	}
+
+	// reader only, the latest published value (stays valid and unchanged until the next call)
+	inline const T& front() {
+		if (shared.load(std::memory_order_relaxed) & FRESH) {
+			frontIndex = shared.exchange(frontIndex, std::memory_order_acq_rel) & INDEX;
+		}
+		return buffers[frontIndex];
+	}
+private:
+	static constexpr int INDEX = 3;
+	static constexpr int FRESH = 4;
+
+	T buffers[3];
+	int backIndex = 0;
+	alignas(64) std::atomic<int> shared{ 1 };
+	alignas(64) int frontIndex = 2;
+};
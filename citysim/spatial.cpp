@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include "spatial.h"
+
+void SpatialGrid::build(const std::vector<Vector2f>& points) {
+	Vector2f lower(FLT_MAX, FLT_MAX);
+	Vector2f upper(-FLT_MAX, -FLT_MAX);
+	for (const Vector2f& p : points) {
+		lower.x = std::min(lower.x, p.x);
+		lower.y = std::min(lower.y, p.y);
+		upper.x = std::max(upper.x, p.x);
+		upper.y = std::max(upper.y, p.y);
+	}
+	if (points.empty()) {
+		lower = upper = Vector2f(0, 0);
+	}
+
+	// square cells holding SPATIAL_CELL_POINTS points on average if the points were spread evenly over the bounding box
+	float width = std::max(upper.x - lower.x, 1.0f);
+	float height = std::max(upper.y - lower.y, 1.0f);
+	cellSize = std::sqrt(width * height * SPATIAL_CELL_POINTS / std::max(points.size(), size_t(1)));
+	cellSize = std::max(cellSize, std::max(width, height) / SPATIAL_MAX_CELLS_PER_AXIS);
+	inverseCellSize = 1.0f / cellSize;
+	origin = lower;
+	cols = int(width * inverseCellSize) + 1;
+	rows = int(height * inverseCellSize) + 1;
+
+	// counting sort by cell
+	std::vector<uint32_t> cells(points.size());
+	offsets.assign(size_t(cols) * rows + 1, 0);
+	for (size_t i = 0; i < points.size(); i++) {
+		cells[i] = uint32_t(cellY(points[i].y) * cols + cellX(points[i].x));
+		offsets[cells[i] + 1]++;
+	}
+	for (size_t c = 1; c < offsets.size(); c++) {
+		offsets[c] += offsets[c - 1];
+	}
+	indices.resize(points.size());
+	positions.resize(points.size());
+	std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < points.size(); i++) {
+		uint32_t slot = next[cells[i]]++;
+		indices[slot] = uint32_t(i);
+		positions[slot] = points[i];
+	}
+}
+
+void SpatialGrid::radius(Vector2f p, float r, std::vector<uint32_t>& out) const {
+	if (indices.empty() || !(r > 0)) return;
+	// cells overlapping the query's bounding box (empty if it misses the grid)
+	if (p.x + r < origin.x || p.y + r < origin.y || p.x - r > origin.x + cols * cellSize || p.y - r > origin.y + rows * cellSize) return;
+	int x0 = cellX(p.x - r);
+	int x1 = cellX(p.x + r);
+	int y0 = cellY(p.y - r);
+	int y1 = cellY(p.y + r);
+	float r2 = r * r;
+	for (int y = y0; y <= y1; y++) {
+		// cells of a row are adjacent, so the whole span is one run
+		uint32_t end = offsets[y * cols + x1 + 1];
+		for (uint32_t k = offsets[y * cols + x0]; k < end; k++) {
+			float dx = positions[k].x - p.x;
+			float dy = positions[k].y - p.y;
+			if (dx * dx + dy * dy < r2) {
+				out.push_back(indices[k]);
+			}
+		}
+	}
+}
+
+uint32_t SpatialGrid::nearest(Vector2f p, float maxDist) const {
+	uint32_t best = SPATIAL_NONE;
+	float bestDist2 = maxDist < FLT_MAX ? maxDist * maxDist : FLT_MAX;
+	int cx = cellX(p.x);
+	int cy = cellY(p.y);
+	int maxRing = std::max(cols, rows);
+	// visits rings of cells around the one containing (or closest to) p, a point in ring k is at least (k - 1) cells away
+	// (the bound is shaved a little, cellX rounding can put a point right on a cell border into the next cell)
+	for (int k = 0; k <= maxRing; k++) {
+		float ringDist = (k - 1) * cellSize * 0.999f;
+		if (k > 1 && ringDist * ringDist >= bestDist2) break;
+		for (int y = std::max(cy - k, 0); y <= std::min(cy + k, rows - 1); y++) {
+			bool edgeRow = y == cy - k || y == cy + k;
+			for (int x = std::max(cx - k, 0); x <= std::min(cx + k, cols - 1); x++) {
+				// inner rows only have their two end cells in the ring
+				if (!edgeRow && x != cx - k && x != cx + k) {
+					x = cx + k - 1;
+					continue;
+				}
+				int cell = y * cols + x;
+				for (uint32_t i = offsets[cell]; i < offsets[cell + 1]; i++) {
+					float dx = positions[i].x - p.x;
+					float dy = positions[i].y - p.y;
+					float d2 = dx * dx + dy * dy;
+					if (d2 < bestDist2 || (d2 == bestDist2 && best != SPATIAL_NONE && indices[i] < best)) {
+						bestDist2 = d2;
+						best = indices[i];
+					}
+				}
+			}
+		}
+	}
+	return best;
+}
+
+int SpatialGrid::check(const std::vector<Vector2f>& points, float r, int queries, uint64_t seed) const {
+	int mismatches = 0;
+	std::vector<uint32_t> found;
+	std::vector<uint32_t> expected;
+	for (size_t i = 0; i < points.size(); i++) {
+		found.clear();
+		expected.clear();
+		radius(points[i], r, found);
+		for (size_t j = 0; j < points.size(); j++) {
+			float dx = points[j].x - points[i].x;
+			float dy = points[j].y - points[i].y;
+			if (dx * dx + dy * dy < r * r) expected.push_back(uint32_t(j));
+		}
+		std::sort(found.begin(), found.end());
+		if (found != expected) mismatches++;
+	}
+
+	// query positions spread a little past the points' bounding box, so misses and clamped cells are covered too
+	std::mt19937_64 rng(seed);
+	float margin = cellSize * 2;
+	std::uniform_real_distribution<float> xs(origin.x - margin, origin.x + cols * cellSize + margin);
+	std::uniform_real_distribution<float> ys(origin.y - margin, origin.y + rows * cellSize + margin);
+	std::uniform_real_distribution<float> ds(0.0f, cellSize * 3);
+	for (int q = 0; q < queries; q++) {
+		Vector2f p(xs(rng), ys(rng));
+		float maxDist = q % 2 == 0 ? FLT_MAX : ds(rng);
+		uint32_t best = SPATIAL_NONE;
+		float bestDist2 = maxDist < FLT_MAX ? maxDist * maxDist : FLT_MAX;
+		for (size_t j = 0; j < points.size(); j++) {
+			float dx = points[j].x - p.x;
+			float dy = points[j].y - p.y;
+			float d2 = dx * dx + dy * dy;
+			if (d2 < bestDist2) {
+				bestDist2 = d2;
+				best = uint32_t(j);
+			}
+		}
+		if (nearest(p, maxDist) != best) mismatches++;
+	}
+	return mismatches;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include "macros.h"
+
+typedef sf::Vector2f Vector2f;
+
+#define SPATIAL_NONE				UINT32_MAX // nearest() found no point
+
+// static point index over a uniform grid sized from the points' bounding box
+// points are bucketed with a counting sort and stored cell by cell (CSR), so building is O(n) and a cell is one contiguous run
+// queries are exact for any radius, they visit every cell the query can reach instead of a fixed neighborhood
+class SpatialGrid {
+public:
+	// indexes points[i] as i (about SPATIAL_CELL_POINTS points per cell), replaces any previous contents
+	void build(const std::vector<Vector2f>& points);
+
+	// appends the index of every point closer than r to p (in no particular order)
+	void radius(Vector2f p, float r, std::vector<uint32_t>& out) const;
+	// index of the point closest to p if it is closer than maxDist, SPATIAL_NONE otherwise
+	uint32_t nearest(Vector2f p, float maxDist = FLT_MAX) const;
+
+	// compares radius queries around every point and nearest queries at random positions against a linear scan
+	// returns the number of queries that disagree (0 if the index is correct)
+	int check(const std::vector<Vector2f>& points, float r, int queries, uint64_t seed) const;
+
+	inline size_t size() const {
+		return indices.size();
+	}
+	inline int numCells() const {
+		return cols * rows;
+	}
+	inline size_t memoryBytes() const {
+		return offsets.capacity() * sizeof(uint32_t) + indices.capacity() * sizeof(uint32_t) + positions.capacity() * sizeof(Vector2f);
+	}
+private:
+	Vector2f origin;
+	float cellSize = 1.0f;
+	float inverseCellSize = 1.0f;
+	int cols = 0;
+	int rows = 0;
+	std::vector<uint32_t> offsets; // points of cell (x, y) are [offsets[y * cols + x], offsets[y * cols + x + 1])
+	std::vector<uint32_t> indices; // point index, in cell order
+	std::vector<Vector2f> positions; // point position, in cell order (queries never touch the caller's array)
+
+	// cell column/row of a coordinate, clamped to the grid
+	inline int cellX(float x) const {
+		float c = (x - origin.x) * inverseCellSize;
+		return c < 1.0f ? 0 : c >= float(cols) ? cols - 1 : int(c);
+	}
+	inline int cellY(float y) const {
+		float c = (y - origin.y) * inverseCellSize;
+		return c < 1.0f ? 0 : c >= float(rows) ? rows - 1 : int(c);
+	}
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// bounded lock-free multi-producer single-consumer ring (Vyukov's bounded queue, one consumer)
+// producers copy a finished value into a slot before publishing it, so the consumer never sees a half-written value
+template<class T>
+class SpawnQueue {
+public:
+	// capacity must be a power of two
+	explicit SpawnQueue(size_t capacity) : cells(new Cell[capacity]), mask(capacity - 1), head(0), tail(0) {
+		for (size_t i = 0; i < capacity; i++) {
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	// safe from any number of threads, returns false if the ring is full
+	bool push(const T& value) {
+		size_t pos = tail.load(std::memory_order_relaxed);
+		while (true) {
+			Cell& cell = cells[pos & mask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			intptr_t diff = intptr_t(sequence) - intptr_t(pos);
+			if (diff == 0) {
+				// slot is free for this lap, claim it
+				if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					cell.value = value;
+					cell.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0) {
+				// the consumer has not freed this slot since the last lap
+				return false;
+			}
+			else {
+				pos = tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// consumer thread only, returns false if the next slot has not been published yet
+	bool pop(T& value) {
+		size_t pos = head.load(std::memory_order_relaxed);
+		Cell& cell = cells[pos & mask];
+		size_t sequence = cell.sequence.load(std::memory_order_acquire);
+		if (intptr_t(sequence) - intptr_t(pos + 1) < 0) {
+			return false;
+		}
+		value = cell.value;
+		cell.sequence.store(pos + mask + 1, std::memory_order_release);
+		head.store(pos + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// values claimed but not popped yet, only a hint while producers are running
+	inline size_t size() {
+		size_t h = head.load(std::memory_order_relaxed);
+		size_t t = tail.load(std::memory_order_relaxed);
+		return t > h ? t - h : 0;
+	}
+
+	inline size_t capacity() {
+		return mask + 1;
+	}
+	inline size_t memoryBytes() {
+		return capacity() * sizeof(Cell);
+	}
+private:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T value;
+	};
+	std::unique_ptr<Cell[]> cells;
+	size_t mask;
+	alignas(64) std::atomic<size_t> head; // only written by the consumer
+	alignas(64) std::atomic<size_t> tail;
+};
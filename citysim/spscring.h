@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+// bounded lock-free single-producer single-consumer ring
+// the producer never waits: push fails when the consumer has fallen a whole ring behind
+template<class T>
+class SpscRing {
+public:
+	// capacity must be a power of two
+	explicit SpscRing(size_t capacity) : values(new T[capacity]), mask(capacity - 1), head(0), tail(0) {}
+
+	// producer thread only, returns false if the ring is full
+	bool push(const T& value) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) > mask) {
+			return false;
+		}
+		values[t & mask] = value;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+	// same, but moves value into the ring (value is left untouched if the ring is full)
+	bool push(T&& value) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) > mask) {
+			return false;
+		}
+		values[t & mask] = std::move(value);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer thread only, returns false if the ring is empty
+	bool pop(T& value) {
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		value = std::move(values[h & mask]);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	// only a hint while the other side is running
+	inline size_t size() {
+		return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_relaxed);
+	}
+
+	inline size_t capacity() {
+		return mask + 1;
+	}
+private:
+	std::unique_ptr<T[]> values;
+	size_t mask;
+	alignas(64) std::atomic<size_t> head; // only written by the consumer
+	alignas(64) std::atomic<size_t> tail; // only written by the producer
+};
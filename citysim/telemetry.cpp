@@ -0,0 +1,62 @@
+#include <chrono>
+#include <iostream>
+#include "telemetry.h"
+
+static const char* STATUS_NAMES[STATUS_COUNT] = { "status_despawned", "status_spawned", "status_in_transit", "status_at_stop", "status_transfer", "status_walk", "status_boarded" };
+
+Telemetry::Telemetry() : ring(TELEMETRY_RING_SIZE) {}
+
+Telemetry::~Telemetry() {
+	close();
+}
+
+int Telemetry::open(const std::string& filename) {
+	out.open(filename, std::ios::trunc);
+	if (!out.is_open()) {
+		std::cerr << "Error opening " << filename << std::endl;
+		return ERROR_OPENING_FILE;
+	}
+	out << "tick,time,tick_us,citizens";
+	for (int s = 0; s < STATUS_COUNT; s++) {
+		out << "," << STATUS_NAMES[s];
+	}
+	out << ",spawned,despawned,queued,path_requests,path_cache_hits,path_fails,trains,riders,max_load\n";
+
+	running = true;
+	writer = std::thread(&Telemetry::writerThread, this);
+	return AOK;
+}
+
+void Telemetry::close() {
+	if (!running) return;
+	running = false;
+	writer.join();
+	out.flush();
+	out.close();
+}
+
+void Telemetry::writerThread() {
+	TelemetryRecord r;
+	while (true) {
+		// checked before draining, so records pushed before close() are always written
+		bool stopping = !running;
+		while (ring.pop(r)) {
+			write(r);
+		}
+		if (stopping) break;
+		// batches of rows go out together, the ring absorbs TELEMETRY_RING_SIZE ticks in between
+		out.flush();
+		std::this_thread::sleep_for(std::chrono::milliseconds(TELEMETRY_FLUSH_MS));
+	}
+}
+
+void Telemetry::write(const TelemetryRecord& r) {
+	out << r.tick << "," << r.time << "," << r.tickMicros << "," << r.citizens;
+	for (int s = 0; s < STATUS_COUNT; s++) {
+		out << "," << r.status[s];
+	}
+	out << "," << r.spawned << "," << r.despawned << "," << r.queued;
+	out << "," << r.pathRequests << "," << r.pathCacheHits << "," << r.pathFails;
+	out << "," << r.trains << "," << r.riders << "," << r.maxLoad << "\n";
+	written++;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include "macros.h"
+#include "spscring.h"
+
+// metrics of one simulation tick (counters marked cumulative are totals since the start of the run)
+struct TelemetryRecord {
+	uint64_t tick;
+	uint32_t time; // ticks since midnight of the first day (simTime)
+	float tickMicros; // wall time spent on the tick
+	uint32_t citizens; // active citizens after the tick
+	uint32_t status[STATUS_COUNT]; // citizen slots per status flag after the tick (see macros.h, despawned slots wait for reuse)
+	uint32_t spawned; // citizens drained from the spawn queue this tick
+	uint32_t despawned; // citizens that finished (or were culled) this tick
+	uint32_t queued; // citizens waiting in the spawn queue after the tick
+	uint32_t pathRequests; // cumulative
+	uint32_t pathCacheHits; // cumulative
+	uint32_t pathFails; // cumulative
+	uint32_t trains; // trains running
+	uint32_t riders; // citizens on board of all trains
+	uint32_t maxLoad; // citizens on board of the fullest train
+};
+
+// streams TelemetryRecords to a CSV file (one row per record) from a background writer thread
+// the simulation only copies a record into a fixed-size ring, records are dropped (and counted) if the writer falls behind
+class Telemetry {
+public:
+	Telemetry();
+	Telemetry(const Telemetry&) = delete;
+	Telemetry& operator=(const Telemetry&) = delete;
+	~Telemetry();
+
+	// creates filename, writes the header row and starts the writer
+	int open(const std::string& filename);
+	// simulation thread only, never blocks
+	inline void record(const TelemetryRecord& r) {
+		if (!ring.push(r)) dropped++;
+	}
+	// writes every record still in the ring and stops the writer
+	void close();
+
+	inline uint64_t recordsWritten() {
+		return written;
+	}
+	inline uint64_t recordsDropped() {
+		return dropped;
+	}
+	inline size_t memoryBytes() {
+		return ring.capacity() * sizeof(TelemetryRecord);
+	}
+private:
+	SpscRing<TelemetryRecord> ring;
+	std::ofstream out;
+	std::thread writer;
+	std::atomic<bool> running{ false };
+	std::atomic<uint64_t> written{ 0 };
+	std::atomic<uint64_t> dropped{ 0 };
+
+	void writerThread();
+	void write(const TelemetryRecord& r);
+};
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "timetable.h"
+#include "node.h"
+#include "util.h"
+
+// [start, end) time of day with a fixed headway (0 = no service)
+struct HeadwayBand {
+	unsigned int start;
+	unsigned int end;
+	unsigned int headway;
+};
+
+// parses "hh:mm" into ticks since midnight
+static unsigned int parseTime(const std::string& cell) {
+	size_t sep = cell.find(':');
+	int hours = std::stoi(cell.substr(0, sep));
+	int minutes = sep == std::string::npos ? 0 : std::stoi(cell.substr(sep + 1));
+	return (hours * 60 + minutes) * TICKS_PER_MINUTE;
+}
+
+bool TimetableRoute::popTrip(unsigned int now, unsigned int* start) {
+	while (numTrips > 0) {
+		unsigned long long day = nextTrip / numTrips;
+		unsigned int s = (unsigned int)(day * SIM_DAY_TICKS) + departures[nextTrip % numTrips];
+		if (s > now) {
+			return false;
+		}
+		nextTrip++;
+		if (s + duration > now) {
+			*start = s;
+			return true;
+		}
+	}
+	return false;
+}
+
+int Timetable::load(const std::string& filename, Line* lines, int numLines) {
+	// inputs per route (line index * 2 + direction)
+	std::vector<std::vector<HeadwayBand>> bands(numLines * 2);
+	std::vector<std::vector<int>> runTimes(numLines * 2);
+	std::vector<int> dwells(numLines * 2, TRAIN_DWELL_TIME);
+
+	// parse [H, line, F/B, start, end, headway], [R, line, F/B, {run times}], [D, line, F/B, dwell]
+	std::ifstream timetableCSV(filename);
+	if (!timetableCSV.is_open()) {
+		std::cout << "No " << filename << " found, using default headways" << std::endl;
+	}
+	else {
+		std::cout << "Reading " << filename << std::endl;
+		std::string fileLine;
+		while (std::getline(timetableCSV, fileLine)) {
+			if (fileLine.empty() || fileLine[0] == '#') continue;
+
+			std::stringstream lineStream(fileLine);
+			std::string cell;
+			std::vector<std::string> cells;
+			while (std::getline(lineStream, cell, ',')) {
+				cells.push_back(cell);
+			}
+			if (cells.size() < 4) continue;
+
+			int l = 0;
+			while (l < numLines && std::strcmp(lines[l].id, cells[1].c_str()) != 0) l++;
+			if (l == numLines) {
+				std::cout << "WARN: timetable references unknown line " << cells[1] << std::endl;
+				continue;
+			}
+			int r = l * 2 + (cells[2] == "B" ? 1 : 0);
+
+			switch (cells[0][0]) {
+			case 'H': // headway (minutes) during a time band
+				if (cells.size() >= 6) {
+					bands[r].push_back({ parseTime(cells[3]), parseTime(cells[4]), (unsigned int)std::stoi(cells[5]) * TICKS_PER_MINUTE });
+				}
+				break;
+			case 'R': // run times (ticks) for each segment, in line order
+				for (size_t i = 3; i < cells.size(); i++) {
+					runTimes[r].push_back(std::stoi(cells[i]));
+				}
+				break;
+			case 'D': // dwell time (ticks) at every stop
+				dwells[r] = std::stoi(cells[3]);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+	#if PLATFORM_STRESS_TEST == true
+	// replace the service of every route through a hub with high frequency, long dwell service
+	int stressedLines = 0;
+	for (int l = 0; l < numLines; l++) {
+		bool servesHub = false;
+		for (int i = 0; i < lines[l].size; i++) {
+			servesHub |= lines[l].path[i]->platforms.size() / 2 >= PLATFORM_STRESS_HUB_LINES;
+		}
+		if (!servesHub) continue;
+		for (int d = 0; d < 2; d++) {
+			bands[l * 2 + d] = { { 0, SIM_DAY_TICKS, PLATFORM_STRESS_HEADWAY * TICKS_PER_MINUTE } };
+			dwells[l * 2 + d] = PLATFORM_STRESS_DWELL;
+		}
+		stressedLines++;
+	}
+	std::cout << "Platform stress test: " << stressedLines << " lines through hubs run every " << PLATFORM_STRESS_HEADWAY << " min" << std::endl;
+	#endif
+
+	// compile offsets, departures and per-stop arrival tables
+	routes.clear();
+	routes.reserve(numLines * 2);
+	size_t totalTrips = 0;
+	for (int l = 0; l < numLines; l++) {
+		Line& line = lines[l];
+		for (int d = 0; d < 2; d++) {
+			int r = l * 2 + d;
+			line.routes[d] = int(routes.size());
+
+			TimetableRoute route;
+			route.line = &line;
+			route.direction = d == 0 ? STATUS_FORWARD : STATUS_BACKWARD;
+			route.numStops = line.size;
+			route.dwell = std::max(dwells[r], 1);
+			route.nextTrip = 0;
+
+			// directions without their own run times share the other direction's
+			std::vector<int>& runs = runTimes[r].empty() ? runTimes[r ^ 1] : runTimes[r];
+			unsigned int t = 0;
+			for (int k = 0; k < route.numStops; k++) {
+				route.arriveOffset.push_back(t);
+				t += route.dwell;
+				route.departOffset.push_back(t);
+				if (k + 1 < route.numStops) {
+					// accelerate/cruise/decelerate over the track length, stretched to the timetable's run time if it has one
+					int segment = route.pathIndex(k) - (d == 0 ? 0 : 1);
+					Segment& track = line.segments[segment];
+					float accel = track.accel > 0 ? track.accel : TRAIN_ACCEL;
+					float decel = track.decel > 0 ? track.decel : TRAIN_DECEL;
+					KinematicProfile profile;
+					profile.build(line.dist[segment], track.maxSpeed > 0 ? track.maxSpeed : TRAIN_MAX_SPEED, d == 0 ? accel : decel, d == 0 ? decel : accel);
+					if (segment < int(runs.size()) && runs[segment] > 0) {
+						profile.fitTime(float(runs[segment]));
+					}
+					route.profiles.push_back(profile);
+					t += std::max(int(std::ceil(profile.duration())), 1);
+				}
+			}
+			route.duration = t;
+
+			// step through the day, switching headway whenever a new band starts
+			std::vector<HeadwayBand>& routeBands = bands[r];
+			unsigned int tick = 0;
+			while (tick < SIM_DAY_TICKS) {
+				unsigned int headway = TIMETABLE_DEFAULT_HEADWAY * TICKS_PER_MINUTE;
+				unsigned int bandEnd = SIM_DAY_TICKS;
+				for (HeadwayBand& band : routeBands) {
+					if (band.start <= tick && tick < band.end) {
+						headway = band.headway;
+						bandEnd = band.end;
+						break;
+					}
+					if (band.start > tick) {
+						bandEnd = std::min(bandEnd, band.start);
+					}
+				}
+				if (headway == 0) {
+					tick = bandEnd;
+					continue;
+				}
+				route.departures.push_back(tick);
+				tick += headway;
+			}
+			route.numTrips = int(route.departures.size());
+			totalTrips += route.numTrips;
+
+			route.arrivals.resize(size_t(route.numStops) * route.numTrips);
+			for (int k = 0; k < route.numStops; k++) {
+				for (int i = 0; i < route.numTrips; i++) {
+					route.arrivals[size_t(k) * route.numTrips + i] = route.departures[i] + route.arriveOffset[k];
+				}
+			}
+
+			routes.push_back(route);
+		}
+	}
+
+	std::cout << "Compiled timetable: " << routes.size() << " routes, " << totalTrips << " trips/day" << std::endl;
+	return AOK;
+}
+
+unsigned int Timetable::nextTrain(Line* line, char direction, int pathIndex, unsigned int now) {
+	TimetableRoute& route = routes[line->routes[direction == STATUS_FORWARD ? 0 : 1]];
+	if (route.numTrips == 0) {
+		return now + SIM_DAY_TICKS;
+	}
+
+	const unsigned int* stopArrivals = &route.arrivals[size_t(route.pathIndex(pathIndex)) * route.numTrips];
+	const unsigned int* stopArrivalsEnd = stopArrivals + route.numTrips;
+	unsigned int t = now % SIM_DAY_TICKS;
+	unsigned int base = now - t;
+
+	// trains that arrived less than dwell ticks ago are still at the stop
+	unsigned int from = t + 1 > unsigned(route.dwell) ? t + 1 - route.dwell : 0;
+
+	// first train tomorrow, unless something earlier turns up
+	unsigned int best = base + SIM_DAY_TICKS + stopArrivals[0];
+	const unsigned int* it = std::lower_bound(stopArrivals, stopArrivalsEnd, from);
+	if (it != stopArrivalsEnd) {
+		best = std::min(best, base + *it);
+	}
+	// yesterday's trips running past midnight
+	if (base >= SIM_DAY_TICKS) {
+		it = std::lower_bound(stopArrivals, stopArrivalsEnd, from + SIM_DAY_TICKS);
+		if (it != stopArrivalsEnd) {
+			best = std::min(best, base - SIM_DAY_TICKS + *it);
+		}
+	}
+	return std::max(best, now);
+}
+
+size_t Timetable::memoryBytes() const {
+	size_t bytes = util::vectorBytes(routes);
+	for (const TimetableRoute& r : routes) {
+		bytes += util::vectorBytes(r.arriveOffset) + util::vectorBytes(r.departOffset) + util::vectorBytes(r.profiles)
+			+ util::vectorBytes(r.departures) + util::vectorBytes(r.arrivals);
+	}
+	return bytes;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "macros.h"
+#include "line.h"
+#include "geometry.h"
+
+// service pattern of one line in one direction, compiled from timetable.csv
+struct TimetableRoute {
+	Line* line;
+	char direction; // STATUS_FORWARD runs along line->path, STATUS_BACKWARD runs it in reverse
+	int numStops;
+	int numTrips; // trips per day
+	int dwell; // ticks spent at each stop
+	unsigned int duration; // ticks from arriving at the first stop to leaving the last one
+	unsigned long long nextTrip; // next trip to start, counted across days (day * numTrips + trip)
+
+	// all offsets are in ticks after the trip reached its first stop, indexed in travel order
+	std::vector<unsigned int> arriveOffset;
+	std::vector<unsigned int> departOffset;
+	std::vector<KinematicProfile> profiles; // profiles[k] covers the run from stop k to stop k + 1
+	std::vector<unsigned int> departures; // first stop arrival of every trip (ticks since midnight), sorted
+	std::vector<unsigned int> arrivals; // arrivals[k * numTrips + i] is when trip i reaches stop k, sorted per stop (can exceed SIM_DAY_TICKS)
+
+	// converts between travel order and line->path order (works both ways)
+	inline int pathIndex(int k) {
+		return direction == STATUS_FORWARD ? k : numStops - 1 - k;
+	}
+
+	// last stop (travel order) reached elapsed ticks into a trip, searching forward from hint
+	inline int stopAt(unsigned int elapsed, int hint) {
+		int k = (hint >= 0 && arriveOffset[hint] <= elapsed) ? hint : 0;
+		while (k + 1 < numStops && arriveOffset[k + 1] <= elapsed) k++;
+		return k;
+	}
+
+	// pops the next trip if it has started by now (trips that already finished are skipped)
+	bool popTrip(unsigned int now, unsigned int* start);
+};
+
+class Timetable {
+public:
+	std::vector<TimetableRoute> routes;
+
+	// reads headways, run times and dwell times, then compiles them into per-stop arrival tables
+	// lines, bands or segments missing from the file fall back to defaults (see macros.h)
+	int load(const std::string& filename, Line* lines, int numLines);
+
+	// earliest tick at or after now when a train of line (running in direction) is at the stop at pathIndex
+	unsigned int nextTrain(Line* line, char direction, int pathIndex, unsigned int now);
+
+	// heap bytes held by the arrival tables and profiles of every route
+	size_t memoryBytes() const;
+};
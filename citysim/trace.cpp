@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include "trace.h"
+
+static thread_local void* threadRing = nullptr; // this thread's ring of the (only) Tracer
+
+Tracer::Tracer() {
+	epoch = std::chrono::steady_clock::now();
+}
+
+Tracer::ThreadRing& Tracer::ring() {
+	if (threadRing == nullptr) {
+		std::lock_guard<std::mutex> ringsLock(ringsMutex);
+		rings.emplace_back(new ThreadRing());
+		ThreadRing& r = *rings.back();
+		r.id = uint32_t(rings.size());
+		r.name = "thread " + std::to_string(r.id);
+		r.events.resize(TRACE_RING_EVENTS);
+		threadRing = &r;
+	}
+	return *static_cast<ThreadRing*>(threadRing);
+}
+
+void Tracer::nameThread(const std::string& name) {
+	ring().name = name;
+}
+
+void Tracer::slice(const char* name, const char* category, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+	push(ring(), { name, category, since(start), since(end) - since(start), false });
+}
+
+void Tracer::instant(const char* name, const char* category) {
+	push(ring(), { name, category, since(std::chrono::steady_clock::now()), 0, true });
+}
+
+static void writeString(std::ofstream& out, const std::string& s) {
+	out << '"';
+	for (char c : s) {
+		if (c == '"' || c == '\\') out << '\\';
+		if (c >= 0 && c < 0x20) continue;
+		out << c;
+	}
+	out << '"';
+}
+
+int Tracer::write(const std::string& filename) {
+	std::ofstream out(filename, std::ios::trunc);
+	if (!out) {
+		std::cerr << "Error opening " << filename << std::endl;
+		return ERROR_OPENING_FILE;
+	}
+	std::lock_guard<std::mutex> ringsLock(ringsMutex);
+	out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+	bool first = true;
+	uint64_t written = 0;
+	uint64_t overwritten = 0;
+	out.setf(std::ios::fixed);
+	out.precision(3);
+	for (std::unique_ptr<ThreadRing>& r : rings) {
+		out << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << r->id << ",\"args\":{\"name\":";
+		writeString(out, r->name);
+		out << "}}";
+		first = false;
+
+		uint64_t kept = std::min(r->next, uint64_t(TRACE_RING_EVENTS));
+		overwritten += r->next - kept;
+		for (uint64_t i = r->next - kept; i < r->next; i++) {
+			const TraceEvent& e = r->events[i & (TRACE_RING_EVENTS - 1)];
+			// Chrome timestamps are microseconds
+			out << ",\n{\"ph\":\"" << (e.instant ? "i" : "X") << "\",\"name\":\"" << e.name << "\",\"cat\":\"" << e.category
+				<< "\",\"pid\":1,\"tid\":" << r->id << ",\"ts\":" << e.start / 1e3;
+			if (e.instant) out << ",\"s\":\"t\"}";
+			else out << ",\"dur\":" << e.duration / 1e3 << "}";
+			written++;
+		}
+	}
+	out << "\n]}\n";
+	std::cout << "Trace: " << written << " events of " << rings.size() << " threads written to " << filename << " (" << overwritten << " overwritten)" << std::endl;
+	return AOK;
+}
+
+size_t Tracer::memoryBytes() {
+	std::lock_guard<std::mutex> ringsLock(ringsMutex);
+	return rings.size() * (sizeof(ThreadRing) + TRACE_RING_EVENTS * sizeof(TraceEvent));
+}
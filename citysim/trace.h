@@ -0,0 +1,91 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "macros.h"
+
+// one slice (or instant, duration 0) of a thread's timeline, names and categories must be string literals
+struct TraceEvent {
+	const char* name;
+	const char* category;
+	uint64_t start; // nanoseconds since the tracer was created
+	uint64_t duration;
+	bool instant;
+};
+
+// records the timelines of every thread into per-thread rings and writes them as Chrome trace-event JSON (opens in Perfetto or chrome://tracing)
+// a ring keeps the last TRACE_RING_EVENTS events of its thread and overwrites older ones, so memory stays bounded however long the run
+// a thread only ever writes its own ring, the rings are only read by write() once every other thread has stopped
+// there is one Tracer per program (rings are found through a thread_local)
+class Tracer {
+public:
+	Tracer();
+	Tracer(const Tracer&) = delete;
+	Tracer& operator=(const Tracer&) = delete;
+
+	// names the calling thread's timeline
+	void nameThread(const std::string& name);
+
+	void slice(const char* name, const char* category, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+	void instant(const char* name, const char* category);
+
+	// writes every ring (oldest event first) and the thread names to filename
+	int write(const std::string& filename);
+	// rings of every thread that has recorded an event
+	size_t memoryBytes();
+private:
+	struct ThreadRing {
+		std::string name;
+		uint32_t id;
+		uint64_t next = 0; // events ever recorded, the newest is at (next - 1) & mask
+		std::vector<TraceEvent> events;
+	};
+
+	std::chrono::steady_clock::time_point epoch;
+	std::mutex ringsMutex; // only taken when a thread records its first event
+	std::vector<std::unique_ptr<ThreadRing>> rings;
+
+	ThreadRing& ring();
+	inline uint64_t since(std::chrono::steady_clock::time_point t) {
+		return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(t - epoch).count());
+	}
+	inline void push(ThreadRing& r, const TraceEvent& e) {
+		r.events[r.next++ & (TRACE_RING_EVENTS - 1)] = e;
+	}
+};
+
+// records the scope it lives in as a slice of the calling thread's timeline
+// compiles to nothing unless TRACE is set
+class TraceScope {
+public:
+	inline TraceScope(Tracer& t, const char* n, const char* c) {
+		#if TRACE == true
+		tracer = &t;
+		name = n;
+		category = c;
+		start = std::chrono::steady_clock::now();
+		#else
+		(void)t;
+		(void)n;
+		(void)c;
+		#endif
+	}
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+	inline ~TraceScope() {
+		#if TRACE == true
+		tracer->slice(name, category, start, std::chrono::steady_clock::now());
+		#endif
+	}
+private:
+	#if TRACE == true
+	Tracer* tracer;
+	const char* name;
+	const char* category;
+	std::chrono::steady_clock::time_point start;
+	#endif
+};
@@ -1,102 +1,216 @@
 #include "train.h"
+#include "checkpoint.h"
+#include "heatmap.h"
+#include "util.h"
 
-// aah, this whole class is so confusing! why did i do this?
-Train::Train() {
-	 Drawable(TRAIN_MIN_SIZE, TRAIN_N_POINTS);
-}
+extern Timetable timetable;
+#if HEATMAP == true
+extern Heatmap heatmap;
+#endif
 
-Node* Train::getLastStop() {
-	return getStop(index);
+void TrainStore::reserve(size_t n) {
+	line.reserve(n);
+	route.reserve(n);
+	start.reserve(n);
+	status.reserve(n);
+	statusForward.reserve(n);
+	index.reserve(n);
+	nextIndex.reserve(n);
+	capacity.reserve(n);
+	timer.reserve(n);
+	dist.reserve(n);
 }
 
-Node* Train::getCurrentStop() {
-	if (status == STATUS_IN_TRANSIT) {
-		return getNextStop();
+int TrainStore::add(int r, unsigned int tripStart) {
+	TimetableRoute& tripRoute = timetable.routes[r];
+	int t;
+	if (!freeIDs.empty()) {
+		t = freeIDs.back();
+		freeIDs.pop_back();
 	}
-	else if (status == STATUS_AT_STOP) {
-		return getLastStop();
+	else {
+		t = size();
+		line.push_back(nullptr);
+		route.push_back(0);
+		start.push_back(0);
+		status.push_back(STATUS_DESPAWNED);
+		statusForward.push_back(0);
+		index.push_back(0);
+		nextIndex.push_back(0);
+		capacity.push_back(0);
+		timer.push_back(0);
+		dist.push_back(0);
 	}
-	return nullptr;
+	// the first update places the train (and registers it at its stop)
+	line[t] = tripRoute.line;
+	route[t] = r;
+	start[t] = tripStart;
+	status[t] = STATUS_TRANSFER;
+	statusForward[t] = tripRoute.direction;
+	index[t] = tripRoute.pathIndex(0);
+	nextIndex[t] = index[t];
+	capacity[t] = 0;
+	timer[t] = 0;
+	dist[t] = 0;
+	return t;
 }
 
-Node* Train::getNextStop() {
-	return line->path[getNextIndex()];
+Node* TrainStore::getLastStop(int t) {
+	return getStop(t, index[t]);
 }
 
-int Train::getNextIndex(bool reversed) {
-	int increment = (statusForward == STATUS_FORWARD) ? 1 : -1;
-	if (reversed) increment *= -1;
-	if (index + increment < 0 || index + increment >= line->size) {
-		increment *= -1;
+void TrainStore::spawn(unsigned int now) {
+	for (int r = 0; r < int(timetable.routes.size()); r++) {
+		unsigned int tripStart;
+		while (timetable.routes[r].popTrip(now, &tripStart)) {
+			add(r, tripStart);
+		}
 	}
-	return index + increment;
 }
 
-int Train::getPrevIndex() {
-	return getNextIndex(true);
-}
+void TrainStore::update(int first, int last, unsigned int now, std::vector<TrainEvent>& events) {
+	for (int t = first; t < last; t++) {
+		if (status[t] == STATUS_DESPAWNED) continue;
 
-int Train::getCorrectNextIndex() {
-	if (statusForward == STATUS_FORWARD) {
-		return getNextIndex();
-	}
-	else {
-		return getNextIndex(true);
-	}
-}
+		TimetableRoute& tripRoute = timetable.routes[route[t]];
+		unsigned int elapsed = now - start[t];
 
-void Train::updatePositionAlongLine() {
-	timer += TRAIN_SPEED;
+		// left the last stop
+		if (elapsed >= tripRoute.duration) {
+			if (status[t] == STATUS_AT_STOP) {
+				events.push_back({ t, STATUS_IN_TRANSIT, index[t] });
+			}
+			events.push_back({ t, STATUS_DESPAWNED, index[t] });
+			status[t] = STATUS_DESPAWNED;
+			continue;
+		}
 
-	switch (status) {
-	case STATUS_DESPAWNED:
-		return;
-	case STATUS_TRANSFER:
-		if (statusForward == STATUS_FORWARD && index == line->size - 1) statusForward = STATUS_BACKWARD;
-		if (statusForward == STATUS_BACKWARD && index == 0) statusForward = STATUS_FORWARD;
+		// the stop index only moves forward, so searching from the current stop is O(1) per tick
+		int k = tripRoute.stopAt(elapsed, status[t] == STATUS_TRANSFER ? 0 : tripRoute.pathIndex(index[t]));
+		int stopIndex = tripRoute.pathIndex(k);
+		bool atStop = elapsed < tripRoute.departOffset[k];
 
-		if (statusForward == STATUS_FORWARD) {
-			dist = getDist(index);
+		if (status[t] == STATUS_AT_STOP && (!atStop || stopIndex != index[t])) {
+			events.push_back({ t, STATUS_IN_TRANSIT, index[t] });
+		}
+		if (atStop && (status[t] != STATUS_AT_STOP || stopIndex != index[t])) {
+			events.push_back({ t, STATUS_AT_STOP, stopIndex });
+		}
+
+		index[t] = stopIndex;
+		if (atStop) {
+			status[t] = STATUS_AT_STOP;
+			nextIndex[t] = stopIndex;
+			timer[t] = float(elapsed - tripRoute.arriveOffset[k]);
+			dist[t] = float(tripRoute.dwell);
 		}
 		else {
-			dist = getDist(getNextIndex());
+			status[t] = STATUS_IN_TRANSIT;
+			nextIndex[t] = tripRoute.pathIndex(k + 1);
+			timer[t] = float(elapsed - tripRoute.departOffset[k]);
+			dist[t] = float(tripRoute.arriveOffset[k + 1] - tripRoute.departOffset[k]);
 		}
-		nextIndex = getNextIndex();
-
-		status = STATUS_IN_TRANSIT;
-		break;
-	case STATUS_IN_TRANSIT:
-		// linearly interpolate position
-		setPosition(getStop(index)->lerp(timer / dist, getStop(nextIndex)));
-
-		// reached stop
-		if (timer > dist) {
-			if (getNextStop()->addTrain(this)) {
-				goTo(getCurrentStop());
-				index = nextIndex;
-				timer = 0;
-				status = STATUS_AT_STOP;
-			}
-			#if TRAIN_ERRORS == true
-			else {
-				std::cout << "ERR: failed to add [" << line->id << "] train to " << getNextStop()->id << std::endl;
-			}
+	}
+}
+
+void TrainStore::applyEvents(const std::vector<TrainEvent>& events) {
+	for (const TrainEvent& e : events) {
+		int t = e.train;
+		Node* stop = getStop(t, e.index);
+		switch (e.status) {
+		case STATUS_AT_STOP:
+			stop->addTrain(t, line[t]->platformIndex(e.index, statusForward[t]));
+			#if HEATMAP == true
+			heatmap.arrive(t);
 			#endif
-		}
-		break;
-	case STATUS_AT_STOP:
-		// done boarding/deboarding
-		if (timer > TRAIN_STOP_THRESH) {
-			if (getLastStop()->removeTrain(this)) {
-				timer = 0;
-				status = STATUS_TRANSFER;
-			}
-			#if TRAIN_ERRORS == true
-			else {
-				std::cout << "ERR: failed to remove [" << line->id << "] train from " << getLastStop()->id << std::endl;
+			break;
+		case STATUS_IN_TRANSIT:
+			if (!stop->removeTrain(t, line[t]->platformIndex(e.index, statusForward[t]))) {
+				#if TRAIN_ERRORS == true
+				std::cout << "ERR: failed to remove [" << line[t]->id << "] train from " << stop->id << std::endl;
+				#endif
 			}
+			#if HEATMAP == true
+			heatmap.depart(t, line[t], e.index, statusForward[t], capacity[t]);
+			#endif
+			break;
+		case STATUS_DESPAWNED:
+			freeIDs.push_back(t);
+			#if HEATMAP == true
+			heatmap.arrive(t);
 			#endif
+			break;
 		}
-		break;
 	}
-}
\ No newline at end of file
+}
+
+Vector2f TrainStore::getPosition(int t) {
+	if (status[t] != STATUS_IN_TRANSIT) {
+		return getLastStop(t)->getPosition();
+	}
+	// distance covered comes from the segment's precomputed profile, the point from its arc length table
+	TimetableRoute& tripRoute = timetable.routes[route[t]];
+	float s = tripRoute.profiles[tripRoute.pathIndex(index[t])].distanceAt(timer[t]) / DISTANCE_SCALE;
+	if (statusForward[t] == STATUS_FORWARD) {
+		return line[t]->segments[index[t]].polyline.at(s);
+	}
+	Polyline& track = line[t]->segments[nextIndex[t]].polyline;
+	return track.at(track.length() - s);
+}
+
+void TrainStore::save(CheckpointWriter& out) {
+	std::vector<int32_t> lineIndices;
+	for (Line* l : line) {
+		lineIndices.push_back(out.line(l));
+	}
+	out.put(lineIndices);
+	out.put(route);
+	out.put(start);
+	out.put(status);
+	out.put(statusForward);
+	out.put(index);
+	out.put(nextIndex);
+	out.put(capacity);
+	out.put(timer);
+	out.put(dist);
+	out.put(freeIDs);
+}
+
+bool TrainStore::restore(CheckpointReader& in) {
+	std::vector<int32_t> lineIndices;
+	in.get(lineIndices);
+	in.get(route);
+	in.get(start);
+	in.get(status);
+	in.get(statusForward);
+	in.get(index);
+	in.get(nextIndex);
+	in.get(capacity);
+	in.get(timer);
+	in.get(dist);
+	in.get(freeIDs);
+
+	size_t n = lineIndices.size();
+	if (route.size() != n || start.size() != n || status.size() != n || statusForward.size() != n || index.size() != n
+		|| nextIndex.size() != n || capacity.size() != n || timer.size() != n || dist.size() != n) {
+		in.fail();
+	}
+	line.assign(n, nullptr);
+	for (size_t t = 0; in.valid() && t < n; t++) {
+		line[t] = in.line(lineIndices[t]);
+		if (line[t] == nullptr || route[t] < 0 || route[t] >= int(timetable.routes.size())
+			|| index[t] < 0 || index[t] >= line[t]->size || nextIndex[t] < 0 || nextIndex[t] >= line[t]->size) {
+			in.fail();
+		}
+	}
+	for (int t : freeIDs) {
+		if (t < 0 || size_t(t) >= n) in.fail();
+	}
+	return in.valid();
+}
+
+size_t TrainStore::memoryBytes() const {
+	return util::vectorBytes(line) + util::vectorBytes(route) + util::vectorBytes(start) + util::vectorBytes(status)
+		+ util::vectorBytes(statusForward) + util::vectorBytes(index) + util::vectorBytes(nextIndex) + util::vectorBytes(capacity)
+		+ util::vectorBytes(timer) + util::vectorBytes(dist) + util::vectorBytes(freeIDs);
+}
@@ -2,39 +2,70 @@
 
 #include <SFML/Graphics.hpp>
 #include <iostream>
+#include <vector>
 #include "drawable.h"
 #include "macros.h"
 #include "line.h"
 #include "node.h"
+#include "timetable.h"
 class Node;
+class CheckpointWriter;
+class CheckpointReader;
 
-class Train : public Drawable {
+// stop arrival/departure found during a (parallel) train update, applied to nodes afterwards
+struct TrainEvent {
+	int train;
+	char status; // STATUS_AT_STOP (arrived), STATUS_IN_TRANSIT (departed) or STATUS_DESPAWNED (trip finished)
+	int index; // stop (line path index) the event happened at
+};
+
+// kinematic state of every train, stored as parallel arrays indexed by train id
+// each train runs one timetabled trip, so its state is a function of the trip start time and the current time
+class TrainStore {
 public:
-	Train();
-
-	char status;
-	char statusForward;
-	char index;
-	char nextIndex;
-	unsigned int capacity;
-	float timer;
-	float dist;
-	Line* line;
-
-	inline float getDist(char indx) {
-		return line->dist[indx];
+	std::vector<Line*> line;
+	std::vector<int> route; // see Timetable
+	std::vector<unsigned int> start; // tick the trip reached its first stop
+	std::vector<char> status;
+	std::vector<char> statusForward;
+	std::vector<int> index;
+	std::vector<int> nextIndex;
+	std::vector<unsigned int> capacity;
+	std::vector<float> timer; // ticks since arriving at (AT_STOP) or leaving (IN_TRANSIT) the last stop
+	std::vector<float> dist; // dwell time (AT_STOP) or run time (IN_TRANSIT) of the current stop/segment
+
+	void reserve(size_t n);
+	// reuses the id of a finished trip if there is one
+	int add(int r, unsigned int tripStart);
+
+	inline int size() {
+		return int(status.size());
+	}
+	inline int activeSize() {
+		return size() - int(freeIDs.size());
 	}
+	// heap bytes held by every column and the free ids
+	size_t memoryBytes() const;
 
-	inline Node* getStop(char indx) {
-		return line->path[indx];
+	inline Node* getStop(int t, int indx) {
+		return line[t]->path[indx];
 	}
-	Node* getLastStop();
-	Node* getCurrentStop();
-	Node* getNextStop();
+	Node* getLastStop(int t);
+
+	// starts every timetabled trip that has begun by now
+	void spawn(unsigned int now);
+	// moves trains [first, last) to where the timetable puts them at now, safe to run concurrently on disjoint ranges
+	// node arrivals/departures are only recorded in events, see applyEvents
+	void update(int first, int last, unsigned int now, std::vector<TrainEvent>& events);
+	// adds/removes trains to/from nodes and frees finished trips (must not run concurrently with itself or citizen updates)
+	void applyEvents(const std::vector<TrainEvent>& events);
 
-	int getNextIndex(bool reversed = false);
-	int getPrevIndex();
-	int getCorrectNextIndex();
+	// only needed for drawing, positions are not stored anywhere
+	Vector2f getPosition(int t);
 
-	void updatePositionAlongLine();
+	// every train's state and the free ids, lines as indices (see saveCheckpoint)
+	void save(CheckpointWriter& out);
+	bool restore(CheckpointReader& in);
+private:
+	std::vector<int> freeIDs;
 };
@@ -0,0 +1,432 @@
+#include <chrono>
+#include <iostream>
+#include "trajectory.h"
+#include "checkpoint.h"
+#include "line.h"
+#include "node.h"
+#include "train.h"
+#include "graph.h"
+#include "citizen.h"
+
+extern int VALID_NODES;
+extern std::vector<Line> lines;
+extern Line WALKING_LINE;
+extern TrainStore trains;
+extern CitizenVector citizens;
+extern long unsigned int simTick;
+
+#define LZ_MIN_MATCH		4
+#define LZ_HASH_BITS		14
+#define LZ_MAX_OFFSET		65535
+#define LZ_LAST_LITERALS	8 // the tail of a block is always stored as literals, so matches never read past the input
+
+static int32_t lineIndex(const Line* l) {
+	if (l == nullptr) return TRAJECTORY_NULL;
+	return l == &WALKING_LINE ? GRAPH_WALKING_LINE : int32_t(l - lines.data());
+}
+
+TrajectoryEvent trajectoryEvent(const Citizen& c, int index, uint64_t tick) {
+	TrajectoryEvent e;
+	e.tick = tick;
+	e.citizen = index;
+	e.node = c.currentNode == nullptr ? TRAJECTORY_NULL : c.currentNode->index;
+	// on board, currentLine is already the line taken after getting off
+	e.line = lineIndex(c.currentTrain != TRAIN_NONE ? trains.line[c.currentTrain] : c.currentLine);
+	e.status = uint8_t(c.status);
+	return e;
+}
+
+static void putVarint(std::vector<uint8_t>& out, uint64_t value) {
+	while (value >= 0x80) {
+		out.push_back(uint8_t(value) | 0x80);
+		value >>= 7;
+	}
+	out.push_back(uint8_t(value));
+}
+
+static bool getVarint(const uint8_t*& in, const uint8_t* end, uint64_t& value) {
+	value = 0;
+	for (int shift = 0; shift < 64 && in < end; shift += 7) {
+		uint8_t byte = *in++;
+		value |= uint64_t(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) return true;
+	}
+	return false;
+}
+
+static inline uint64_t zigzag(int64_t value) {
+	return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t value) {
+	return int64_t(value >> 1) ^ -int64_t(value & 1);
+}
+
+// per event: tick delta (zigzag) and status in one varint, citizen delta (zigzag), node and line (offset past TRAJECTORY_NULL)
+// events are sorted by tick and citizen within a tick, so both deltas are mostly a single byte
+static void encodeEvents(const std::vector<TrajectoryEvent>& events, uint64_t firstTick, std::vector<uint8_t>& out) {
+	uint64_t prevTick = firstTick;
+	int32_t prevCitizen = 0;
+	for (const TrajectoryEvent& e : events) {
+		putVarint(out, zigzag(int64_t(e.tick - prevTick)) << 3 | e.status);
+		putVarint(out, zigzag(int64_t(e.citizen) - prevCitizen));
+		putVarint(out, uint64_t(e.node - TRAJECTORY_NULL));
+		putVarint(out, uint64_t(e.line - TRAJECTORY_NULL));
+		prevTick = e.tick;
+		prevCitizen = e.citizen;
+	}
+}
+
+static bool decodeEvents(const uint8_t* in, size_t size, uint64_t firstTick, uint32_t count, uint32_t maxCitizens, std::vector<TrajectoryEvent>& events) {
+	const uint8_t* end = in + size;
+	uint64_t prevTick = firstTick;
+	int64_t prevCitizen = 0;
+	events.resize(count);
+	for (TrajectoryEvent& e : events) {
+		uint64_t tickStatus, citizen, node, line;
+		if (!getVarint(in, end, tickStatus) || !getVarint(in, end, citizen) || !getVarint(in, end, node) || !getVarint(in, end, line)) {
+			return false;
+		}
+		e.tick = prevTick + uint64_t(unzigzag(tickStatus >> 3));
+		e.status = uint8_t(tickStatus & 7);
+		int64_t c = prevCitizen + unzigzag(citizen);
+		if (c < 0 || c >= int64_t(maxCitizens) || e.status >= STATUS_COUNT) return false;
+		e.citizen = int32_t(c);
+		e.node = int32_t(int64_t(node) + TRAJECTORY_NULL);
+		e.line = int32_t(int64_t(line) + TRAJECTORY_NULL);
+		if (e.node >= VALID_NODES) return false;
+		prevTick = e.tick;
+		prevCitizen = c;
+	}
+	return in == end;
+}
+
+static inline uint32_t read32(const uint8_t* p) {
+	uint32_t value;
+	std::memcpy(&value, p, 4);
+	return value;
+}
+
+static void putLength(std::vector<uint8_t>& out, size_t length) {
+	while (length >= 255) {
+		out.push_back(255);
+		length -= 255;
+	}
+	out.push_back(uint8_t(length));
+}
+
+// LZ77 with a single-entry hash table (the LZ4 block format, minus its size limits)
+// sequences of [token: literal length << 4 | match length - LZ_MIN_MATCH][literals][16 bit offset], the last one has no match
+static void compress(const uint8_t* in, size_t size, std::vector<uint8_t>& out) {
+	std::vector<int64_t> table(size_t(1) << LZ_HASH_BITS, -1);
+	size_t anchor = 0;
+	size_t i = 0;
+	auto emit = [&](size_t literals, size_t match, size_t offset) {
+		size_t matchCode = match ? match - LZ_MIN_MATCH : 0;
+		out.push_back(uint8_t(std::min<size_t>(literals, 15) << 4 | std::min<size_t>(matchCode, 15)));
+		if (literals >= 15) putLength(out, literals - 15);
+		out.insert(out.end(), in + anchor, in + anchor + literals);
+		if (match == 0) return;
+		out.push_back(uint8_t(offset));
+		out.push_back(uint8_t(offset >> 8));
+		if (matchCode >= 15) putLength(out, matchCode - 15);
+	};
+	while (size >= LZ_LAST_LITERALS && i + LZ_LAST_LITERALS <= size) {
+		uint32_t word = read32(in + i);
+		uint32_t hash = (word * 2654435761u) >> (32 - LZ_HASH_BITS);
+		int64_t candidate = table[hash];
+		table[hash] = int64_t(i);
+		if (candidate < 0 || i - size_t(candidate) > LZ_MAX_OFFSET || read32(in + candidate) != word) {
+			i++;
+			continue;
+		}
+		size_t match = LZ_MIN_MATCH;
+		while (i + match + LZ_LAST_LITERALS <= size && in[candidate + match] == in[i + match]) {
+			match++;
+		}
+		emit(i - anchor, match, i - size_t(candidate));
+		i += match;
+		anchor = i;
+	}
+	emit(size - anchor, 0, 0);
+}
+
+static bool decompress(const uint8_t* in, size_t size, uint8_t* out, size_t outSize) {
+	const uint8_t* end = in + size;
+	size_t o = 0;
+	auto getLength = [&](size_t& length) {
+		uint8_t byte;
+		do {
+			if (in >= end) return false;
+			byte = *in++;
+			length += byte;
+		} while (byte == 255);
+		return true;
+	};
+	while (in < end) {
+		uint8_t token = *in++;
+		size_t literals = token >> 4;
+		if (literals == 15 && !getLength(literals)) return false;
+		if (literals > size_t(end - in) || literals > outSize - o) return false;
+		std::memcpy(out + o, in, literals);
+		in += literals;
+		o += literals;
+		if (in == end) break;
+
+		if (end - in < 2) return false;
+		size_t offset = size_t(in[0]) | size_t(in[1]) << 8;
+		in += 2;
+		size_t match = token & 15;
+		if (match == 15 && !getLength(match)) return false;
+		match += LZ_MIN_MATCH;
+		if (offset == 0 || offset > o || match > outSize - o) return false;
+		// byte by byte, matches may overlap their own output
+		for (size_t k = 0; k < match; k++, o++) {
+			out[o] = out[o - offset];
+		}
+	}
+	return o == outSize;
+}
+
+Trajectory::Trajectory() : ring(TRAJECTORY_RING_SIZE) {}
+
+Trajectory::~Trajectory() {
+	close();
+}
+
+int Trajectory::open(const std::string& filename) {
+	out.open(filename, std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) {
+		std::cerr << "Error opening " << filename << std::endl;
+		return ERROR_OPENING_FILE;
+	}
+	TrajectoryHeader header = {};
+	std::memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic));
+	header.version = TRAJECTORY_VERSION;
+	header.byteOrder = NETWORK_BYTE_ORDER_MARK;
+	header.network = checkpointNetworkKey();
+	header.numNodes = uint32_t(VALID_NODES);
+	header.maxCitizens = uint32_t(citizens.max());
+	header.startTick = simTick;
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	block = PendingBlock();
+	block.firstTick = simTick;
+	block.lastTick = simTick;
+	keyframe();
+
+	running = true;
+	writer = std::thread(&Trajectory::writerThread, this);
+	return AOK;
+}
+
+// the state of every active citizen, at the end of block.firstTick
+void Trajectory::keyframe() {
+	for (int i = 0; i < int(citizens.size()); i++) {
+		Citizen& c = citizens[i];
+		if (c.status == STATUS_DESPAWNED) continue;
+		// the timer restarts on most transitions, which is close enough to find citizens that are stuck
+		uint64_t age = std::min(uint64_t(c.timer / CITIZEN_SPEED), block.firstTick);
+		block.events.push_back(trajectoryEvent(c, i, block.firstTick - age));
+	}
+	block.keyframeEvents = uint32_t(block.events.size());
+	lastKeyframe = block.firstTick;
+}
+
+void Trajectory::endTick(uint64_t tick) {
+	if (!running) return;
+	block.lastTick = tick;
+	if (block.events.size() - block.keyframeEvents < TRAJECTORY_BLOCK_EVENTS && tick - block.firstTick < TRAJECTORY_BLOCK_TICKS) {
+		return;
+	}
+	submit();
+	block.firstTick = tick;
+	block.lastTick = tick;
+	if (tick - lastKeyframe >= TRAJECTORY_KEYFRAME_TICKS) {
+		keyframe();
+	}
+}
+
+void Trajectory::submit() {
+	// blocks can't be dropped without breaking every later one up to the next keyframe, so wait for the writer instead
+	while (!ring.push(std::move(block))) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	block.events = std::vector<TrajectoryEvent>();
+	block.events.reserve(TRAJECTORY_BLOCK_EVENTS);
+	block.keyframeEvents = 0;
+}
+
+void Trajectory::close() {
+	if (!running) return;
+	submit();
+	running = false;
+	writer.join();
+	out.close();
+}
+
+void Trajectory::writerThread() {
+	PendingBlock pending;
+	while (true) {
+		// checked before draining, so blocks submitted before close() are always written
+		bool stopping = !running;
+		while (ring.pop(pending)) {
+			write(pending);
+		}
+		if (stopping) break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(TRAJECTORY_WRITER_MS));
+	}
+}
+
+void Trajectory::write(const PendingBlock& pending) {
+	std::vector<uint8_t> raw;
+	std::vector<uint8_t> compressed;
+	raw.reserve(pending.events.size() * 6);
+	encodeEvents(pending.events, pending.firstTick, raw);
+	compress(raw.data(), raw.size(), compressed);
+
+	TrajectoryBlock header = {};
+	header.firstTick = pending.firstTick;
+	header.lastTick = pending.lastTick;
+	header.events = uint32_t(pending.events.size());
+	header.keyframeEvents = pending.keyframeEvents;
+	header.rawSize = uint32_t(raw.size());
+	header.compressedSize = uint32_t(compressed.size());
+	header.checksum = networkChecksum(compressed.data(), compressed.size());
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(compressed.data()), std::streamsize(compressed.size()));
+	// whole blocks only, so the recording of a run that crashed can still be replayed up to its last block
+	out.flush();
+	written += pending.events.size();
+	bytes += sizeof(header) + compressed.size();
+}
+
+int TrajectoryReplay::open(const std::string& filename) {
+	if (!file.open(filename)) {
+		std::cerr << "Error opening " << filename << std::endl;
+		return ERROR_OPENING_FILE;
+	}
+	if (file.size() < sizeof(TrajectoryHeader)) {
+		std::cout << "ERR: " << filename << " is truncated" << std::endl;
+		return ERROR_INVALID_FILE;
+	}
+	std::memcpy(&header, file.data(), sizeof(header));
+	if (std::memcmp(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic)) != 0 || header.byteOrder != NETWORK_BYTE_ORDER_MARK || header.version != TRAJECTORY_VERSION) {
+		std::cout << "ERR: " << filename << " is not a trajectory of this version for this machine" << std::endl;
+		return ERROR_INVALID_FILE;
+	}
+	if (header.network != checkpointNetworkKey() || header.numNodes != uint32_t(VALID_NODES)) {
+		std::cout << "ERR: " << filename << " was recorded with another network" << std::endl;
+		return ERROR_INVALID_FILE;
+	}
+
+	// index the blocks, a run that did not shut down cleanly may have left a partial one at the end
+	size_t position = sizeof(TrajectoryHeader);
+	uint64_t tick = header.startTick;
+	while (position + sizeof(TrajectoryBlock) <= file.size()) {
+		TrajectoryBlock b;
+		std::memcpy(&b, file.data() + position, sizeof(b));
+		if (b.compressedSize > file.size() - position - sizeof(b)) break;
+		if (b.firstTick != tick || b.lastTick < b.firstTick || b.keyframeEvents > b.events || b.rawSize / 4 < b.events || b.rawSize / 256 > b.compressedSize || (blocks.empty() && b.keyframeEvents == 0 && b.events > 0)) {
+			std::cout << "ERR: " << filename << " has an invalid block at byte " << position << std::endl;
+			return ERROR_INVALID_FILE;
+		}
+		blocks.push_back({ b.firstTick, b.lastTick, b.keyframeEvents, file.data() + position });
+		tick = b.lastTick;
+		position += sizeof(b) + b.compressedSize;
+	}
+	if (position != file.size()) {
+		std::cout << "WARN: " << filename << " ends in a partial block, replaying up to tick " << tick << std::endl;
+	}
+	if (blocks.empty()) {
+		std::cout << "ERR: " << filename << " holds no blocks" << std::endl;
+		return ERROR_INVALID_FILE;
+	}
+
+	citizens.assign(header.maxCitizens, { 0, TRAJECTORY_NULL, TRAJECTORY_NULL, STATUS_DESPAWNED });
+	std::cout << "Replaying " << filename << ": ticks " << firstTick() << "-" << lastTick() << " in " << blocks.size() << " blocks" << std::endl;
+	return AOK;
+}
+
+bool TrajectoryReplay::decode(size_t b) {
+	if (decodedBlock == b) return true;
+	TrajectoryBlock h;
+	std::memcpy(&h, blocks[b].data, sizeof(h));
+	const uint8_t* compressed = blocks[b].data + sizeof(h);
+	std::vector<uint8_t> raw(h.rawSize);
+	if (networkChecksum(compressed, h.compressedSize) != h.checksum || !decompress(compressed, h.compressedSize, raw.data(), raw.size()) ||
+		!decodeEvents(raw.data(), raw.size(), h.firstTick, h.events, header.maxCitizens, events)) {
+		// replay what came before it
+		std::cout << "ERR: trajectory block " << b << " is corrupt, replaying up to tick " << blocks[b].firstTick << std::endl;
+		blocks.resize(b);
+		decodedBlock = SIZE_MAX;
+		events.clear();
+		return false;
+	}
+	decodedBlock = b;
+	return true;
+}
+
+void TrajectoryReplay::reset(size_t keyframeBlock) {
+	for (TrajectoryState& s : citizens) {
+		s.status = STATUS_DESPAWNED;
+	}
+	active = 0;
+	nextBlock = keyframeBlock;
+	nextEvent = 0;
+	currentTick = blocks[keyframeBlock].firstTick;
+	if (!decode(keyframeBlock)) return;
+	for (; nextEvent < blocks[keyframeBlock].keyframeEvents; nextEvent++) {
+		apply(events[nextEvent]);
+	}
+}
+
+void TrajectoryReplay::apply(const TrajectoryEvent& e) {
+	TrajectoryState& s = citizens[e.citizen];
+	if (s.status != STATUS_DESPAWNED) active--;
+	s = { e.tick, e.node, e.line, e.status };
+	if (s.status != STATUS_DESPAWNED) active++;
+}
+
+void TrajectoryReplay::seek(uint64_t tick) {
+	if (blocks.empty()) return;
+	tick = std::max(firstTick(), std::min(tick, lastTick()));
+
+	// start over from the last keyframe before tick when going back or when it is further than the current position
+	size_t keyframe = 0;
+	for (size_t b = 0; b < blocks.size() && blocks[b].firstTick <= tick; b++) {
+		if (blocks[b].keyframeEvents > 0) keyframe = b;
+	}
+	if (!positioned || tick < currentTick || keyframe > nextBlock) {
+		reset(keyframe);
+		positioned = true;
+		if (blocks.empty()) return;
+	}
+
+	// events of a block are after its firstTick, keyframe events are skipped when playing through
+	while (nextBlock < blocks.size() && blocks[nextBlock].firstTick < tick) {
+		if (!decode(nextBlock)) break;
+		while (nextEvent < events.size() && events[nextEvent].tick <= tick) {
+			apply(events[nextEvent++]);
+		}
+		if (nextEvent < events.size()) break;
+		nextBlock++;
+		nextEvent = nextBlock < blocks.size() ? blocks[nextBlock].keyframeEvents : 0;
+	}
+	currentTick = std::min(tick, lastTick());
+}
+
+void TrajectoryReplay::countNodes(uint64_t stuckTicks, std::vector<unsigned int>& waiting, std::vector<unsigned int>& stuck) {
+	waiting.assign(header.numNodes, 0);
+	stuck.assign(header.numNodes, 0);
+	for (TrajectoryState& s : citizens) {
+		if (s.status == STATUS_DESPAWNED || s.node < 0) continue;
+		if (s.status == STATUS_TRANSFER || s.status == STATUS_AT_STOP) {
+			waiting[s.node]++;
+		}
+		// same rule as debugReport: walking citizens are never stuck
+		if (s.status != STATUS_WALK && currentTick - s.since > stuckTicks) {
+			stuck[s.node]++;
+		}
+	}
+}
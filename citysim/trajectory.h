@@ -0,0 +1,164 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "macros.h"
+#include "network.h"
+#include "spscring.h"
+
+class Citizen;
+
+// Trajectory file layout (written by Trajectory, native byte order):
+// TrajectoryHeader, then TrajectoryBlock headers each followed by compressedSize bytes, until the end of the file
+// a block holds the events of a run of whole ticks, delta and varint encoded (see encodeEvents), then LZ compressed
+// keyframe blocks start with the state of every active citizen, so replays can seek to them without reading earlier blocks
+#define TRAJECTORY_MAGIC			"CSTRAJEC"
+#define TRAJECTORY_VERSION			1
+#define TRAJECTORY_NULL				-2 // index of a null node/line pointer (the walking line is GRAPH_WALKING_LINE)
+
+struct TrajectoryHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint64_t network; // see checkpointNetworkKey
+	uint32_t numNodes;
+	uint32_t maxCitizens; // citizen indices are below this
+	uint64_t startTick; // tick of the first keyframe
+};
+
+struct TrajectoryBlock {
+	uint64_t firstTick;
+	uint64_t lastTick;
+	uint32_t events;
+	uint32_t keyframeEvents; // the first n events are the state at firstTick (0 if this is no keyframe)
+	uint32_t rawSize; // encoded size before compression
+	uint32_t compressedSize;
+	uint64_t checksum; // over the compressed bytes
+};
+
+// a citizen reaching a new status or node (state after the transition)
+struct TrajectoryEvent {
+	uint64_t tick; // for keyframe events, the tick of the citizen's last transition (estimated from its timer)
+	int32_t citizen; // index in citizens
+	int32_t node; // currentNode
+	int32_t line; // line of the train the citizen is on, currentLine otherwise
+	uint8_t status;
+};
+
+// records citizen state transitions to a trajectory file from a background writer thread
+// the simulation only appends fixed-size events, blocks are encoded, compressed and written by the writer
+class Trajectory {
+public:
+	Trajectory();
+	Trajectory(const Trajectory&) = delete;
+	Trajectory& operator=(const Trajectory&) = delete;
+	~Trajectory();
+
+	// creates filename, writes the header and starts the writer (the first block is a keyframe of the current citizens)
+	int open(const std::string& filename);
+	// simulation thread only, events of one tick in citizen order
+	inline void record(const std::vector<TrajectoryEvent>& events) {
+		block.events.insert(block.events.end(), events.begin(), events.end());
+	}
+	// simulation thread only, between ticks: hands the block to the writer once it is full and starts keyframes (nothing unless open)
+	void endTick(uint64_t tick);
+	// writes every pending block and stops the writer
+	void close();
+
+	inline uint64_t eventsWritten() {
+		return written;
+	}
+	inline uint64_t bytesWritten() {
+		return bytes;
+	}
+	// the block being filled and the ring's slots (blocks waiting for the writer are not counted, it owns them)
+	inline size_t memoryBytes() {
+		return block.events.capacity() * sizeof(TrajectoryEvent) + ring.capacity() * sizeof(PendingBlock);
+	}
+private:
+	struct PendingBlock {
+		uint64_t firstTick = 0;
+		uint64_t lastTick = 0;
+		uint32_t keyframeEvents = 0;
+		std::vector<TrajectoryEvent> events;
+	};
+
+	PendingBlock block; // being filled by the simulation thread
+	uint64_t lastKeyframe = 0;
+	SpscRing<PendingBlock> ring;
+	std::ofstream out;
+	std::thread writer;
+	std::atomic<bool> running{ false };
+	std::atomic<uint64_t> written{ 0 };
+	std::atomic<uint64_t> bytes{ 0 };
+
+	void keyframe();
+	void submit();
+	void writerThread();
+	void write(const PendingBlock& pending);
+};
+
+// state of a citizen at a given tick, from the last event that touched it
+struct TrajectoryState {
+	uint64_t since; // tick of the last transition
+	int32_t node;
+	int32_t line;
+	uint8_t status;
+};
+
+// plays a trajectory file back (seeking forward and backward) without running the simulation
+class TrajectoryReplay {
+public:
+	// maps filename and indexes its blocks, fails if it was recorded with another network
+	int open(const std::string& filename);
+
+	// moves the state to the end of tick (clamped to the recording)
+	void seek(uint64_t tick);
+
+	inline uint64_t tick() {
+		return currentTick;
+	}
+	inline uint64_t firstTick() {
+		return blocks.empty() ? 0 : blocks.front().firstTick;
+	}
+	inline uint64_t lastTick() {
+		return blocks.empty() ? 0 : blocks.back().lastTick;
+	}
+	inline size_t numBlocks() {
+		return blocks.size();
+	}
+
+	std::vector<TrajectoryState> citizens; // indexed by citizen, despawned citizens have STATUS_DESPAWNED
+	size_t active = 0; // citizens that are not despawned
+
+	// per node: citizens waiting at it (TRANSFER/AT_STOP) and those without a transition for over stuckTicks
+	void countNodes(uint64_t stuckTicks, std::vector<unsigned int>& waiting, std::vector<unsigned int>& stuck);
+private:
+	struct IndexedBlock {
+		uint64_t firstTick;
+		uint64_t lastTick;
+		uint32_t keyframeEvents;
+		const uint8_t* data; // TrajectoryBlock, then the compressed events
+	};
+
+	MappedFile file;
+	TrajectoryHeader header;
+	std::vector<IndexedBlock> blocks;
+	std::vector<TrajectoryEvent> events; // decoded events of blocks[decodedBlock]
+	size_t decodedBlock = SIZE_MAX;
+	size_t nextBlock = 0; // first block not fully applied
+	size_t nextEvent = 0; // first event of nextBlock not applied
+	uint64_t currentTick = 0;
+	bool positioned = false; // false until the first seek
+
+	bool decode(size_t b);
+	void reset(size_t keyframeBlock);
+	void apply(const TrajectoryEvent& e);
+};
+
+// fills an event with the citizen's state after a transition
+TrajectoryEvent trajectoryEvent(const Citizen& c, int index, uint64_t tick);
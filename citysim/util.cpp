@@ -1,5 +1,15 @@
+#include <cmath>
 #include "util.h"
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
 // utility function to parse hex string into sf::Color
 // requires 6 character string
 void util::colorConvert(sf::Color* v, const std::string& a) {
@@ -11,5 +21,65 @@ void util::colorConvert(sf::Color* v, const std::string& a) {
 
 // utility function to update capacity of node/train by -1 without uint overflow
 void util::subCapacity(unsigned int* ptr) {
-	*ptr = std::min(*ptr - 1, 0u);
-}
\ No newline at end of file
+	if (*ptr > 0) (*ptr)--;
+}
+
+// utility function to create an independent random number stream (one per thread) from a shared seed
+std::mt19937_64 util::rngStream(unsigned int seed, unsigned int stream) {
+	std::seed_seq seq{ seed, stream };
+	return std::mt19937_64(seq);
+}
+
+// utility function to get the peak resident set size of the process in bytes (0 if the platform has no way to tell)
+size_t util::peakResidentBytes() {
+	#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return counters.PeakWorkingSetSize;
+	#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+	#ifdef __APPLE__
+	return size_t(usage.ru_maxrss); // bytes on macOS
+	#else
+	return size_t(usage.ru_maxrss) * 1024; // KiB on Linux
+	#endif
+	#endif
+}
+
+// utility function to parse a whole string as an unsigned number (digits only, no sign or trailing characters)
+bool util::parseUnsigned(const std::string& s, unsigned long* v) {
+	if (s.empty() || s[0] < '0' || s[0] > '9') return false;
+	try {
+		size_t used;
+		*v = std::stoul(s, &used);
+		return used == s.size();
+	}
+	catch (const std::exception&) {
+		return false;
+	}
+}
+
+// utility function to parse a whole string as an int (no trailing characters)
+bool util::parseInt(const std::string& s, int* v) {
+	try {
+		size_t used;
+		*v = std::stoi(s, &used);
+		return used == s.size();
+	}
+	catch (const std::exception&) {
+		return false;
+	}
+}
+
+// utility function to parse a whole string as a finite number (no trailing characters, nan or inf)
+bool util::parseDouble(const std::string& s, double* v) {
+	try {
+		size_t used;
+		*v = std::stod(s, &used);
+		return used == s.size() && std::isfinite(*v);
+	}
+	catch (const std::exception&) {
+		return false;
+	}
+}
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <SFML/Graphics.hpp>
+#include <random>
+#include <vector>
 
 namespace util {
 	// utility function to parse hex string into sf::Color
@@ -9,4 +11,23 @@ namespace util {
 
 	// utility function to update capacity of node/train by -1 without uint overflow
 	void subCapacity(unsigned int* ptr);
+
+	// utility function to create an independent random number stream (one per thread) from a shared seed
+	std::mt19937_64 rngStream(unsigned int seed, unsigned int stream);
+
+	// utility function to parse a whole string as an unsigned number (digits only, no sign or trailing characters), false if it is not one
+	bool parseUnsigned(const std::string& s, unsigned long* v);
+	// utility function to parse a whole string as an int (no trailing characters), false if it is not one
+	bool parseInt(const std::string& s, int* v);
+	// utility function to parse a whole string as a finite number (no trailing characters, nan or inf), false if it is not one
+	bool parseDouble(const std::string& s, double* v);
+
+	// utility function to get the peak resident set size of the process in bytes (0 if the platform has no way to tell)
+	size_t peakResidentBytes();
+
+	// utility function to get the bytes a vector holds (its capacity, not its size)
+	template<class T>
+	inline size_t vectorBytes(const std::vector<T>& v) {
+		return v.capacity() * sizeof(T);
+	}
 }
\ No newline at end of file